@@ -0,0 +1,283 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* Benchmark driver: ingests a data file into a local sink (null, file,
+ * sqlite3) for a number of block sizes and reports rows/s and peak memory.
+ * Each run is done in its own process, so that the peak RSS belongs to
+ * this run only.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <Schema.h>
+#include <DBIngestor.h>
+#include <DBAdaptorsFactory.h>
+#include <AsserterFactory.h>
+#include <ConverterFactory.h>
+#include "Sag_Reader.h"
+#include "Sag_SchemaMapper.h"
+#include "Sag_DBConnection.h"
+#include "Sag_RowBatch.h"
+#include "Sag_BenchSinks.h"
+#include "sagingest_error.h"
+
+using namespace Sag;
+using namespace std;
+namespace po = boost::program_options;
+
+
+class BenchResult {
+    public:
+        string sink;
+        long blocksize;
+        long rows;
+        double seconds;
+        long peakRSS;   // kB
+
+        BenchResult() {
+            blocksize = 0;
+            rows = 0;
+            seconds = 0;
+            peakRSS = 0;
+        }
+};
+
+
+long runIngest(string dataFile, string mapFile, string sink, long blocksize, string tmpDir, int decompressThreads) {
+    // one benchmark run; this is executed in the child process
+    DBAsserter::AsserterFactory * assertFac = new DBAsserter::AsserterFactory;
+    DBConverter::ConverterFactory * convFac = new DBConverter::ConverterFactory;
+    SagSchemaMapper * mapper = new SagSchemaMapper(assertFac, convFac);
+    vector<string> fieldNames = mapper->readMappingFile(mapFile);
+    DBDataSchema::Schema * schema = mapper->generateSchema("", "bench");
+    long numRows = 0;
+
+    SagReader reader(dataFile, 0, blocksize, fieldNames);
+    reader.setDecompressThreads(decompressThreads);
+    reader.setPrecisions(mapper->getPrecisions());
+    reader.setNulls(mapper->getNulls());
+
+    if (sink == "null") {
+        NullSink nullSink;
+        numRows = drainReader(&reader, schema, &nullSink);
+    } else if (sink == "file") {
+        RowLayout layout(schema);
+        FileSink fileSink(tmpDir + "/SagBenchmark.rows", layout);
+        numRows = drainReader(&reader, schema, &fileSink);
+        unlink((tmpDir + "/SagBenchmark.rows").c_str());
+#ifdef DB_SQLITE3
+    } else if (sink == "sqlite") {
+        // the real ingest path, with DBIngestor and its sqlite3 adaptor
+        DBServer::DBAdaptorsFactory adaptorFac;
+        DBConnInfo conn;
+        conn.system = "sqlite3";
+        conn.table = "bench";
+        conn.path = tmpDir + "/SagBenchmark.sqlite";
+        conn.askUserToValidateRead = false;
+        conn.outputFreq = 1000000000;
+
+        unlink(conn.path.c_str());
+        createSqliteTable(conn.path, schema);
+        DBServer::DBAbstractor * dbServer = adaptorFac.getDBAdaptors(conn.system);
+        DBIngest::DBIngestor ingestor(schema, &reader, dbServer);
+        setupIngestor(&ingestor, conn);
+        ingestor.ingestData(128);
+        numRows = countSqliteRows(conn.path, conn.table);
+        unlink(conn.path.c_str());
+#endif
+    } else {
+        cout << "ERROR: Unknown sink " << sink << endl;
+        return -1;
+    }
+
+    return numRows;
+}
+
+BenchResult runForked(string dataFile, string mapFile, string sink, long blocksize, string tmpDir, int decompressThreads, bool verbose) {
+    BenchResult r;
+    int fds[2];
+    pid_t pid;
+    int status;
+    struct rusage usage;
+
+    r.sink = sink;
+    r.blocksize = blocksize;
+
+    if (pipe(fds) != 0) {
+        SagIngest_error("SagBenchmark: Cannot create pipe.\n");
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        SagIngest_error("SagBenchmark: Cannot fork.\n");
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        if (!verbose) {
+            // the reader is talkative; only the result goes through the pipe
+            int devnull = open("/dev/null", O_WRONLY);
+            dup2(devnull, STDOUT_FILENO);
+        }
+
+        boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+        long rows = runIngest(dataFile, mapFile, sink, blocksize, tmpDir, decompressThreads);
+        boost::posix_time::ptime endTime = boost::posix_time::microsec_clock::universal_time();
+        double seconds = (endTime - startTime).total_microseconds() * 1.e-6;
+
+        char result[128];
+        int len = snprintf(result, sizeof(result), "%ld %.6f\n", rows, seconds);
+        if (write(fds[1], result, len) != len) {
+            _exit(EXIT_FAILURE);
+        }
+        close(fds[1]);
+        _exit(rows < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    char buffer[128] = "";
+    ssize_t len = read(fds[0], buffer, sizeof(buffer) - 1);
+    close(fds[0]);
+    wait4(pid, &status, 0, &usage);
+
+    if (len <= 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        cout << "ERROR: Benchmark run failed (sink " << sink << ", blocksize " << blocksize << ")" << endl;
+        r.rows = -1;
+        return r;
+    }
+
+    buffer[len] = '\0';
+    sscanf(buffer, "%ld %lf", &r.rows, &r.seconds);
+    r.peakRSS = usage.ru_maxrss;
+    return r;
+}
+
+vector<string> splitList(const string &list) {
+    vector<string> items;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+
+int main (int argc, const char * argv[])
+{
+    string dataFile;
+    string mapFile;
+    string sinkList;
+    string blocksizeList;
+    string tmpDir;
+    string csvFile;
+    int repeat;
+    int decompressThreads;
+    bool verbose;
+
+    po::options_description progDesc("SagBenchmark - Measure ingest speed of SAG HDF5 files with local sinks\n\nSagBenchmark [OPTIONS] dataFile\n\nCommand line options:");
+
+    progDesc.add_options()
+                ("help,?", "output help")
+                ("data,d", po::value<string>(&dataFile), "datafile to ingest")
+                ("mapFile,f", po::value<string>(&mapFile)->default_value(""), "path to the mapping file")
+                ("sinks", po::value<string>(&sinkList)->default_value("null,file,sqlite"), "comma separated list of sinks: null, file, sqlite [default: null,file,sqlite]")
+                ("blocksizes", po::value<string>(&blocksizeList)->default_value("1000,10000,100000,1000000"), "comma separated list of block sizes [default: 1000,10000,100000,1000000]")
+                ("repeat", po::value<int>(&repeat)->default_value(3), "runs per configuration, the fastest one is reported [default: 3]")
+                ("tmpDir", po::value<string>(&tmpDir)->default_value("."), "directory for the output of the file and sqlite sinks [default: .]")
+                ("csv", po::value<string>(&csvFile)->default_value(""), "also write all runs to this csv file")
+                ("decompressThreads", po::value<int>(&decompressThreads)->default_value(0), "threads for decompressing chunks in the reader (0: HDF5 decompresses) [default: 0]")
+                ("verbose", po::value<bool>(&verbose)->default_value(0), "show the output of the reader [default: 0]")
+                ;
+
+    po::positional_options_description posDesc;
+    posDesc.add("data", 1);
+
+    po::variables_map varMap;
+    po::store(po::command_line_parser(argc, (char **) argv).options(progDesc).positional(posDesc).run(), varMap);
+    po::notify(varMap);
+
+    if (varMap.count("help") || varMap.count("?") || dataFile.length() == 0 || mapFile.length() == 0) {
+        cout << progDesc;
+        return EXIT_SUCCESS;
+    }
+
+    vector<string> sinks = splitList(sinkList);
+    vector<string> blocksizes = splitList(blocksizeList);
+    ofstream csv;
+    if (csvFile != "") {
+        csv.open(csvFile.c_str());
+        csv << "file,sink,blocksize,run,rows,seconds,rows_per_s,peak_rss_kb" << endl;
+    }
+
+    cout << "Data file: " << dataFile << endl;
+    cout << "Mapping file: " << mapFile << endl;
+    cout << endl;
+    cout << setw(8) << "sink" << setw(12) << "blocksize" << setw(12) << "rows" << setw(12) << "seconds"
+         << setw(14) << "rows/s" << setw(14) << "peak RSS MB" << endl;
+
+    int failed = 0;
+    for (int s=0; s<sinks.size(); s++) {
+#ifndef DB_SQLITE3
+        if (sinks[s] == "sqlite") {
+            cout << "sqlite sink not available (compiled without sqlite3)" << endl;
+            continue;
+        }
+#endif
+        for (int b=0; b<blocksizes.size(); b++) {
+            BenchResult best;
+            for (int k=0; k<repeat; k++) {
+                BenchResult r = runForked(dataFile, mapFile, sinks[s], atol(blocksizes[b].c_str()), tmpDir, decompressThreads, verbose);
+                if (r.rows < 0) {
+                    failed++;
+                    break;
+                }
+                if (csv.is_open()) {
+                    csv << dataFile << "," << r.sink << "," << r.blocksize << "," << k << "," << r.rows << ","
+                        << r.seconds << "," << r.rows / r.seconds << "," << r.peakRSS << endl;
+                }
+                if (k == 0 || r.seconds < best.seconds) {
+                    best = r;
+                }
+            }
+            if (best.rows <= 0) {
+                continue;
+            }
+            cout << setw(8) << best.sink << setw(12) << best.blocksize << setw(12) << best.rows
+                 << setw(12) << fixed << setprecision(3) << best.seconds
+                 << setw(14) << setprecision(0) << best.rows / best.seconds
+                 << setw(14) << setprecision(1) << best.peakRSS / 1024. << endl;
+        }
+    }
+
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* Generator for synthetic SAG-like HDF5 files, for benchmarking the
+ * ingest with files of arbitrary size and layout.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "H5Cpp.h"
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace H5;
+namespace po = boost::program_options;
+
+
+class GenColumn {
+    public:
+        string name;    // path of the dataset, relative to the output group
+        string type;    // long, int8, float or double
+        int ncomp;      // 1 for normal columns, > 1 for N x ncomp datasets
+};
+
+// simple reproducible random numbers (64 bit LCG), one stream per column
+class GenRandom {
+    private:
+        uint64_t state;
+    public:
+        GenRandom(uint64_t seed) {
+            state = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        double uniform() {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return (state >> 11) * (1.0 / 9007199254740992.0);
+        }
+};
+
+
+vector<GenColumn> parseColumns(const string &spec) {
+    // format: name:type[:ncomp],name:type[:ncomp],...
+    vector<GenColumn> cols;
+    stringstream ss(spec);
+    string item;
+
+    while (getline(ss, item, ',')) {
+        GenColumn c;
+        stringstream is(item);
+        string ncomp;
+        getline(is, c.name, ':');
+        getline(is, c.type, ':');
+        c.ncomp = getline(is, ncomp, ':') ? atoi(ncomp.c_str()) : 1;
+        if (c.type != "long" && c.type != "int8" && c.type != "float" && c.type != "double") {
+            cout << "ERROR: Unknown column type " << c.type << " for column " << c.name << endl;
+            exit(EXIT_FAILURE);
+        }
+        if (c.ncomp < 1) {
+            cout << "ERROR: Number of components must be at least 1 for column " << c.name << endl;
+            exit(EXIT_FAILURE);
+        }
+        cols.push_back(c);
+    }
+    return cols;
+}
+
+void createGroups(H5File &file, const string &path) {
+    // create all groups along the path of a dataset (like mkdir -p)
+    size_t pos = 1;
+    string groupName;
+    while ((pos = path.find('/', pos)) != string::npos) {
+        groupName = path.substr(0, pos);
+        if (!H5Lexists(file.getId(), groupName.c_str(), H5P_DEFAULT)) {
+            file.createGroup(groupName);
+        }
+        pos++;
+    }
+}
+
+void writeColumn(H5File &file, const string &path, const GenColumn &col, long nrows, long chunkRows, int compress, bool shuffle, uint64_t seed, double boxSize, long idOffset) {
+    hsize_t dims[2], cdims[2], offset[2], count[2];
+    int rank = (col.ncomp > 1) ? 2 : 1;
+    long blockRows = 1000000;
+    PredType memtype = PredType::NATIVE_FLOAT;
+    PredType filetype = PredType::NATIVE_FLOAT;
+    size_t elemsize = sizeof(float);
+
+    if (col.type == "long") {
+        memtype = PredType::NATIVE_LONG;
+        filetype = PredType::STD_I64LE;
+        elemsize = sizeof(long);
+    } else if (col.type == "int8") {
+        memtype = PredType::NATIVE_INT8;
+        filetype = PredType::STD_I8LE;
+        elemsize = sizeof(int8_t);
+    } else if (col.type == "double") {
+        memtype = PredType::NATIVE_DOUBLE;
+        filetype = PredType::IEEE_F64LE;
+        elemsize = sizeof(double);
+    } else {
+        filetype = PredType::IEEE_F32LE;
+    }
+
+    dims[0] = nrows;
+    dims[1] = col.ncomp;
+    DataSpace filespace(rank, dims);
+
+    DSetCreatPropList plist;
+    if (chunkRows > 0) {
+        cdims[0] = min(chunkRows, max(nrows, 1L));
+        cdims[1] = col.ncomp;
+        plist.setChunk(rank, cdims);
+        if (shuffle) {
+            plist.setShuffle();
+        }
+        if (compress > 0) {
+            plist.setDeflate(compress);
+        }
+    }
+
+    createGroups(file, path);
+    DataSet dataset = file.createDataSet(path, filetype, filespace, plist);
+
+    // positions are in kpc/h, like in SAG (the reader converts to Mpc/h)
+    bool isPos = (col.name == "X" || col.name == "Y" || col.name == "Z");
+    bool isId = (col.name == "GalaxyID");
+    GenRandom rnd(seed);
+    vector<char> buffer(blockRows * col.ncomp * elemsize);
+
+    for (long start = 0; start < nrows; start += blockRows) {
+        long n = min(blockRows, nrows - start);
+        for (long i = 0; i < n * col.ncomp; i++) {
+            double r = rnd.uniform();
+            if (col.type == "long") {
+                ((long*) &buffer[0])[i] = isId ? idOffset + start + i : (long) (r * 1.e12);
+            } else if (col.type == "int8") {
+                ((int8_t*) &buffer[0])[i] = (int8_t) (r * 100);
+            } else if (col.type == "double") {
+                ((double*) &buffer[0])[i] = r * 1.e10;
+            } else {
+                ((float*) &buffer[0])[i] = isPos ? r * boxSize * 1000. : r * 1.e3;
+            }
+        }
+
+        offset[0] = start;
+        offset[1] = 0;
+        count[0] = n;
+        count[1] = col.ncomp;
+        filespace.selectHyperslab(H5S_SELECT_SET, count, offset);
+        DataSpace memspace(rank, count);
+        dataset.write(&buffer[0], memtype, memspace, filespace);
+    }
+}
+
+void writeOutputAttributes(Group &group, float redshift, int snapnum) {
+    hsize_t one = 1;
+    DataSpace scalar(1, &one);
+    Attribute att = group.createAttribute("Redshift", PredType::NATIVE_FLOAT, scalar);
+    att.write(PredType::NATIVE_FLOAT, &redshift);
+    Attribute att2 = group.createAttribute("Snapshot", PredType::NATIVE_INT, scalar);
+    att2.write(PredType::NATIVE_INT, &snapnum);
+}
+
+void writeFieldMap(const string &mapFile, const vector<GenColumn> &cols) {
+    ofstream out(mapFile.c_str());
+    if (!out) {
+        cout << "ERROR: Cannot write mapping file " << mapFile << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    out << "# generated by SagGenerate" << endl;
+    out << "snapnum                 INT4        snapnum         SMALLINT" << endl;
+    out << "redshift                REAL4       redshift        FLOAT" << endl;
+    out << "NInFile                 INT8        NInFile         BIGINT" << endl;
+    out << "fileNum                 INT4        fileNum         INTEGER" << endl;
+
+    for (int k=0; k<cols.size(); k++) {
+        const GenColumn &c = cols[k];
+        string ftype = "REAL4", dbtype = "FLOAT";
+        if (c.type == "long") {
+            ftype = "INT8";
+            dbtype = "BIGINT";
+        } else if (c.type == "int8") {
+            ftype = "INT1";
+            dbtype = "TINYINT";
+        } else if (c.type == "double") {
+            ftype = "REAL8";
+            dbtype = "REAL";
+        }
+
+        // database column names without the group path
+        string colName = c.name.substr(c.name.find_last_of('/') + 1);
+        for (int j=0; j<c.ncomp; j++) {
+            stringstream fname, dbname;
+            fname << "/" << c.name;
+            dbname << colName;
+            if (c.ncomp > 1) {
+                fname << "[" << j << "]";
+                dbname << "_" << j;
+            }
+            out << fname.str() << "    " << ftype << "    " << dbname.str() << "    " << dbtype << endl;
+        }
+    }
+}
+
+
+int main (int argc, const char * argv[])
+{
+    string outFile;
+    string mapFile;
+    string columnSpec;
+    long nrows;
+    int numOutputs;
+    int extraColumns;
+    string extraType;
+    int nesting;
+    long chunkRows;
+    int compress;
+    bool shuffle;
+    double boxSize;
+    int seed;
+
+    po::options_description progDesc("SagGenerate - Generate synthetic SAG-like HDF5 files for benchmarks\n\nSagGenerate [OPTIONS] outFile\n\nCommand line options:");
+
+    progDesc.add_options()
+                ("help,?", "output help")
+                ("out,o", po::value<string>(&outFile), "HDF5 file to be written")
+                ("rows,n", po::value<long>(&nrows)->default_value(1000000), "number of rows (per output group) [default: 1000000]")
+                ("columns", po::value<string>(&columnSpec)->default_value("GalaxyID:long,X:float,Y:float,Z:float,Type:int8,Mvir:double,Pos:float:3"), "comma separated list of columns name:type[:ncomp], type is long, int8, float or double; names may contain groups (e.g. SED/Mag_r:float)")
+                ("extraColumns", po::value<int>(&extraColumns)->default_value(0), "number of additional generated columns [default: 0]")
+                ("extraType", po::value<string>(&extraType)->default_value("float"), "type of the additional columns [default: float]")
+                ("nesting", po::value<int>(&nesting)->default_value(0), "group depth for the additional columns (e.g. 2: /G1/G2/Col0001) [default: 0]")
+                ("outputs", po::value<int>(&numOutputs)->default_value(0), "number of Output* groups (0: datasets in the root group, like a single SAG snapshot) [default: 0]")
+                ("chunk", po::value<long>(&chunkRows)->default_value(0), "rows per chunk (0: contiguous layout) [default: 0]")
+                ("compress", po::value<int>(&compress)->default_value(0), "deflate level 1-9 for chunked datasets (0: no compression) [default: 0]")
+                ("shuffle", po::value<bool>(&shuffle)->default_value(0), "apply the shuffle filter to chunked datasets [default: 0]")
+                ("boxSize", po::value<double>(&boxSize)->default_value(100), "box size in Mpc/h for the X, Y, Z columns [default: 100]")
+                ("seed", po::value<int>(&seed)->default_value(42), "seed for the random values [default: 42]")
+                ("mapFile,f", po::value<string>(&mapFile)->default_value(""), "also write a mapping file for all generated columns")
+                ;
+
+    po::positional_options_description posDesc;
+    posDesc.add("out", 1);
+
+    po::variables_map varMap;
+    po::store(po::command_line_parser(argc, (char **) argv).options(progDesc).positional(posDesc).run(), varMap);
+    po::notify(varMap);
+
+    if (varMap.count("help") || varMap.count("?") || outFile.length() == 0) {
+        cout << progDesc;
+        return EXIT_SUCCESS;
+    }
+    if (compress > 0 && chunkRows <= 0) {
+        cout << "ERROR: Compression requires a chunked layout (--chunk)." << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<GenColumn> cols = parseColumns(columnSpec);
+    if (extraColumns > 0) {
+        parseColumns("check:" + extraType); // only validates the type
+    }
+    for (int k=0; k<extraColumns; k++) {
+        GenColumn c;
+        char name[32];
+        c.name = "";
+        for (int d=1; d<=nesting; d++) {
+            sprintf(name, "G%d/", d);
+            c.name += name;
+        }
+        sprintf(name, "Col%04d", k);
+        c.name += name;
+        c.type = extraType;
+        c.ncomp = 1;
+        cols.push_back(c);
+    }
+
+    cout << "Writing " << outFile << ": " << nrows << " rows, " << cols.size() << " columns";
+    if (numOutputs > 0) {
+        cout << ", " << numOutputs << " output groups";
+    }
+    cout << endl;
+
+    H5File file(outFile, H5F_ACC_TRUNC);
+    int ngroups = max(numOutputs, 1);
+    for (int g=0; g<ngroups; g++) {
+        string prefix = "";
+        int snapnum = 125 - (ngroups - 1 - g) * 10;
+        float redshift = (ngroups - 1 - g) * 0.5;
+        if (numOutputs > 0) {
+            char name[32];
+            sprintf(name, "/Output%d", snapnum);
+            prefix = name;
+            Group group = file.createGroup(prefix);
+            writeOutputAttributes(group, redshift, snapnum);
+        } else {
+            Group group = file.openGroup("/");
+            writeOutputAttributes(group, redshift, snapnum);
+        }
+        for (int k=0; k<cols.size(); k++) {
+            writeColumn(file, prefix + "/" + cols[k].name, cols[k], nrows, chunkRows, compress, shuffle, seed + 1000 * g + k, boxSize, (long) g * nrows);
+        }
+    }
+    file.close();
+
+    if (mapFile != "") {
+        writeFieldMap(mapFile, cols);
+        cout << "Mapping file written to " << mapFile << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* Microbenchmark for serving rows: drives SagReader like
+ * DBIngestor::ingestData (getNextRow, then getItemInRow for each item),
+ * but without a database, and reports the time per row and per item.
+ *
+ * The time for reading the blocks from the file (readNextBlock) is
+ * measured by the reader and subtracted, so only the row serving is left.
+ * Items are timed by running one pass per item and subtracting the pass
+ * without any items.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdlib.h>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <Schema.h>
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+#include <AsserterFactory.h>
+#include <ConverterFactory.h>
+#include "Sag_Reader.h"
+#include "Sag_SchemaMapper.h"
+
+using namespace Sag;
+using namespace std;
+namespace po = boost::program_options;
+
+
+class PassResult {
+    public:
+        long rows;
+        double serveSeconds;    // total time minus time in readNextBlock
+        double readSeconds;
+};
+
+const char * dtypeName(DBDataSchema::DType t) {
+    switch (t) {
+        case DBDataSchema::DT_INT1: return "INT1";
+        case DBDataSchema::DT_INT2: return "INT2";
+        case DBDataSchema::DT_INT4: return "INT4";
+        case DBDataSchema::DT_INT8: return "INT8";
+        case DBDataSchema::DT_REAL4: return "REAL4";
+        case DBDataSchema::DT_REAL8: return "REAL8";
+        default: return "other";
+    }
+}
+
+PassResult runPass(SagReader * reader, string dataFile, const vector<DBDataSchema::DataObjDesc*> &items) {
+    // one pass over the whole file, calling getItemInRow for the given items
+    PassResult r;
+    char result[64];
+    volatile char sink = 0;
+    long read0;
+
+    reader->closeFile();
+    reader->setFile(dataFile, 0);
+    read0 = reader->getReadMicroseconds();
+    r.rows = 0;
+
+    boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+    while (reader->getNextRow()) {
+        for (int j=0; j<items.size(); j++) {
+            reader->getItemInRow(items[j], true, true, result);
+            sink ^= result[0];
+        }
+        r.rows++;
+    }
+    boost::posix_time::ptime endTime = boost::posix_time::microsec_clock::universal_time();
+
+    r.readSeconds = (reader->getReadMicroseconds() - read0) * 1.e-6;
+    r.serveSeconds = (endTime - startTime).total_microseconds() * 1.e-6 - r.readSeconds;
+    return r;
+}
+
+PassResult bestPass(SagReader * reader, string dataFile, const vector<DBDataSchema::DataObjDesc*> &items, int passes) {
+    PassResult best, r;
+    for (int k=0; k<passes; k++) {
+        r = runPass(reader, dataFile, items);
+        if (k == 0 || r.serveSeconds < best.serveSeconds) {
+            best = r;
+        }
+    }
+    return best;
+}
+
+
+int main (int argc, const char * argv[])
+{
+    string dataFile;
+    string mapFile;
+    long blocksize;
+    int passes;
+    bool perItem;
+
+    po::options_description progDesc("SagHotLoop - Time per row and per item for serving rows from SagReader\n\nSagHotLoop [OPTIONS] dataFile\n\nCommand line options:");
+
+    progDesc.add_options()
+                ("help,?", "output help")
+                ("data,d", po::value<string>(&dataFile), "datafile to read")
+                ("mapFile,f", po::value<string>(&mapFile)->default_value(""), "path to the mapping file")
+                ("blocksize", po::value<long>(&blocksize)->default_value(100000), "number of rows to be read in one block [default: 100000]")
+                ("passes", po::value<int>(&passes)->default_value(3), "passes per measurement, the fastest one is used [default: 3]")
+                ("perItem", po::value<bool>(&perItem)->default_value(1), "time each item separately (one pass per item) [default: 1]")
+                ;
+
+    po::positional_options_description posDesc;
+    posDesc.add("data", 1);
+
+    po::variables_map varMap;
+    po::store(po::command_line_parser(argc, (char **) argv).options(progDesc).positional(posDesc).run(), varMap);
+    po::notify(varMap);
+
+    if (varMap.count("help") || varMap.count("?") || dataFile.length() == 0 || mapFile.length() == 0) {
+        cout << progDesc;
+        return EXIT_SUCCESS;
+    }
+
+    // the reader reports each block and dataset on cout, keep that away
+    ofstream devnull("/dev/null");
+    streambuf * coutBuf = cout.rdbuf(devnull.rdbuf());
+
+    DBAsserter::AsserterFactory * assertFac = new DBAsserter::AsserterFactory;
+    DBConverter::ConverterFactory * convFac = new DBConverter::ConverterFactory;
+    SagSchemaMapper * mapper = new SagSchemaMapper(assertFac, convFac);
+    vector<string> fieldNames = mapper->readMappingFile(mapFile);
+    DBDataSchema::Schema * schema = mapper->generateSchema("", "hotloop");
+    vector<DBDataSchema::SchemaItem*> schemaItems = schema->getArrSchemaItems();
+
+    vector<DBDataSchema::DataObjDesc*> allItems, noItems, oneItem(1);
+    for (int j=0; j<schemaItems.size(); j++) {
+        allItems.push_back(schemaItems[j]->getDataDesc());
+    }
+
+    SagReader reader(dataFile, 0, blocksize, fieldNames);
+    reader.setPrecisions(mapper->getPrecisions());
+    reader.setNulls(mapper->getNulls());
+
+    PassResult base = bestPass(&reader, dataFile, noItems, passes);
+    PassResult full = bestPass(&reader, dataFile, allItems, passes);
+
+    vector<double> itemNs(allItems.size(), 0.);
+    if (perItem) {
+        for (int j=0; j<allItems.size(); j++) {
+            oneItem[0] = allItems[j];
+            PassResult r = bestPass(&reader, dataFile, oneItem, passes);
+            itemNs[j] = (r.serveSeconds - base.serveSeconds) * 1.e9 / r.rows;
+        }
+    }
+
+    cout.rdbuf(coutBuf);
+
+    double nsRow = 1.e9 / base.rows;
+    cout << fixed << setprecision(2);
+    cout << "Data file: " << dataFile << " (" << base.rows << " rows, blocksize " << blocksize << ")" << endl;
+    cout << endl;
+    cout << "readNextBlock:                  " << setw(10) << full.readSeconds * nsRow << " ns/row" << endl;
+    cout << "getNextRow only:                " << setw(10) << base.serveSeconds * nsRow << " ns/row" << endl;
+    cout << "getNextRow + all " << setw(3) << allItems.size() << " items:    " << setw(10) << full.serveSeconds * nsRow << " ns/row" << endl;
+    if (allItems.size() > 0) {
+        cout << "per item (all items):           " << setw(10) << (full.serveSeconds - base.serveSeconds) * nsRow / allItems.size() << " ns/item" << endl;
+    }
+
+    if (!perItem) {
+        return 0;
+    }
+
+    // per item, and averaged by type; derived items (not read from a
+    // dataset, e.g. dbId, NInFile, snapnum) are listed separately
+    map<string, double> typeSum;
+    map<string, int> typeCount;
+    cout << endl;
+    cout << setw(40) << left << "item" << setw(8) << "type" << setw(10) << "source" << right << setw(12) << "ns/item" << endl;
+    for (int j=0; j<allItems.size(); j++) {
+        string name = allItems[j]->getDataObjName();
+        bool derived = (name.size() == 0 || name[0] != '/');
+        string type = dtypeName(allItems[j]->getDataObjDType());
+        if (allItems[j]->getIsConstItem()) {
+            type += "*"; // constant item
+        }
+        cout << setw(40) << left << name << setw(8) << type << setw(10) << (derived ? "derived" : "dataset") << right << setw(12) << itemNs[j] << endl;
+        if (!derived) {
+            typeSum[type] += itemNs[j];
+            typeCount[type]++;
+        }
+    }
+
+    cout << endl << "mean for dataset items by type:" << endl;
+    for (map<string, double>::iterator it = typeSum.begin(); it != typeSum.end(); it++) {
+        cout << setw(8) << left << it->first << right << setw(12) << it->second / typeCount[it->first] << " ns/item (" << typeCount[it->first] << " items)" << endl;
+    }
+
+    return 0;
+}
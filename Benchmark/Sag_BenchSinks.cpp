@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <vector>
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+#include <DBType.h>
+#ifdef DB_SQLITE3
+#include <sqlite3.h>
+#endif
+#include "sagingest_error.h"
+
+#include "Sag_BenchSinks.h"
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Sag {
+
+    void NullSink::writeRow(const char * row, const char * nulls) {
+    }
+
+
+    FileSink::FileSink(string fileName, const RowLayout &layout) {
+        fp = fopen(fileName.c_str(), "wb");
+        if (!fp) {
+            SagIngest_error("FileSink: Cannot open output file.\n");
+        }
+        rowSize = layout.rowSize;
+        numItems = layout.sizes.size();
+    }
+
+    FileSink::~FileSink() {
+        finish();
+    }
+
+    void FileSink::writeRow(const char * row, const char * nulls) {
+        fwrite(row, rowSize, 1, fp);
+        fwrite(nulls, numItems, 1, fp);
+    }
+
+    void FileSink::finish() {
+        if (fp) {
+            fclose(fp);
+            fp = NULL;
+        }
+    }
+
+
+    long drainReader(DBReader::Reader * reader, Schema * schema, RowSink * sink) {
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        RowLayout layout(schema);
+        vector<char> row(layout.rowSize + 1);
+        vector<char> nulls(items.size() + 1);
+        long numRows = 0;
+
+        while (reader->getNextRow()) {
+            for (int j=0; j<items.size(); j++) {
+                nulls[j] = reader->getItemInRow(items[j]->getDataDesc(), true, true, &row[layout.offsets[j]]);
+            }
+            sink->writeRow(&row[0], &nulls[0]);
+            numRows++;
+        }
+        sink->finish();
+
+        return numRows;
+    }
+
+
+#ifdef DB_SQLITE3
+    void createSqliteTable(string dbFile, Schema * schema) {
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        string sql;
+        sqlite3 * db;
+        char * errMsg = NULL;
+
+        if (sqlite3_open(dbFile.c_str(), &db) != SQLITE_OK) {
+            SagIngest_error("createSqliteTable: Cannot open sqlite3 database.\n");
+        }
+
+        sql = "DROP TABLE IF EXISTS " + schema->getTableName() + "; CREATE TABLE " + schema->getTableName() + " (";
+        for (int j=0; j<items.size(); j++) {
+            DBType t = items[j]->getColumnDBType();
+            sql += (j > 0) ? ", " : "";
+            sql += items[j]->getColumnName();
+            sql += (t == DBT_FLOAT || t == DBT_REAL || t == DBT_UFLOAT || t == DBT_UREAL) ? " REAL" : " INTEGER";
+        }
+        sql += ");";
+
+        if (sqlite3_exec(db, sql.c_str(), NULL, NULL, &errMsg) != SQLITE_OK) {
+            cout << "ERROR: " << errMsg << endl;
+            sqlite3_free(errMsg);
+            SagIngest_error("createSqliteTable: Cannot create table.\n");
+        }
+        sqlite3_close(db);
+    }
+
+    long countSqliteRows(string dbFile, string table) {
+        string sql = "SELECT COUNT(*) FROM " + table + ";";
+        sqlite3 * db;
+        sqlite3_stmt * stmt;
+        long count = -1;
+
+        if (sqlite3_open(dbFile.c_str(), &db) != SQLITE_OK) {
+            SagIngest_error("countSqliteRows: Cannot open sqlite3 database.\n");
+        }
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                count = sqlite3_column_int64(stmt, 0);
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(db);
+
+        return count;
+    }
+#endif
+
+}
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Reader.h>
+#include <Schema.h>
+#include <string>
+#include <stdio.h>
+
+#include "Sag_RowBatch.h"
+
+#ifndef Sag_Sag_BenchSinks_h
+#define Sag_Sag_BenchSinks_h
+
+namespace Sag {
+
+    // Destination for the rows of a benchmark run, instead of a database.
+    class RowSink {
+        public:
+            virtual ~RowSink() {}
+            virtual void writeRow(const char * row, const char * nulls) = 0;
+            virtual void finish() {}
+    };
+
+    // discards all rows
+    class NullSink : public RowSink {
+        public:
+            void writeRow(const char * row, const char * nulls);
+    };
+
+    // writes the rows in binary form (row layout as in RowBatch) to a file
+    class FileSink : public RowSink {
+        private:
+            FILE * fp;
+            int rowSize;
+            int numItems;
+        public:
+            FileSink(std::string fileName, const RowLayout &layout);
+            ~FileSink();
+            void writeRow(const char * row, const char * nulls);
+            void finish();
+    };
+
+    // Reads all rows from the reader the way DBIngestor::ingestData does
+    // (getNextRow, then getItemInRow for each schema item) and passes them
+    // to the sink. Returns the number of rows.
+    long drainReader(DBReader::Reader * reader, DBDataSchema::Schema * schema, RowSink * sink);
+
+#ifdef DB_SQLITE3
+    // create (or replace) the table for the schema in a sqlite3 database
+    void createSqliteTable(std::string dbFile, DBDataSchema::Schema * schema);
+
+    // number of rows in a table of a sqlite3 database
+    long countSqliteRows(std::string dbFile, std::string table);
+#endif
+
+}
+
+#endif
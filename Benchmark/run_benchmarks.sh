@@ -0,0 +1,31 @@
+#!/bin/sh
+# Reproducible ingest benchmark: generates a fixed set of synthetic SAG
+# files and runs SagBenchmark.x on each of them.
+#
+# usage: Benchmark/run_benchmarks.sh [build dir] [work dir] [rows]
+
+BUILD=${1:-build}
+WORK=${2:-bench_work}
+ROWS=${3:-2000000}
+SINKS=${SINKS:-null,file,sqlite}
+BLOCKSIZES=${BLOCKSIZES:-1000,10000,100000,1000000}
+
+set -e
+mkdir -p $WORK
+
+# name and generator options for each test file
+while read name options; do
+    if [ ! -f $WORK/$name.hdf5 ]; then
+        $BUILD/SagGenerate.x -n $ROWS $options -f $WORK/$name.fieldmap $WORK/$name.hdf5
+    fi
+    echo
+    echo "=== $name ($options)"
+    $BUILD/SagBenchmark.x -f $WORK/$name.fieldmap --sinks $SINKS --blocksizes $BLOCKSIZES \
+        --tmpDir $WORK --csv $WORK/$name.csv $WORK/$name.hdf5
+done <<LIST
+contiguous --chunk 0
+chunked --chunk 65536
+deflate --chunk 65536 --compress 4 --shuffle 1
+wide --chunk 65536 --extraColumns 100 --nesting 2
+outputs --chunk 65536 --outputs 4
+LIST
@@ -0,0 +1,13 @@
+DROP TABLE IF EXISTS `Sag_test_summary`;
+CREATE TABLE `Sag_test_summary` (
+snapnum BIGINT NOT NULL,
+HostHaloID BIGINT NOT NULL,
+nGalaxies BIGINT NOT NULL,
+sum_MZstarDisk DOUBLE NULL,
+max_HaloMass DOUBLE NULL,
+nMagg_0 BIGINT NOT NULL,
+nMagg_1 BIGINT NOT NULL,
+nMagg_2 BIGINT NOT NULL,
+nMagg_3 BIGINT NOT NULL,
+nMagg_4 BIGINT NOT NULL
+) ENGINE=MyISAM;
@@ -0,0 +1,506 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+#include <DType.h>
+#include <DBType.h>
+#include <DBIngestor.h>
+#include <DBAdaptorsFactory.h>
+
+#include "Sag_Aggregator.h"
+#include "Sag_RowBatch.h"
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Sag {
+
+    AggregateItem::AggregateItem() {
+        lo = 0;
+        hi = 0;
+        nbins = 0;
+    }
+
+
+    void AggregateSpec::readSpecFile(string specFile) {
+        ifstream fileStream;
+        string line;
+
+        fileStream.open(specFile.c_str(), ios::in);
+        if (!fileStream) {
+            cout << "ERROR: Cannot open file '" << specFile << "'. Maybe it does not exist?" << endl;
+            abort();
+        }
+
+        keys.clear();
+        items.clear();
+        while (getline(fileStream, line)) {
+            // skip empty lines and lines starting with #
+            if (line.substr(0,1) == "#" || line.size() == 0) {
+                continue;
+            }
+
+            stringstream ss(line);
+            string func;
+            AggregateItem item;
+
+            ss >> func;
+            if (func == "") {
+                continue;
+            }
+            if (func == "key") {
+                string key;
+                ss >> key;
+                if (key == "") {
+                    cout << "ERROR: Missing column in aggregate line '" << line << "'." << endl;
+                    abort();
+                }
+                keys.push_back(key);
+                continue;
+            }
+
+            item.func = func;
+            if (func == "count") {
+                // count or count * counts the rows, count column the non-NULL values
+                ss >> item.column;
+                ss >> item.name;
+                if (item.column == "*") {
+                    item.column = "";
+                }
+                if (item.name == "") {
+                    item.name = (item.column == "") ? string("nRows") : "n_" + item.column;
+                }
+            } else if (func == "sum" || func == "min" || func == "max" || func == "mean") {
+                ss >> item.column;
+                ss >> item.name;
+                if (item.name == "") {
+                    item.name = func + "_" + item.column;
+                }
+            } else if (func == "hist") {
+                ss >> item.column >> item.lo >> item.hi >> item.nbins;
+                if (!ss || item.nbins <= 0 || item.hi <= item.lo) {
+                    cout << "ERROR: Histograms need 'hist column lo hi nbins' with lo < hi and nbins > 0: '" << line << "'." << endl;
+                    abort();
+                }
+                ss >> item.name;
+                if (item.name == "") {
+                    item.name = "hist_" + item.column;
+                }
+            } else {
+                cout << "ERROR: Unknown aggregate '" << func << "' (use key, count, sum, min, max, mean or hist)." << endl;
+                abort();
+            }
+            if (func != "count" && item.column == "") {
+                cout << "ERROR: Missing column in aggregate line '" << line << "'." << endl;
+                abort();
+            }
+            items.push_back(item);
+        }
+        fileStream.close();
+
+        if (items.size() == 0) {
+            cout << "ERROR: No aggregates declared in " << specFile << endl;
+            abort();
+        }
+    }
+
+
+    const long Aggregator::nullKey = LONG_MIN;
+
+    Aggregator::Aggregator(const AggregateSpec &newSpec) {
+        spec = newSpec;
+        numKeys = spec.keys.size();
+        lastState = NULL;
+
+        inputColumns = spec.keys;
+        numSlots = 1;
+        for (int i=0; i<spec.items.size(); i++) {
+            AggregateItem &item = spec.items[i];
+            int func;
+
+            if (item.func == "count") {
+                func = AGG_COUNT;
+            } else if (item.func == "sum") {
+                func = AGG_SUM;
+            } else if (item.func == "min") {
+                func = AGG_MIN;
+            } else if (item.func == "max") {
+                func = AGG_MAX;
+            } else if (item.func == "mean") {
+                func = AGG_MEAN;
+            } else {
+                func = AGG_HIST;
+            }
+            itemFuncs.push_back(func);
+
+            // each column is passed in only once
+            int input = -1;
+            if (item.column != "") {
+                vector<string>::iterator it = find(inputColumns.begin() + numKeys, inputColumns.end(), item.column);
+                input = it - (inputColumns.begin() + numKeys);
+                if (it == inputColumns.end()) {
+                    inputColumns.push_back(item.column);
+                }
+            }
+            itemInputs.push_back(input);
+
+            // state: [n] for count, [n, value] for the others, one per bin for histograms
+            itemSlots.push_back(numSlots);
+            if (func == AGG_HIST) {
+                numSlots += item.nbins;
+                for (int b=0; b<item.nbins; b++) {
+                    stringstream ss;
+                    ss << item.name << "_" << b;
+                    outputNames.push_back(ss.str());
+                    outputItems.push_back(i);
+                    outputBins.push_back(b);
+                }
+            } else {
+                numSlots += (input < 0) ? 0 : ((func == AGG_COUNT) ? 1 : 2);
+                outputNames.push_back(item.name);
+                outputItems.push_back(i);
+                outputBins.push_back(0);
+            }
+        }
+    }
+
+    void Aggregator::addRow(const long * keys, const double * values, const char * nulls) {
+        vector<double> * state;
+
+        if (lastState && equal(keys, keys + numKeys, lastKey.begin())) {
+            state = lastState;
+        } else {
+            lastKey.assign(keys, keys + numKeys);
+            GroupMap::iterator it = groups.find(lastKey);
+            if (it == groups.end()) {
+                it = groups.insert(make_pair(lastKey, vector<double>(numSlots, 0.))).first;
+            }
+            state = &it->second;
+            lastState = state;  // references stay valid when the map grows
+        }
+
+        double * s = &(*state)[0];
+        s[0] += 1;
+        for (int i=0; i<itemFuncs.size(); i++) {
+            int input = itemInputs[i];
+            if (input < 0 || nulls[input]) {
+                continue;
+            }
+            double v = values[input];
+            double * p = s + itemSlots[i];
+
+            switch (itemFuncs[i]) {
+                case AGG_COUNT:
+                    p[0] += 1;
+                    break;
+                case AGG_SUM:
+                case AGG_MEAN:
+                    p[0] += 1;
+                    p[1] += v;
+                    break;
+                case AGG_MIN:
+                    if (p[0] == 0 || v < p[1]) {
+                        p[1] = v;
+                    }
+                    p[0] += 1;
+                    break;
+                case AGG_MAX:
+                    if (p[0] == 0 || v > p[1]) {
+                        p[1] = v;
+                    }
+                    p[0] += 1;
+                    break;
+                case AGG_HIST: {
+                    const AggregateItem &item = spec.items[i];
+                    double bin = floor((v - item.lo) / (item.hi - item.lo) * item.nbins);
+                    // values outside of [lo, hi) are not counted
+                    if (bin >= 0 && bin < item.nbins) {
+                        p[(int) bin] += 1;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    void Aggregator::clear() {
+        groups.clear();
+        lastState = NULL;
+    }
+
+    int Aggregator::getNumKeys() {
+        return numKeys;
+    }
+
+    long Aggregator::getNumGroups() {
+        return groups.size();
+    }
+
+    DBDataSchema::Schema * Aggregator::createSummarySchema(string dbName, string tblName) {
+        DBDataSchema::Schema * schema = new Schema();
+
+        schema->setDbName(dbName);
+        schema->setTableName(tblName);
+
+        for (int j=0; j<numKeys + outputNames.size(); j++) {
+            bool isKey = (j < numKeys);
+            string name = isKey ? spec.keys[j] : outputNames[j - numKeys];
+            int func = isKey ? AGG_COUNT : itemFuncs[outputItems[j - numKeys]];
+            bool isInt = (isKey || func == AGG_COUNT || func == AGG_HIST);
+
+            DataObjDesc* colObj = new DataObjDesc();
+            colObj->setDataObjName(name);
+            colObj->setDataObjDType(isInt ? DT_INT8 : DT_REAL8);
+            colObj->setIsConstItem(false, false);
+            colObj->setIsHeaderItem(false);
+
+            SchemaItem* schemaItem = new SchemaItem();
+            schemaItem->setColumnName(name);
+            schemaItem->setColumnDBType(isInt ? DBT_BIGINT : DBT_REAL);
+            schemaItem->setDataDesc(colObj);
+
+            schema->addItemToSchema(schemaItem);
+        }
+
+        return schema;
+    }
+
+    // orders the groups by their keys
+    class GroupOrder {
+        public:
+            bool operator()(const Aggregator::GroupMap::const_iterator &a, const Aggregator::GroupMap::const_iterator &b) const {
+                return a->first < b->first;
+            }
+    };
+
+    vector<Aggregator::GroupMap::const_iterator> Aggregator::getSortedGroups() {
+        vector<GroupMap::const_iterator> sorted;
+        for (GroupMap::const_iterator it=groups.begin(); it!=groups.end(); ++it) {
+            sorted.push_back(it);
+        }
+        sort(sorted.begin(), sorted.end(), GroupOrder());
+        return sorted;
+    }
+
+    bool Aggregator::getOutputValue(const vector<double> &state, int j, void * result) {
+        int i = outputItems[j];
+        const double * p = &state[itemSlots[i]];
+
+        switch (itemFuncs[i]) {
+            case AGG_COUNT:
+                *(long*) result = (long) ((itemInputs[i] < 0) ? state[0] : p[0]);
+                return false;
+            case AGG_HIST:
+                *(long*) result = (long) p[outputBins[j]];
+                return false;
+            case AGG_MEAN:
+                if (p[0] == 0) {
+                    return true;
+                }
+                *(double*) result = p[1] / p[0];
+                return false;
+            default:
+                // sum, min and max of no values are NULL, as in SQL
+                if (p[0] == 0) {
+                    return true;
+                }
+                *(double*) result = p[1];
+                return false;
+        }
+    }
+
+
+    AggregatingReader::AggregatingReader(DBReader::Reader * newReader, DBDataSchema::Schema * schema, Aggregator * newAggregator) {
+        reader = newReader;
+        aggregator = newAggregator;
+        numKeys = aggregator->getNumKeys();
+
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        vector<string> &inputs = aggregator->inputColumns;
+        vector<bool> found(inputs.size(), false);
+        for (int j=0; j<items.size(); j++) {
+            DataObjDesc * desc = items[j]->getDataDesc();
+            DType dtype = desc->getDataObjDType();
+            string name = items[j]->getColumnName();
+
+            // a column may be a key and aggregated as well
+            vector<string>::iterator key = find(inputs.begin(), inputs.begin() + numKeys, name);
+            vector<string>::iterator value = find(inputs.begin() + numKeys, inputs.end(), name);
+            itemKeys.push_back((key == inputs.begin() + numKeys) ? -1 : key - inputs.begin());
+            itemValues.push_back((value == inputs.end()) ? -1 : value - (inputs.begin() + numKeys));
+
+            if (itemKeys[j] >= 0 || itemValues[j] >= 0) {
+                if (dtype == DT_STRING || dtype == (DType) 0) {
+                    cout << "ERROR: Cannot aggregate column " << name << ", it is not numeric." << endl;
+                    abort();
+                }
+                if (itemKeys[j] >= 0 && (dtype == DT_REAL4 || dtype == DT_REAL8)) {
+                    cout << "ERROR: Cannot group by column " << name << ", keys must be integer columns." << endl;
+                    abort();
+                }
+                if (itemKeys[j] >= 0) {
+                    found[itemKeys[j]] = true;
+                }
+                if (itemValues[j] >= 0) {
+                    found[numKeys + itemValues[j]] = true;
+                }
+            }
+            schemaItems.push_back(desc);
+            itemTypes.push_back(dtype);
+            itemIndex[desc] = j;
+        }
+        for (int i=0; i<found.size(); i++) {
+            if (!found[i]) {
+                cout << "ERROR: Column " << inputs[i] << " of the aggregates is not in the mapping file." << endl;
+                abort();
+            }
+        }
+
+        keys.resize(numKeys + 1);
+        values.resize(aggregator->inputColumns.size() - numKeys + 1);
+        nulls.resize(values.size());
+        nextItem = 0;
+        inRow = false;
+    }
+
+    void AggregatingReader::openFile(string newFileName) {
+        reader->openFile(newFileName);
+    }
+
+    void AggregatingReader::closeFile() {
+        reader->closeFile();
+    }
+
+    void AggregatingReader::addCurrentRow() {
+        aggregator->addRow(&keys[0], &values[0], &nulls[0]);
+    }
+
+    int AggregatingReader::getNextRow() {
+        // the previous row is complete now
+        if (inRow) {
+            addCurrentRow();
+        }
+        int status = reader->getNextRow();
+        inRow = (status != 0);
+        nextItem = 0;
+        return status;
+    }
+
+    bool AggregatingReader::getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result) {
+        bool isNull = reader->getItemInRow(thisItem, applyAsserters, applyConverters, result);
+        int j;
+
+        if (nextItem < schemaItems.size() && schemaItems[nextItem] == thisItem) {
+            j = nextItem;
+        } else {
+            map<DataObjDesc*, int>::iterator it = itemIndex.find(thisItem);
+            if (it == itemIndex.end()) {
+                return isNull;
+            }
+            j = it->second;
+        }
+        nextItem = j + 1;
+
+        if (itemValues[j] >= 0) {
+            values[itemValues[j]] = isNull ? 0 : getItemDouble(itemTypes[j], result);
+            nulls[itemValues[j]] = isNull;
+        }
+        if (itemKeys[j] >= 0) {
+            keys[itemKeys[j]] = isNull ? Aggregator::nullKey : getItemLong(itemTypes[j], result);
+        }
+
+        return isNull;
+    }
+
+    void AggregatingReader::getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result) {
+        reader->getConstItem(thisItem, result);
+    }
+
+
+    SummaryReader::SummaryReader(Aggregator * newAggregator, DBDataSchema::Schema * schema) {
+        aggregator = newAggregator;
+        numKeys = aggregator->getNumKeys();
+        rows = aggregator->getSortedGroups();
+        currRow = -1;
+
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        for (int j=0; j<items.size(); j++) {
+            itemIndex[items[j]->getDataDesc()] = j;
+        }
+    }
+
+    void SummaryReader::openFile(string newFileName) {
+    }
+
+    void SummaryReader::closeFile() {
+    }
+
+    int SummaryReader::getNextRow() {
+        currRow++;
+        return (currRow < (long) rows.size()) ? 1 : 0;
+    }
+
+    bool SummaryReader::getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result) {
+        int j = itemIndex[thisItem];
+
+        if (j < numKeys) {
+            long key = rows[currRow]->first[j];
+            if (key == Aggregator::nullKey) {
+                return true;
+            }
+            *(long*) result = key;
+            return false;
+        }
+        return aggregator->getOutputValue(rows[currRow]->second, j - numKeys, result);
+    }
+
+    void SummaryReader::getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result) {
+    }
+
+
+    void writeSummary(Aggregator * aggregator, const DBConnInfo &conn, string tblName, int bufferSize) {
+        DBServer::DBAdaptorsFactory adaptorFac;
+        DBConnInfo summaryConn = conn;
+
+        summaryConn.table = tblName;
+        summaryConn.askUserToValidateRead = false;
+
+        DBDataSchema::Schema * schema = aggregator->createSummarySchema(conn.dbase, tblName);
+        SummaryReader reader(aggregator, schema);
+        DBServer::DBAbstractor * dbServer = adaptorFac.getDBAdaptors(conn.system);
+        DBIngest::DBIngestor * ingestor = new DBIngest::DBIngestor(schema, &reader, dbServer);
+        setupIngestor(ingestor, summaryConn);
+
+        cout << "Writing " << aggregator->getNumGroups() << " rows to summary table " << tblName << " ..." << endl;
+        ingestor->ingestData(bufferSize);
+
+        delete ingestor;
+        delete schema;
+    }
+
+}
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Reader.h>
+#include <Schema.h>
+#include <DType.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/unordered_map.hpp>
+
+#include "Sag_DBConnection.h"
+
+#ifndef Sag_Sag_Aggregator_h
+#define Sag_Sag_Aggregator_h
+
+namespace Sag {
+
+    // One aggregate of the summary table.
+    class AggregateItem {
+        public:
+            std::string func;       // count, sum, min, max, mean or hist
+            std::string column;     // database column of the main table ("" for count of rows)
+            std::string name;       // output column (prefix for the bins of a histogram)
+            double lo;              // histogram: range and number of bins
+            double hi;
+            int nbins;
+
+            AggregateItem();
+    };
+
+
+    // Declared aggregates, read from a file with lines like
+    //   key HostHaloID
+    //   count [* outputName]
+    //   mean Mstar [outputName]
+    //   hist Mstar 8 13 20
+    // Columns are database columns of the main table (as in the mapping
+    // file); keys must be integer columns.
+    class AggregateSpec {
+        public:
+            std::vector<std::string> keys;
+            std::vector<AggregateItem> items;
+
+            void readSpecFile(std::string specFile);
+    };
+
+
+    // Hash-based streaming GROUP BY: collects the aggregates for each
+    // distinct key while the rows pass through.
+    class Aggregator {
+    public:
+        typedef boost::unordered_map< std::vector<long>, std::vector<double> > GroupMap;
+
+    private:
+        enum { AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX, AGG_MEAN, AGG_HIST };
+
+        AggregateSpec spec;
+        int numKeys;
+        std::vector<int> itemFuncs;
+        std::vector<int> itemSlots;     // first state slot of each item; slot 0 counts the rows
+        std::vector<int> itemInputs;    // index of the item's column in the values, -1 for count of rows
+        int numSlots;
+
+        std::vector<std::string> outputNames;
+        std::vector<int> outputItems;   // item and histogram bin of each output column
+        std::vector<int> outputBins;
+
+        GroupMap groups;
+        std::vector<long> lastKey;      // rows of one key often come together
+        std::vector<double> * lastState;
+
+    public:
+        // column names of the input values: the keys first, then the
+        // columns of the aggregates
+        std::vector<std::string> inputColumns;
+
+        // NULL keys are stored with this value
+        static const long nullKey;
+
+        Aggregator(const AggregateSpec &newSpec);
+
+        // add one row: the keys, and the values of the other input columns
+        // with their NULL flags (NULL values are ignored)
+        void addRow(const long * keys, const double * values, const char * nulls);
+
+        void clear();
+        int getNumKeys();
+        long getNumGroups();
+
+        // table with one row per key: the key columns, then one column per
+        // aggregate (one per bin for histograms)
+        DBDataSchema::Schema * createSummarySchema(std::string dbName, std::string tblName);
+
+        // the groups sorted by key
+        std::vector<GroupMap::const_iterator> getSortedGroups();
+
+        // value of output column j (after the keys) for the given group state;
+        // returns true for NULL
+        bool getOutputValue(const std::vector<double> &state, int j, void * result);
+    };
+
+
+    // Reader which passes the rows of another reader through unchanged
+    // and feeds the values of the aggregated columns into an Aggregator.
+    class AggregatingReader : public DBReader::Reader {
+    private:
+        DBReader::Reader * reader;
+        Aggregator * aggregator;
+        int numKeys;
+
+        std::vector<DBDataSchema::DataObjDesc*> schemaItems;
+        std::vector<DBDataSchema::DType> itemTypes;
+        std::vector<int> itemKeys;      // key index of each schema item, -1 if none
+        std::vector<int> itemValues;    // value index of each schema item, -1 if not aggregated
+        std::map<DBDataSchema::DataObjDesc*, int> itemIndex;
+        int nextItem;                   // schema items usually come in order
+
+        std::vector<long> keys;
+        std::vector<double> values;
+        std::vector<char> nulls;
+        bool inRow;
+
+        void addCurrentRow();
+
+    public:
+        AggregatingReader(DBReader::Reader * newReader, DBDataSchema::Schema * schema, Aggregator * newAggregator);
+
+        void openFile(std::string newFileName);
+        void closeFile();
+
+        int getNextRow();
+
+        bool getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result);
+
+        void getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result);
+    };
+
+
+    // Serves the rows of the summary table, for a DBIngestor.
+    class SummaryReader : public DBReader::Reader {
+    private:
+        Aggregator * aggregator;
+        int numKeys;
+        std::vector<Aggregator::GroupMap::const_iterator> rows;
+        long currRow;
+        std::map<DBDataSchema::DataObjDesc*, int> itemIndex;
+
+    public:
+        SummaryReader(Aggregator * newAggregator, DBDataSchema::Schema * schema);
+
+        void openFile(std::string newFileName);
+        void closeFile();
+
+        int getNextRow();
+
+        bool getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result);
+
+        void getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result);
+    };
+
+
+    // write the summary table of the aggregator with its own connection
+    void writeSummary(Aggregator * aggregator, const DBConnInfo &conn, std::string tblName, int bufferSize);
+
+}
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+#include <SchemaItem.h>
+#include <DType.h>
+
+#include "Sag_BatchReader.h"
+#include "Sag_Trace.h"
+#include "sagingest_error.h"
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Sag {
+
+    SagBatchReader::SagBatchReader(RowBatchQueue * newQueue, Schema * schema, long newSegmentBatches) {
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+
+        queue = newQueue;
+        layout = RowLayout(schema);
+
+        // the items are identified by their position in the schema
+        for (int j=0; j<items.size(); j++) {
+            DataObjDesc * desc = items[j]->getDataDesc();
+            schemaItems.push_back(desc);
+            itemIndex[desc] = j;
+            constValues.push_back(desc->getIsConstItem() ? (const char*) desc->getConstData() : NULL);
+        }
+        nextItem = 0;
+        batchValues.assign(items.size(), (const char*) NULL);
+        batchNulls.assign(items.size(), 0);
+
+        current = NULL;
+        rowInBatch = 0;
+        numBatches = 0;
+        numRows = 0;
+
+        segmentBatches = newSegmentBatches;
+        batchesInSegment = 0;
+        rowsInSegment = 0;
+        done = false;
+    }
+
+    SagBatchReader::~SagBatchReader() {
+        if (current) {
+            delete current;
+        }
+    }
+
+    void SagBatchReader::openFile(string newFileName) {
+        // nothing to do, rows come from the queue
+    }
+
+    void SagBatchReader::closeFile() {
+    }
+
+    bool SagBatchReader::startSegment() {
+        batchesInSegment = 0;
+        rowsInSegment = 0;
+        sourceRowsInSegment.clear();
+        if (done) {
+            return false;
+        }
+        current = queue->pop();
+        if (!current) {
+            // queue closed and empty: we are done
+            done = true;
+            return false;
+        }
+        takeBatch();
+        rowInBatch = -1;
+        return true;
+    }
+
+    void SagBatchReader::takeBatch() {
+        // items with one value for the whole batch are served from there
+        for (int j=0; j<schemaItems.size(); j++) {
+            if (constValues[j]) {
+                batchValues[j] = constValues[j];
+                batchNulls[j] = 0;
+            } else if (current->isBroadcast(j)) {
+                batchValues[j] = &current->broadcastRow[layout.offsets[j]];
+                batchNulls[j] = current->broadcastNulls[j];
+            } else {
+                batchValues[j] = NULL;
+            }
+        }
+        numBatches++;
+        batchesInSegment++;
+        batchStart = boost::posix_time::microsec_clock::universal_time();
+    }
+
+    void SagBatchReader::finishBatch() {
+        if (queue->getMetrics() || Tracer::isEnabled()) {
+            boost::posix_time::ptime batchEnd = boost::posix_time::microsec_clock::universal_time();
+            if (queue->getMetrics()) {
+                queue->getMetrics()->addBatchWritten(current->nrows, (batchEnd-batchStart).total_microseconds());
+            }
+            // includes the inserts and flushes of the ingestor for this batch
+            Tracer::add("write_batch", "db", "", batchStart, batchEnd);
+        }
+        if (current->source >= 0) {
+            sourceRowsInSegment[current->source] += current->nrows;
+        }
+        delete current;
+        current = NULL;
+    }
+
+    int SagBatchReader::getNextRow() {
+        if (!current) {
+            // segment (or queue) done
+            return 0;
+        }
+        rowInBatch++;
+        nextItem = 0;
+        if (rowInBatch < current->nrows) {
+            numRows++;
+            rowsInSegment++;
+            return 1;
+        }
+
+        // current batch is completely handed over, get the next one unless
+        // the segment is complete
+        finishBatch();
+        if (segmentBatches > 0 && batchesInSegment >= segmentBatches) {
+            return 0;
+        }
+        current = queue->pop();
+        if (!current) {
+            done = true;
+            return 0;
+        }
+        takeBatch();
+        rowInBatch = 0;
+        numRows++;
+        rowsInSegment++;
+
+        return 1;
+    }
+
+    int SagBatchReader::findItem(DataObjDesc * thisItem) {
+        // position of the item in the schema
+        int j;
+
+        if (nextItem < schemaItems.size() && schemaItems[nextItem] == thisItem) {
+            j = nextItem;
+        } else {
+            map<DataObjDesc*, int>::iterator it = itemIndex.find(thisItem);
+            if (it == itemIndex.end()) {
+                printf("\nERROR: Item %s not found in the batch layout\n", thisItem->getDataObjName().c_str());
+                exit(EXIT_FAILURE);
+            }
+            j = it->second;
+        }
+        nextItem = j + 1;
+        return j;
+    }
+
+    bool SagBatchReader::getItemInRow(DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result) {
+        int j = findItem(thisItem);
+
+        if (batchValues[j]) {
+            copyItem(result, batchValues[j], layout.sizes[j]);
+            return batchNulls[j];
+        }
+        copyItem(result, current->getRow(rowInBatch) + layout.offsets[j], layout.sizes[j]);
+        return current->getNulls(rowInBatch)[j];
+    }
+
+    void SagBatchReader::getConstItem(DataObjDesc * thisItem, void* result) {
+        // constants do not depend on the batch
+        int j = findItem(thisItem);
+
+        if (!constValues[j]) {
+            SagIngest_error("SagBatchReader: getConstItem for an item which is not constant.\n");
+        }
+        copyItem(result, constValues[j], layout.sizes[j]);
+    }
+
+    long SagBatchReader::getSegmentBatches() {
+        return batchesInSegment;
+    }
+
+    long SagBatchReader::getSegmentRows() {
+        return rowsInSegment;
+    }
+
+    const map<int, long>& SagBatchReader::getSegmentSourceRows() {
+        return sourceRowsInSegment;
+    }
+
+    long SagBatchReader::getNumBatches() {
+        return numBatches;
+    }
+
+    long SagBatchReader::getNumRows() {
+        return numRows;
+    }
+
+}
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Reader.h>
+#include <Schema.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "Sag_RowBatch.h"
+
+#ifndef Sag_Sag_BatchReader_h
+#define Sag_Sag_BatchReader_h
+
+namespace Sag {
+
+    // Reader that takes its rows from a RowBatchQueue instead of a file,
+    // so that DBIngestor can be used for the writer threads.
+    // The schema must have the same items in the same order as the schema
+    // used by the BatchProducer.
+    // The rows are handed over in segments of at most segmentBatches
+    // batches: getNextRow ends a segment like the end of a file, so that
+    // each ingestData call commits one segment.
+    class SagBatchReader : public DBReader::Reader {
+    private:
+        RowBatchQueue * queue;
+        RowLayout layout;
+        std::vector<DBDataSchema::DataObjDesc*> schemaItems;
+        std::map<DBDataSchema::DataObjDesc*, int> itemIndex;
+        int nextItem;                   // schema items usually come in order
+        std::vector<const char*> constValues;   // per item: value of a constant item, else NULL
+
+        // per item: value for all rows of the current batch (constants and
+        // broadcast items), else NULL
+        std::vector<const char*> batchValues;
+        std::vector<char> batchNulls;
+
+        RowBatch * current;
+        long rowInBatch;
+        boost::posix_time::ptime batchStart;   // when the current batch was taken
+
+        long numBatches;
+        long numRows;
+
+        long segmentBatches;    // batches per segment (0: the whole queue)
+        long batchesInSegment;
+        long rowsInSegment;
+        std::map<int, long> sourceRowsInSegment;   // rows of the segment per batch source
+        bool done;              // queue closed and empty
+
+        int findItem(DBDataSchema::DataObjDesc * thisItem);
+        void takeBatch();
+        void finishBatch();
+
+    public:
+        SagBatchReader(RowBatchQueue * newQueue, DBDataSchema::Schema * schema, long newSegmentBatches = 0);
+        ~SagBatchReader();
+
+        void openFile(std::string newFileName);
+        void closeFile();
+
+        int getNextRow();
+
+        bool getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result);
+
+        void getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result);
+
+        // wait for the first batch of the next segment; false once the
+        // queue is closed and empty
+        bool startSegment();
+
+        // batches/rows of the segment handed over so far
+        long getSegmentBatches();
+        long getSegmentRows();
+
+        // rows of the segment per source of the batches (without source -1)
+        const std::map<int, long>& getSegmentSourceRows();
+
+        // batches/rows handed over to the ingestor so far (not necessarily
+        // flushed to the database yet)
+        long getNumBatches();
+        long getNumRows();
+    };
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+
+#include "Sag_BlockSizer.h"
+
+using namespace std;
+
+namespace Sag {
+
+    // blocks measured for each size; the first blocks of a file are often
+    // slower (opening, caches), so one block is not enough
+    static const int blocksPerSample = 3;
+
+    BlockSizer::BlockSizer(long initialRows) {
+        rows = max(initialRows, 1L);
+        minRows = max(rows / 16, min(rows, 1000L));
+        maxRows = rows * 16;
+        factor = 2;
+        direction = 1;
+        settled = false;
+
+        bestRows = rows;
+        bestRate = 0;
+
+        sampleRows = 0;
+        sampleMicroseconds = 0;
+        sampleBlocks = 0;
+    }
+
+    long BlockSizer::getBlockRows() {
+        return rows;
+    }
+
+    bool BlockSizer::isSettled() {
+        return settled;
+    }
+
+    void BlockSizer::moveTo(long newRows) {
+        newRows = max(minRows, min(newRows, maxRows));
+        if (newRows != rows) {
+            cout << "Adaptive blocksize: " << rows << " -> " << newRows << " rows (best so far: "
+                 << bestRows << " rows, " << (long) bestRate << " rows/s)" << endl;
+        }
+        rows = newRows;
+    }
+
+    void BlockSizer::addBlock(long nrows, long readMicroseconds, long consumeMicroseconds) {
+        if (settled || nrows <= 0) {
+            return;
+        }
+        sampleRows += nrows;
+        sampleMicroseconds += readMicroseconds + consumeMicroseconds;
+        sampleBlocks++;
+        if (sampleBlocks < blocksPerSample) {
+            return;
+        }
+
+        double rate = sampleRows * 1.e6 / max(sampleMicroseconds, 1L);
+        sampleRows = 0;
+        sampleMicroseconds = 0;
+        sampleBlocks = 0;
+
+        // improvements below 2% are noise
+        if (rate > bestRate * 1.02) {
+            bestRate = rate;
+            bestRows = rows;
+        } else {
+            // past the optimum: turn around with a smaller step
+            direction = -direction;
+            factor = sqrt(factor);
+        }
+
+        // at a limit, try the other side
+        long next = max(minRows, min((long) (bestRows * pow(factor, direction)), maxRows));
+        if (next == bestRows) {
+            direction = -direction;
+            factor = sqrt(factor);
+            next = max(minRows, min((long) (bestRows * pow(factor, direction)), maxRows));
+        }
+
+        if (factor < 1.1 || next == bestRows) {
+            moveTo(bestRows);
+            settled = true;
+            cout << "Adaptive blocksize: settled at " << rows << " rows (" << (long) bestRate
+                 << " rows/s), use --blocksize " << rows << " to pin it" << endl;
+            return;
+        }
+        moveTo(next);
+    }
+
+}
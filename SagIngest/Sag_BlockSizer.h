@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef Sag_Sag_BlockSizer_h
+#define Sag_Sag_BlockSizer_h
+
+namespace Sag {
+
+    // Chooses the number of rows per block at runtime. The rate of a block
+    // size is measured as rows per time spent reading the blocks plus the
+    // time the rows took to be consumed (served to the ingestor or the
+    // batch queue) until the next block was requested. Starting with the
+    // given blocksize, the size is doubled or halved as long as the rate
+    // improves, then the steps get smaller around the best size until it
+    // settles there. Every change is logged, so that the size can be
+    // pinned with --blocksize for later runs.
+    class BlockSizer {
+    private:
+        long rows;          // current block size
+        long minRows;
+        long maxRows;
+        double factor;      // current step (> 1)
+        int direction;      // 1: growing, -1: shrinking
+        bool settled;
+
+        long bestRows;
+        double bestRate;    // rows/s
+
+        // measurements for the current size
+        long sampleRows;
+        long sampleMicroseconds;
+        int sampleBlocks;
+
+        void moveTo(long newRows);
+
+    public:
+        BlockSizer(long initialRows);
+
+        long getBlockRows();
+
+        // a block of nrows was read in readMicroseconds and its rows were
+        // consumed in consumeMicroseconds
+        void addBlock(long nrows, long readMicroseconds, long consumeMicroseconds);
+
+        bool isSettled();
+    };
+
+}
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+
+#ifdef DB_SQLITE3
+#include <sqlite3.h>
+#endif
+
+#include "Sag_Checksums.h"
+
+using namespace std;
+
+namespace Sag {
+
+    ColumnChecksum::ColumnChecksum() {
+        isInt = false;
+        isSingle = false;
+        count = 0;
+        imin = imax = 0;
+        dmin = dmax = 0;
+        isum = 0;
+        dsum = 0;
+    }
+
+
+    ChecksumSet::ChecksumSet() {
+        rows = 0;
+    }
+
+    ChecksumSet::ChecksumSet(DBDataSchema::Schema * schema, string newTable) {
+        table = newTable;
+        rows = 0;
+
+        vector<DBDataSchema::SchemaItem*> items = schema->getArrSchemaItems();
+        for (int j=0; j<items.size(); j++) {
+            DBDataSchema::DataObjDesc *desc = items[j]->getDataDesc();
+            columnNames[desc->getDataObjName()] = items[j]->getColumnName();
+            singleColumns[desc->getDataObjName()] = (desc->getDataObjDType() == DBDataSchema::DT_REAL4);
+        }
+    }
+
+    void ChecksumSet::add(const BlockStats &block) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+
+        rows += block.nrows;
+        for (int c=0; c<block.columns.size(); c++) {
+            const ColumnStats &s = block.columns[c];
+            map<string, string>::iterator it = columnNames.find(s.name);
+            string column = (it == columnNames.end()) ? s.name : it->second;
+
+            map<string, int>::iterator ic = columnIndex.find(column);
+            if (ic == columnIndex.end()) {
+                ic = columnIndex.insert(make_pair(column, (int) columns.size())).first;
+                columns.push_back(ColumnChecksum());
+                columns.back().column = column;
+                columns.back().isInt = s.isInt;
+                columns.back().isSingle = singleColumns[s.name];
+            }
+            ColumnChecksum &t = columns[ic->second];
+
+            long n = s.nrows - s.nulls;
+            if (n > 0) {
+                if (t.count == 0) {
+                    t.imin = s.imin;
+                    t.imax = s.imax;
+                    t.dmin = s.dmin;
+                    t.dmax = s.dmax;
+                }
+                t.imin = min(t.imin, s.imin);
+                t.imax = max(t.imax, s.imax);
+                t.dmin = min(t.dmin, s.dmin);
+                t.dmax = max(t.dmax, s.dmax);
+            }
+            t.count += n;
+            t.isum = (long) ((uint64_t) t.isum + (uint64_t) s.isum);
+            t.dsum += s.dsum;
+        }
+    }
+
+    string ChecksumSet::getQuery() {
+        stringstream q;
+        q << "SELECT COUNT(*)";
+        for (int c=0; c<columns.size(); c++) {
+            const string &col = columns[c].column;
+            q << ", COUNT(" << col << "), MIN(" << col << "), MAX(" << col << "), SUM(" << col << ")";
+        }
+        q << " FROM " << table;
+        return q.str();
+    }
+
+    void ChecksumSet::write(string fileName) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        ofstream out(fileName.c_str());
+
+        if (!out) {
+            cout << "ERROR: Cannot open checksum file '" << fileName << "'." << endl;
+            abort();
+        }
+        out.precision(numeric_limits<double>::digits10 + 2);
+        out << "#table\t" << table << endl;
+        out << "#rows\t" << rows << endl;
+        out << "#column\ttype\tcount\tmin\tmax\tsum" << endl;
+        for (int c=0; c<columns.size(); c++) {
+            ColumnChecksum &t = columns[c];
+            out << t.column << "\t" << (t.isInt ? "int" : (t.isSingle ? "real4" : "real8")) << "\t" << t.count << "\t";
+            if (t.count == 0) {
+                out << "\\N\t\\N\t\\N";
+            } else if (t.isInt) {
+                out << t.imin << "\t" << t.imax << "\t" << (uint64_t) t.isum;
+            } else {
+                out << t.dmin << "\t" << t.dmax << "\t" << t.dsum;
+            }
+            out << endl;
+        }
+    }
+
+    void ChecksumSet::read(string fileName) {
+        ifstream in(fileName.c_str());
+        string line;
+
+        if (!in) {
+            cout << "ERROR: Cannot open checksum file '" << fileName << "'." << endl;
+            abort();
+        }
+        while (getline(in, line)) {
+            stringstream ss(line);
+            string first;
+            getline(ss, first, '\t');
+            if (first == "#table") {
+                ss >> table;
+            } else if (first == "#rows") {
+                ss >> rows;
+            } else if (first.size() > 0 && first[0] != '#') {
+                ColumnChecksum t;
+                string type, vmin, vmax, vsum;
+                t.column = first;
+                ss >> type >> t.count >> vmin >> vmax >> vsum;
+                t.isInt = (type == "int");
+                t.isSingle = (type == "real4");
+                if (t.count > 0) {
+                    t.imin = atol(vmin.c_str());
+                    t.imax = atol(vmax.c_str());
+                    t.isum = (long) strtoull(vsum.c_str(), NULL, 10);
+                    t.dmin = atof(vmin.c_str());
+                    t.dmax = atof(vmax.c_str());
+                    t.dsum = atof(vsum.c_str());
+                }
+                columnIndex[t.column] = columns.size();
+                columns.push_back(t);
+            }
+        }
+    }
+
+    // integer given as decimal string (maybe with a fraction, e.g. from
+    // SUM giving a DECIMAL) modulo 2^64
+    static uint64_t parseIntMod64(const string &s) {
+        uint64_t v = 0;
+        bool negative = false;
+        for (int i=0; i<s.size(); i++) {
+            if (s[i] == '-') {
+                negative = true;
+            } else if (s[i] >= '0' && s[i] <= '9') {
+                v = v * 10 + (s[i] - '0');
+            } else if (s[i] == '.' || s[i] == 'e' || s[i] == 'E') {
+                break;
+            }
+        }
+        return negative ? (uint64_t) 0 - v : v;
+    }
+
+    static bool closeTo(double a, double b, double relTol) {
+        return fabs(a - b) <= relTol * max(max(fabs(a), fabs(b)), 1e-30);
+    }
+
+    // the values of the table differ from ours by rounding only: to the
+    // column type, of the additions in another order and of the query
+    // result to (at least 15) decimal digits
+    static const double printEps = 1e-14;
+
+    static bool sumCloseTo(double a, const ColumnChecksum &t) {
+        double eps = t.isSingle ? numeric_limits<float>::epsilon() : numeric_limits<double>::epsilon();
+        double largest = max(fabs(t.dmin), fabs(t.dmax));
+        return fabs(a - t.dsum) <= 10 * sqrt((double) t.count) * eps * largest + printEps * fabs(t.dsum);
+    }
+
+    bool ChecksumSet::compare(const vector<string> &result) {
+        bool ok = true;
+
+        if (result.size() != 1 + 4 * columns.size()) {
+            cout << "ERROR: Expected " << 1 + 4 * columns.size() << " values in the query result, got " << result.size() << "." << endl;
+            return false;
+        }
+
+        cout.precision(numeric_limits<double>::digits10 + 2);
+        long dbRows = atol(result[0].c_str());
+        cout << "rows: " << rows << " ingested, " << dbRows << " in " << table << ((dbRows == rows) ? "" : "  MISMATCH") << endl;
+        ok = ok && (dbRows == rows);
+
+        for (int c=0; c<columns.size(); c++) {
+            ColumnChecksum &t = columns[c];
+            const string *r = &result[1 + 4*c];
+            long dbCount = atol(r[0].c_str());
+            bool colOk = (dbCount == t.count);
+
+            if (t.count > 0 && t.isInt) {
+                colOk = colOk && atol(r[1].c_str()) == t.imin && atol(r[2].c_str()) == t.imax
+                    && parseIntMod64(r[3]) == (uint64_t) t.isum;
+            } else if (t.count > 0) {
+                double eps = t.isSingle ? numeric_limits<float>::epsilon() : numeric_limits<double>::epsilon();
+                eps = max(2 * eps, printEps);
+                colOk = colOk && closeTo(atof(r[1].c_str()), t.dmin, eps) && closeTo(atof(r[2].c_str()), t.dmax, eps)
+                    && sumCloseTo(atof(r[3].c_str()), t);
+            }
+
+            cout << t.column << ": " << (colOk ? "ok" : "MISMATCH") << endl;
+            if (!colOk) {
+                cout << "  ingested: count " << t.count;
+                if (t.isInt) {
+                    cout << ", min " << t.imin << ", max " << t.imax << ", sum (mod 2^64) " << (uint64_t) t.isum << endl;
+                } else {
+                    cout << ", min " << t.dmin << ", max " << t.dmax << ", sum " << t.dsum << endl;
+                }
+                cout << "  table:    count " << r[0] << ", min " << r[1] << ", max " << r[2] << ", sum " << r[3] << endl;
+            }
+            ok = ok && colOk;
+        }
+        return ok;
+    }
+
+
+    int verifyChecksums(string checksumFile, string resultFile, string system, string dbPath) {
+        ChecksumSet checksums;
+        vector<string> result;
+
+        checksums.read(checksumFile);
+        string query = checksums.getQuery();
+
+        if (resultFile != "") {
+            // last line of the saved query output, e.g. from mysql -B -N -e
+            ifstream in(resultFile.c_str());
+            string line, last;
+            while (getline(in, line)) {
+                if (line.size() > 0) {
+                    last = line;
+                }
+            }
+            replace(last.begin(), last.end(), '|', '\t');
+            replace(last.begin(), last.end(), ',', '\t');
+            stringstream ss(last);
+            string value;
+            while (getline(ss, value, '\t')) {
+                result.push_back(value);
+            }
+#ifdef DB_SQLITE3
+        } else if (system == "sqlite3") {
+            sqlite3 *db;
+            sqlite3_stmt *stmt;
+            if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK
+                || sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+                cout << "ERROR: Cannot query " << dbPath << ": " << sqlite3_errmsg(db) << endl;
+                sqlite3_close(db);
+                return EXIT_FAILURE;
+            }
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                for (int i=0; i<sqlite3_column_count(stmt); i++) {
+                    stringstream value;
+                    value.precision(numeric_limits<double>::digits10 + 2);
+                    if (sqlite3_column_type(stmt, i) == SQLITE_FLOAT) {
+                        value << sqlite3_column_double(stmt, i);
+                    } else {
+                        const unsigned char *text = sqlite3_column_text(stmt, i);
+                        value << (text ? (const char*) text : "NULL");
+                    }
+                    result.push_back(value.str());
+                }
+            }
+            sqlite3_finalize(stmt);
+            sqlite3_close(db);
+#endif
+        } else {
+            cout << "Run this query and pass its result with --verifyResult:" << endl;
+            cout << query << ";" << endl;
+            return EXIT_SUCCESS;
+        }
+
+        if (!checksums.compare(result)) {
+            cout << "Verification FAILED for table " << checksums.table << "." << endl;
+            return EXIT_FAILURE;
+        }
+        cout << "Verification passed for table " << checksums.table << "." << endl;
+        return EXIT_SUCCESS;
+    }
+
+}
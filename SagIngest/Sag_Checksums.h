@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Schema.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/thread/mutex.hpp>
+
+#include "Sag_ZoneMap.h"
+
+#ifndef Sag_Sag_Checksums_h
+#define Sag_Sag_Checksums_h
+
+namespace Sag {
+
+    // Totals of one column over all rows of a run, in database units.
+    class ColumnChecksum {
+        public:
+            std::string column;     // database column
+            bool isInt;
+            bool isSingle;          // stored with single precision (REAL4)
+            long count;             // values without NaN
+            long imin, imax;
+            double dmin, dmax;
+            long isum;              // exact sum modulo 2^64 (isInt only)
+            double dsum;
+
+            ColumnChecksum();
+    };
+
+
+    // Checksums of everything a run has written to a table: the number of
+    // rows and count, min, max and sum of each column read from the data
+    // files. They are collected from the block statistics while reading,
+    // so that a finished ingest can be verified with one aggregate query
+    // over the table instead of reading the files again. Shared by all
+    // readers of the process.
+    class ChecksumSet {
+    private:
+        std::map<std::string, std::string> columnNames; // data file name -> database column
+        std::map<std::string, bool> singleColumns;      // data file name -> REAL4
+        boost::mutex mutex;
+
+    public:
+        std::string table;
+        long rows;
+        std::vector<ColumnChecksum> columns;
+        std::map<std::string, int> columnIndex;
+
+        ChecksumSet();
+        ChecksumSet(DBDataSchema::Schema * schema, std::string newTable);
+
+        void add(const BlockStats &block);
+
+        // the aggregate query giving the same numbers for the table
+        std::string getQuery();
+
+        void write(std::string fileName);
+        void read(std::string fileName);
+
+        // compare with the result row of getQuery(); prints the differences
+        bool compare(const std::vector<std::string> &result);
+    };
+
+
+    // verify a table against a checksum file: run the query directly
+    // (sqlite3) or compare with its result, saved in resultFile
+    // (one row, values separated by tabs, | or commas); without either
+    // the query is only printed. Returns the exit code.
+    int verifyChecksums(std::string checksumFile, std::string resultFile, std::string system, std::string dbPath);
+
+}
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <string.h>
+#include <zlib.h>
+
+#include "Sag_ChunkReader.h"
+#include "Sag_Trace.h"
+
+using namespace std;
+
+namespace Sag {
+
+    ChunkLayout::ChunkLayout() {
+        usable = false;
+        rank = 0;
+        dims[0] = dims[1] = 0;
+        chunkDims[0] = chunkDims[1] = 0;
+        elemsize = 0;
+        shuffleIndex = -1;
+        deflateIndex = -1;
+    }
+
+
+    // decompresses one raw chunk and copies the requested part of it
+    // into the output buffer
+    class ChunkTask : public PoolTask {
+        public:
+            const ChunkLayout * layout;
+            vector<char> raw;
+            uint32_t filterMask;    // filters skipped for this chunk
+            hsize_t chunkRow;       // first row and column of the chunk
+            hsize_t chunkCol;
+
+            hsize_t rowOffset;      // requested hyperslab
+            hsize_t nrows;
+            hsize_t firstComp;
+            hsize_t ncomps;
+            char * out;
+
+            bool failed;
+
+            void run();
+    };
+
+    void ChunkTask::run() {
+        const ChunkLayout &l = *layout;
+        size_t es = l.elemsize;
+        size_t chunkBytes = l.chunkDims[0] * l.chunkDims[1] * es;
+        vector<char> buf(chunkBytes);
+
+        failed = true;
+
+        if (l.deflateIndex >= 0 && !(filterMask & (1u << l.deflateIndex))) {
+            uLongf destLen = chunkBytes;
+            if (uncompress((Bytef*) &buf[0], &destLen, (const Bytef*) &raw[0], raw.size()) != Z_OK || destLen != chunkBytes) {
+                return;
+            }
+        } else {
+            if (raw.size() != chunkBytes) {
+                return;
+            }
+            memcpy(&buf[0], &raw[0], chunkBytes);
+        }
+
+        if (l.shuffleIndex >= 0 && !(filterMask & (1u << l.shuffleIndex)) && es > 1) {
+            // shuffle stores byte j of all elements together, undo it
+            vector<char> tmp(chunkBytes);
+            size_t n = chunkBytes / es;
+            for (size_t j=0; j<es; j++) {
+                const char *src = &buf[j*n];
+                for (size_t i=0; i<n; i++) {
+                    tmp[i*es + j] = src[i];
+                }
+            }
+            buf.swap(tmp);
+        }
+
+        // copy the overlap of chunk and requested hyperslab
+        hsize_t r0 = max(rowOffset, chunkRow);
+        hsize_t r1 = min(rowOffset + nrows, chunkRow + l.chunkDims[0]);
+        hsize_t c0 = max(firstComp, chunkCol);
+        hsize_t c1 = min(firstComp + ncomps, chunkCol + l.chunkDims[1]);
+        for (hsize_t r=r0; r<r1; r++) {
+            memcpy(out + ((r - rowOffset) * ncomps + (c0 - firstComp)) * es,
+                   &buf[((r - chunkRow) * l.chunkDims[1] + (c0 - chunkCol)) * es],
+                   (c1 - c0) * es);
+        }
+
+        raw.clear();
+        failed = false;
+    }
+
+
+    ChunkReader::ChunkReader(int numThreads) : pool(numThreads) {
+    }
+
+    ChunkLayout ChunkReader::getLayout(hid_t dset, hid_t memtype) {
+        ChunkLayout l;
+        hid_t dcpl, space, ftype;
+        int nfilters;
+
+        dcpl = H5Dget_create_plist(dset);
+        if (H5Pget_layout(dcpl) != H5D_CHUNKED) {
+            H5Pclose(dcpl);
+            return l;
+        }
+
+        space = H5Dget_space(dset);
+        l.rank = H5Sget_simple_extent_ndims(space);
+        if (l.rank == 1 || l.rank == 2) {
+            H5Sget_simple_extent_dims(space, l.dims, NULL);
+            H5Pget_chunk(dcpl, 2, l.chunkDims);
+        }
+        H5Sclose(space);
+        if (l.rank == 1) {
+            l.dims[1] = 1;
+            l.chunkDims[1] = 1;
+        }
+
+        // no type conversion possible on raw chunks
+        ftype = H5Dget_type(dset);
+        bool sameType = (H5Tequal(ftype, memtype) > 0);
+        l.elemsize = H5Tget_size(ftype);
+        H5Tclose(ftype);
+
+        bool knownFilters = true;
+        nfilters = H5Pget_nfilters(dcpl);
+        for (int i=0; i<nfilters; i++) {
+            unsigned int flags;
+            size_t nelmts = 0;
+            char name[64];
+            H5Z_filter_t filter = H5Pget_filter2(dcpl, i, &flags, &nelmts, NULL, sizeof(name), name, NULL);
+            if (filter == H5Z_FILTER_SHUFFLE) {
+                l.shuffleIndex = i;
+            } else if (filter == H5Z_FILTER_DEFLATE) {
+                l.deflateIndex = i;
+            } else {
+                knownFilters = false;
+            }
+        }
+        H5Pclose(dcpl);
+
+        // only worth it for compressed data; shuffle must be applied before deflate
+        l.usable = (l.rank == 1 || l.rank == 2) && sameType && knownFilters && l.deflateIndex >= 0
+            && (l.shuffleIndex < 0 || l.shuffleIndex < l.deflateIndex);
+
+        return l;
+    }
+
+    bool ChunkReader::read(const string &name, hid_t dset, hid_t memtype, hsize_t rowOffset, hsize_t nrows, hsize_t firstComp, hsize_t ncomps, char *out) {
+        map<string, ChunkLayout>::iterator it = layouts.find(name);
+        if (it == layouts.end()) {
+            it = layouts.insert(make_pair(name, getLayout(dset, memtype))).first;
+        }
+        const ChunkLayout &l = it->second;
+        if (!l.usable || nrows == 0) {
+            return false;
+        }
+
+        TraceSpan span("read_chunks", "read", name);
+        hsize_t firstRowChunk = rowOffset / l.chunkDims[0];
+        hsize_t lastRowChunk = (rowOffset + nrows - 1) / l.chunkDims[0];
+        hsize_t firstColChunk = firstComp / l.chunkDims[1];
+        hsize_t lastColChunk = (firstComp + ncomps - 1) / l.chunkDims[1];
+
+        // raw chunks are read here (HDF5 calls only in this thread), the
+        // decompression starts on the pool while the next chunks are read
+        vector<ChunkTask*> tasks;
+        bool ok = true;
+        for (hsize_t i=firstRowChunk; ok && i<=lastRowChunk; i++) {
+            for (hsize_t j=firstColChunk; ok && j<=lastColChunk; j++) {
+                hsize_t chunkOffset[2];
+                hsize_t size = 0;
+                chunkOffset[0] = i * l.chunkDims[0];
+                chunkOffset[1] = j * l.chunkDims[1];
+
+                // chunks which were never written (fill values) are left to HDF5
+                if (H5Dget_chunk_storage_size(dset, chunkOffset, &size) < 0 || size == 0) {
+                    ok = false;
+                    break;
+                }
+
+                ChunkTask *task = new ChunkTask;
+                task->layout = &l;
+                task->raw.resize(size);
+                task->chunkRow = chunkOffset[0];
+                task->chunkCol = chunkOffset[1];
+                task->rowOffset = rowOffset;
+                task->nrows = nrows;
+                task->firstComp = firstComp;
+                task->ncomps = ncomps;
+                task->out = out;
+                task->failed = false;
+                if (H5Dread_chunk(dset, H5P_DEFAULT, chunkOffset, &task->filterMask, &task->raw[0]) < 0) {
+                    delete task;
+                    ok = false;
+                    break;
+                }
+                tasks.push_back(task);
+                pool.submit(task);
+            }
+        }
+
+        pool.wait();
+        for (int k=0; k<tasks.size(); k++) {
+            ok = ok && !tasks[k]->failed;
+            delete tasks[k];
+        }
+
+        if (!ok) {
+            cout << "Warning: Direct chunk read failed for " << name << ", using normal reads for it." << endl;
+            it->second.usable = false;
+        }
+        return ok;
+    }
+
+    void ChunkReader::clear() {
+        layouts.clear();
+    }
+
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include "H5Cpp.h"
+
+#include "Sag_ThreadPool.h"
+
+#ifndef Sag_Sag_ChunkReader_h
+#define Sag_Sag_ChunkReader_h
+
+namespace Sag {
+
+    // How the chunks of a dataset are stored, as far as the ChunkReader
+    // needs to know it.
+    class ChunkLayout {
+        public:
+            bool usable;        // chunked, only shuffle/deflate, file type == memory type
+            int rank;
+            hsize_t dims[2];
+            hsize_t chunkDims[2];
+            size_t elemsize;
+            int shuffleIndex;   // position of the filters in the pipeline, -1 if not used
+            int deflateIndex;
+
+            ChunkLayout();
+    };
+
+
+    // Reads hyperslabs (rows x columns) of chunked, gzip-compressed datasets
+    // by fetching the raw chunks with H5Dread_chunk and decompressing
+    // (inflate and unshuffle) them on a thread pool, instead of letting the
+    // HDF5 library decompress one chunk after the other.
+    // read() returns false for datasets it cannot handle (contiguous layout,
+    // other filters, type conversion needed, missing chunks); the caller then
+    // reads them the normal way.
+    class ChunkReader {
+    private:
+        ThreadPool pool;
+        std::map<std::string, ChunkLayout> layouts;
+
+        ChunkLayout getLayout(hid_t dset, hid_t memtype);
+
+    public:
+        ChunkReader(int numThreads);
+
+        // read rows [rowOffset, rowOffset+nrows) and columns
+        // [firstComp, firstComp+ncomps) into out (row-major)
+        bool read(const std::string &name, hid_t dset, hid_t memtype, hsize_t rowOffset, hsize_t nrows, hsize_t firstComp, hsize_t ncomps, char *out);
+
+        // forget the cached layouts (e.g. for a new file)
+        void clear();
+    };
+
+}
+
+#endif
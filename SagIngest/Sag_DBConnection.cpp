@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "Sag_DBConnection.h"
+
+using namespace std;
+
+namespace Sag {
+
+    DBConnInfo::DBConnInfo() {
+        system = "mysql";
+        port = "3306";
+        host = "localhost";
+        resumeMode = false;
+        isDryRun = false;
+        askUserToValidateRead = true;
+        outputFreq = 100000;
+        commitBatches = 0;
+    }
+
+    void setupIngestor(DBIngest::DBIngestor * ingestor, const DBConnInfo &conn) {
+        ingestor->setUsrName(conn.user);
+        ingestor->setPasswd(conn.pwd);
+
+        //settings for different DBs (copy&paste from AsciiIngest)
+        if(conn.system.compare("mysql") == 0) {
+            ingestor->setSocket(conn.socket);
+            ingestor->setPort(conn.port);
+            ingestor->setHost(conn.host);
+        } else if (conn.system.compare("sqlite3") == 0) {
+            ingestor->setHost(conn.path);
+        } else if (conn.system.compare("unix_sqlsrv_odbc") == 0) {
+            ingestor->setSocket("DRIVER=FreeTDS;TDS_Version=7.0;");
+            //ingestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
+            ingestor->setPort(conn.port);
+            ingestor->setHost(conn.host);
+        } else if (conn.system.compare("sqlsrv_odbc") == 0) {
+            ingestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
+            ingestor->setPort(conn.port);
+            ingestor->setHost(conn.host);
+        } else if (conn.system.compare("sqlsrv_odbc_bulk") == 0) {
+            //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
+            ingestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
+            ingestor->setPort(conn.port);
+            ingestor->setHost(conn.host);
+        }  else if (conn.system.compare("cust_odbc") == 0) {
+            ingestor->setSocket(conn.socket);
+            ingestor->setPort(conn.port);
+            ingestor->setHost(conn.host);
+        } else if (conn.system.compare("cust_odbc_bulk") == 0) {
+            //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
+            ingestor->setSocket(conn.socket);
+            ingestor->setPort(conn.port);
+            ingestor->setHost(conn.host);
+        }
+
+        // setup resume option, if desired
+        ingestor->setResumeMode(conn.resumeMode);
+        ingestor->setIsDryRun(conn.isDryRun);
+        ingestor->setAskUserToValidateRead(conn.askUserToValidateRead);
+
+        ingestor->setPerformanceMeter(conn.outputFreq);	// after how many lines should I print the status?
+    }
+
+}
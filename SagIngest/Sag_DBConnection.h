@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <DBIngestor.h>
+
+#ifndef Sag_Sag_DBConnection_h
+#define Sag_Sag_DBConnection_h
+
+namespace Sag {
+
+    // Everything needed to open a database connection with DBIngestor,
+    // so that several ingestors (e.g. one per writer thread) can be set up
+    // the same way.
+    class DBConnInfo {
+        public:
+            std::string system;
+            std::string dbase;
+            std::string table;
+            std::string socket;
+            std::string user;
+            std::string pwd;
+            std::string port;
+            std::string host;
+            std::string path;
+
+            bool resumeMode;
+            bool isDryRun;
+            bool askUserToValidateRead;
+            int outputFreq;
+            long commitBatches;     // writer threads: batches per ingestData call, i.e. per commit (0: all)
+
+            DBConnInfo();
+    };
+
+    // set user, password and connection settings for the given database system
+    void setupIngestor(DBIngest::DBIngestor * ingestor, const DBConnInfo &conn);
+
+}
+
+#endif
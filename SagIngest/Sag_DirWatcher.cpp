@@ -0,0 +1,248 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "H5Cpp.h"
+#include "sagingest_error.h"
+#include "Sag_Reader.h"
+
+#include "Sag_DirWatcher.h"
+
+using namespace std;
+
+namespace Sag {
+
+    PendingFile::PendingFile() {
+        size = -1;
+        mtime = 0;
+        stableSince = 0;
+        closed = false;
+    }
+
+
+    DirWatcher::DirWatcher(string newDir, string newSuffix, int newSettleSeconds, int newGraceSeconds, bool includeExisting) {
+        dir = newDir;
+        suffix = newSuffix;
+        settleSeconds = newSettleSeconds;
+        graceSeconds = newGraceSeconds;
+
+        inotifyFd = -1;
+        watchFd = -1;
+
+#ifdef __linux__
+        inotifyFd = inotify_init();
+        if (inotifyFd >= 0) {
+            watchFd = inotify_add_watch(inotifyFd, dir.c_str(), IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (watchFd < 0) {
+                SagIngest_error("DirWatcher: Cannot watch the given directory (does it exist?).\n");
+            }
+        }
+#endif
+        if (inotifyFd < 0) {
+            cout << "DirWatcher: inotify not available, scanning " << dir << " instead." << endl;
+        }
+
+        if (includeExisting) {
+            // files already in the directory are taken as closed;
+            // they still have to be stable for settleSeconds
+            scanDir(true);
+        } else {
+            DIR *d = opendir(dir.c_str());
+            struct dirent *entry;
+            while (d && (entry = readdir(d)) != NULL) {
+                seen.insert(dir + "/" + entry->d_name);
+            }
+            if (d) {
+                closedir(d);
+            }
+        }
+    }
+
+    DirWatcher::~DirWatcher() {
+#ifdef __linux__
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+        }
+#endif
+    }
+
+    void DirWatcher::addCandidate(const string &path, bool closed) {
+        if (path.size() < suffix.size() || path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            return;
+        }
+        if (seen.count(path)) {
+            return;
+        }
+        PendingFile &f = pending[path];
+        if (closed) {
+            f.closed = true;
+        }
+    }
+
+    void DirWatcher::scanDir(bool closed) {
+        DIR *d = opendir(dir.c_str());
+        struct dirent *entry;
+
+        if (!d) {
+            SagIngest_error("DirWatcher: Cannot open the given directory.\n");
+        }
+        while ((entry = readdir(d)) != NULL) {
+            addCandidate(dir + "/" + entry->d_name, closed);
+        }
+        closedir(d);
+    }
+
+    void DirWatcher::readEvents(int timeoutMs) {
+#ifdef __linux__
+        char buf[8192];
+        struct pollfd pfd;
+        ssize_t len;
+
+        if (inotifyFd >= 0) {
+            pfd.fd = inotifyFd;
+            pfd.events = POLLIN;
+            if (::poll(&pfd, 1, timeoutMs) > 0) {
+                len = read(inotifyFd, buf, sizeof(buf));
+                for (char *p = buf; len > 0 && p < buf + len; ) {
+                    struct inotify_event *event = (struct inotify_event *) p;
+                    if (event->len > 0) {
+                        // writing is finished with close or when moved into the directory
+                        addCandidate(dir + "/" + event->name, (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0);
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            return;
+        }
+#endif
+        // no inotify: wait and scan the directory; files count as closed
+        // once they did not change for settleSeconds
+        usleep(timeoutMs * 1000);
+        scanDir(true);
+    }
+
+    bool DirWatcher::isComplete(const string &path) {
+        // make sure that the HDF5 library can open the file
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        H5E_auto2_t func;
+        void *clientData;
+        hid_t fid;
+        bool ok = false;
+
+        // do not print errors, if the file is still incomplete
+        H5Eget_auto2(H5E_DEFAULT, &func, &clientData);
+        H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+        if (H5Fis_hdf5(path.c_str()) > 0) {
+            fid = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            if (fid >= 0) {
+                H5Fclose(fid);
+                ok = true;
+            }
+        }
+        H5Eset_auto2(H5E_DEFAULT, func, clientData);
+
+        return ok;
+    }
+
+    vector<string> DirWatcher::poll(int timeoutMs) {
+        vector<string> ready;
+        vector<string> done;
+        struct stat st;
+        time_t now;
+        map<string, PendingFile>::iterator it;
+
+        readEvents(timeoutMs);
+
+        now = time(NULL);
+        for (it = pending.begin(); it != pending.end(); it++) {
+            PendingFile &f = it->second;
+            if (stat(it->first.c_str(), &st) != 0) {
+                // file vanished again (e.g. temporary file)
+                done.push_back(it->first);
+                continue;
+            }
+            if (st.st_size != f.size || st.st_mtime != f.mtime) {
+                // still changing
+                f.size = st.st_size;
+                f.mtime = st.st_mtime;
+                f.stableSince = now;
+                continue;
+            }
+            if (f.closed && now - f.stableSince >= settleSeconds) {
+                if (isComplete(it->first)) {
+                    ready.push_back(it->first);
+                    done.push_back(it->first);
+                } else if (now - f.stableSince >= settleSeconds + graceSeconds) {
+                    // closed and unchanged, but still no HDF5 file: do not
+                    // try again (it would keep the daemon from idling)
+                    cout << "ERROR: DirWatcher: " << it->first << " cannot be opened as HDF5 file "
+                         << (now - f.stableSince) << " seconds after it was written, rejecting it." << endl;
+                    rejected.push_back(it->first);
+                    seen.insert(it->first);
+                    done.push_back(it->first);
+                }
+            }
+        }
+
+        for (int i=0; i<done.size(); i++) {
+            pending.erase(done[i]);
+        }
+        for (int i=0; i<ready.size(); i++) {
+            seen.insert(ready[i]);
+        }
+
+        return ready;
+    }
+
+    long DirWatcher::getNumPending() {
+        return pending.size();
+    }
+
+    vector<string> DirWatcher::getRejected() {
+        return rejected;
+    }
+
+
+    int fileNumFromName(const string &path, int defaultNum) {
+        string name = path.substr(path.find_last_of('/') + 1);
+        size_t end, start;
+
+        // ignore the extension (e.g. the 5 in .hdf5)
+        if (name.find_last_of('.') != string::npos) {
+            name = name.substr(0, name.find_last_of('.'));
+        }
+
+        end = name.find_last_of("0123456789");
+        if (end == string::npos) {
+            return defaultNum;
+        }
+        start = name.find_last_not_of("0123456789", end);
+        start = (start == string::npos) ? 0 : start + 1;
+        return atoi(name.substr(start, end - start + 1).c_str());
+    }
+
+}
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <time.h>
+#include <sys/types.h>
+
+#ifndef Sag_Sag_DirWatcher_h
+#define Sag_Sag_DirWatcher_h
+
+namespace Sag {
+
+    class PendingFile {
+        public:
+            off_t size;
+            time_t mtime;
+            time_t stableSince;
+            bool closed;    // writer closed the file (or it was moved into the directory)
+
+            PendingFile();
+    };
+
+
+    // Watches a directory for new data files (with inotify on Linux,
+    // by scanning the directory elsewhere). A file is only reported once it
+    // was closed by its writer, did not change for settleSeconds and can be
+    // opened as an HDF5 file. Files that still cannot be opened
+    // graceSeconds after that are logged and rejected.
+    class DirWatcher {
+    private:
+        std::string dir;
+        std::string suffix;
+        int settleSeconds;
+        int graceSeconds;
+
+        int inotifyFd;
+        int watchFd;
+
+        std::map<std::string, PendingFile> pending;
+        std::set<std::string> seen;
+        std::vector<std::string> rejected;
+
+        void addCandidate(const std::string &path, bool closed);
+        void scanDir(bool closed);
+        void readEvents(int timeoutMs);
+        bool isComplete(const std::string &path);
+
+    public:
+        DirWatcher(std::string newDir, std::string newSuffix, int newSettleSeconds, int newGraceSeconds, bool includeExisting);
+        ~DirWatcher();
+
+        // wait up to timeoutMs for changes, return files that are ready for ingest
+        std::vector<std::string> poll(int timeoutMs);
+
+        long getNumPending();
+        std::vector<std::string> getRejected();
+    };
+
+    // number of a data file from its name (last group of digits), or
+    // defaultNum, if there is none
+    int fileNumFromName(const std::string &path, int defaultNum);
+
+}
+
+#endif
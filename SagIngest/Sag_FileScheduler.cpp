@@ -0,0 +1,289 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <stdlib.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "Sag_FileScheduler.h"
+#include "Sag_Trace.h"
+
+using namespace std;
+
+namespace Sag {
+
+    // largest task first
+    static bool largerTask(const IngestTask &a, const IngestTask &b) {
+        return a.nrows > b.nrows;
+    }
+
+    FileProgress::FileProgress() {
+        tasksLeft = 0;
+        flushedRows = 0;
+        recorded = false;
+    }
+
+    FileScheduler::FileScheduler(vector<string> newFieldNames, ReaderSettings newSettings, vector<DBDataSchema::Schema*> newSchemas, RowBatchQueue * newQueue, long newBatchRows, long newTaskRows) {
+        fieldNames = newFieldNames;
+        settings = newSettings;
+        schemas = newSchemas;
+        queue = newQueue;
+        batchRows = newBatchRows;
+        taskRows = newTaskRows;
+
+        sizer = NULL;
+        manifest = NULL;
+        fieldmapHash = 0;
+        numSkipped = 0;
+        numRows = 0;
+        jobTasks.assign(schemas.size(), 0);
+        jobRows.assign(schemas.size(), 0);
+        jobSeconds.assign(schemas.size(), 0);
+    }
+
+    FileScheduler::~FileScheduler() {
+        for (int i=0; i<jobs.size(); i++) {
+            delete jobs[i];
+        }
+        if (sizer) {
+            delete sizer;
+        }
+    }
+
+    void FileScheduler::setManifest(Manifest * newManifest, uint64_t newFieldmapHash) {
+        manifest = newManifest;
+        fieldmapHash = newFieldmapHash;
+    }
+
+    bool FileScheduler::addFile(string fileName, int fileNum) {
+        IngestTask task;
+        FileProgress progress;
+        TraceSpan span("size_file", "meta", fileName);
+        task.fileName = fileName;
+        task.fileNum = fileNum;
+        task.fileIndex = files.size();
+
+        if (manifest) {
+            ManifestEntry &e = progress.entry;
+            e.path = canonicalPath(fileName);
+            e.fileNum = fileNum;
+            e.fieldmapHash = fieldmapHash;
+            if (!getFileStat(fileName, e.size, e.mtime)) {
+                cout << "ERROR: Cannot access " << fileName << endl;
+                exit(EXIT_FAILURE);
+            }
+
+            const ManifestEntry * done = manifest->find(e.path);
+            if (done && done->size == e.size && done->mtime == e.mtime && done->fieldmapHash == e.fieldmapHash) {
+                cout << "File " << fileName << " was ingested before (" << done->rows << " rows), skipping." << endl;
+                numSkipped++;
+                return false;
+            }
+            if (done) {
+                cout << "File " << fileName << " changed since it was ingested, ingesting it again." << endl;
+                cout << "  Its previous rows (fileNum " << done->fileNum << ", snapnums " << done->snapnums
+                     << ") must be deleted from the table." << endl;
+            }
+        }
+
+        if (!sizer) {
+            // only the selection of outputs matters for sizing
+            ReaderSettings sizeSettings;
+            sizeSettings.blocksize = settings.blocksize;
+            sizeSettings.snapnums = settings.snapnums;
+            sizeSettings.multiRead = false;
+            sizeSettings.ioOrder = false;
+            sizer = new SagReader(fileName, fileNum, settings.blocksize, fieldNames);
+            sizer->applySettings(sizeSettings);
+        } else {
+            sizer->setFile(fileName, fileNum);
+        }
+
+        long fileRows = 0;
+        for (long o=0; o<sizer->getNumOutputs(); o++) {
+            sizer->selectOutput(o);
+            long n = sizer->getNumRowsInDataSet(sizer->getDataSetNames()[0]);
+            fileRows += n;
+            if (manifest) {
+                stringstream ss;
+                ss << ((o > 0) ? "," : "") << sizer->getSnapnum(o);
+                progress.entry.snapnums += ss.str();
+            }
+
+            // sorted reads need the whole output, so do not split then
+            long step = (taskRows > 0 && settings.sortKey == "") ? taskRows : n;
+            for (long first=0; first<n && settings.sortKey == ""; first+=step) {
+                task.ioutput = o;
+                task.firstRow = first;
+                task.nrows = min(step, n - first);
+                tasks.push_back(task);
+            }
+        }
+        if (settings.sortKey != "") {
+            task.ioutput = -1;
+            task.firstRow = 0;
+            task.nrows = fileRows;
+            tasks.push_back(task);
+        }
+        sizer->closeFile();
+        if (settings.metrics) {
+            settings.metrics->addExpectedRows(fileRows);
+        }
+
+        progress.tasksLeft = tasks.size();
+        for (int k=0; k<files.size(); k++) {
+            progress.tasksLeft -= files[k].tasksLeft;
+        }
+        files.push_back(progress);
+
+        cout << "File " << fileName << " (fileNum " << fileNum << "): " << fileRows << " rows" << endl;
+        return true;
+    }
+
+    long FileScheduler::getNumTasks() {
+        return tasks.size();
+    }
+
+    long FileScheduler::getNumSkipped() {
+        return numSkipped;
+    }
+
+    void FileScheduler::runJob(int i) {
+        // take one task after the other; the reader is kept for all tasks
+        // and only switches files when needed
+        SagReader * reader = NULL;
+        IngestTask task;
+        boost::posix_time::ptime startTime;
+        stringstream threadName;
+
+        threadName << "job " << i;
+        Tracer::setThreadName(threadName.str());
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (tasks.empty()) {
+                    break;
+                }
+                task = tasks.front();
+                tasks.pop_front();
+            }
+
+            startTime = boost::posix_time::microsec_clock::universal_time();
+            TraceSpan span("task", "ingest", task.fileName);
+            if (!reader) {
+                reader = new SagReader(task.fileName, task.fileNum, settings.blocksize, fieldNames);
+                reader->applySettings(settings);
+                reader->setContentHash(manifest != NULL);
+            } else if (reader->getFileName() != task.fileName) {
+                reader->closeFile();
+                reader->setFile(task.fileName, task.fileNum);
+            }
+            if (task.ioutput >= 0) {
+                reader->setRowRange(task.ioutput, task.firstRow, task.nrows);
+            } else {
+                reader->selectOutput(0);
+            }
+
+            reader->resetContentHash();
+            BatchProducer producer(reader, schemas[i], queue, batchRows);
+            producer.setSource(task.fileIndex);
+            producer.run();
+            if (task.ioutput >= 0 && producer.getNumRows() != task.nrows) {
+                cout << "Warning: Job " << i << " read " << producer.getNumRows() << " rows from " << task.fileName
+                     << ", expected " << task.nrows << "." << endl;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            jobTasks[i]++;
+            jobRows[i] += producer.getNumRows();
+            jobSeconds[i] += (boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds() / 1.e6;
+            numRows += producer.getNumRows();
+
+            // the hash of a file is the sum of the hashes of its tasks
+            FileProgress &f = files[task.fileIndex];
+            f.entry.contentHash += reader->getContentHash();
+            f.entry.rows += producer.getNumRows();
+            f.tasksLeft--;
+            recordFile(task.fileIndex);
+        }
+
+        if (reader) {
+            delete reader;
+        }
+    }
+
+    void FileScheduler::run() {
+        stable_sort(tasks.begin(), tasks.end(), largerTask);
+        if (sizer) {
+            delete sizer;
+            sizer = NULL;
+        }
+
+        cout << "Ingesting " << tasks.size() << " tasks with " << schemas.size() << " jobs ..." << endl;
+        for (int i=0; i<schemas.size(); i++) {
+            jobs.push_back(new boost::thread(&FileScheduler::runJob, this, i));
+        }
+        for (int i=0; i<jobs.size(); i++) {
+            jobs[i]->join();
+        }
+    }
+
+    long FileScheduler::getNumRows() {
+        return numRows;
+    }
+
+    void FileScheduler::printStats() {
+        for (int i=0; i<schemas.size(); i++) {
+            cout << "Job " << i << ": " << jobTasks[i] << " tasks, " << jobRows[i] << " rows, busy "
+                 << jobSeconds[i] << " s" << endl;
+        }
+        cout << "Ingested " << numRows << " rows." << endl;
+        if (manifest) {
+            cout << "Skipped " << numSkipped << " files ingested before." << endl;
+        }
+    }
+
+    void FileScheduler::recordFile(int k) {
+        // add the file to the manifest once all its tasks are read and all
+        // their rows committed (the writers may be done before the job);
+        // called with the lock held
+        FileProgress &f = files[k];
+        if (!manifest || f.recorded || f.tasksLeft > 0 || f.flushedRows != f.entry.rows) {
+            return;
+        }
+        manifest->add(f.entry);
+        f.recorded = true;
+    }
+
+    void FileScheduler::rowsFlushed(int source, long nrows) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        files[source].flushedRows += nrows;
+        recordFile(source);
+    }
+
+    void FileScheduler::writeManifest() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (int k=0; k<files.size(); k++) {
+            recordFile(k);
+        }
+    }
+
+}
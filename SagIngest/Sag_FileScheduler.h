@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Schema.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "Sag_Reader.h"
+#include "Sag_RowBatch.h"
+#include "Sag_Manifest.h"
+#include "Sag_WriterPool.h"
+
+#ifndef Sag_Sag_FileScheduler_h
+#define Sag_Sag_FileScheduler_h
+
+namespace Sag {
+
+    // One piece of work: rows [firstRow, firstRow+nrows) of one output
+    // of a file; ioutput < 0 stands for all outputs of the file.
+    class IngestTask {
+        public:
+            std::string fileName;
+            int fileNum;
+            long ioutput;
+            long firstRow;
+            long nrows;
+            int fileIndex;
+    };
+
+
+    // Progress of one file of the list: its manifest entry is complete
+    // when all its tasks are done and all its rows are committed.
+    class FileProgress {
+        public:
+            ManifestEntry entry;
+            int tasksLeft;
+            long flushedRows;
+            bool recorded;      // in the manifest
+
+            FileProgress();
+    };
+
+
+    // Ingest of a list of files of (very) different sizes. All files are
+    // sized first, outputs with more than taskRows rows are split into
+    // row ranges, and the tasks are handed out largest first to numJobs
+    // reader threads: whoever is done takes the next task, so that one big
+    // file no longer keeps a single reader busy while the others idle.
+    // All rows go to the same batch queue (see WriterPool); the batches are
+    // marked with the index of their file, so that each file is added to
+    // the manifest as soon as its rows are committed.
+    class FileScheduler : public FlushListener {
+    private:
+        std::vector<std::string> fieldNames;
+        ReaderSettings settings;
+        std::vector<DBDataSchema::Schema*> schemas; // one per job
+        RowBatchQueue * queue;
+        long batchRows;
+        long taskRows;
+
+        SagReader * sizer;
+        std::deque<IngestTask> tasks;
+        std::vector<FileProgress> files;
+
+        // optional record of the completely ingested files
+        Manifest * manifest;
+        uint64_t fieldmapHash;
+        long numSkipped;
+        boost::mutex mutex;
+        std::vector<boost::thread*> jobs;
+
+        long numRows;
+        std::vector<long> jobTasks;
+        std::vector<long> jobRows;
+        std::vector<double> jobSeconds;
+
+        void runJob(int i);
+        void recordFile(int k);
+
+    public:
+        FileScheduler(std::vector<std::string> newFieldNames, ReaderSettings newSettings, std::vector<DBDataSchema::Schema*> newSchemas, RowBatchQueue * newQueue, long newBatchRows, long newTaskRows);
+        ~FileScheduler();
+
+        // skip files in the manifest with unchanged size, modification time
+        // and mapping file; the content of the others is hashed while reading
+        void setManifest(Manifest * newManifest, uint64_t newFieldmapHash);
+
+        // size the file and add its tasks; false if it is skipped
+        bool addFile(std::string fileName, int fileNum);
+        long getNumTasks();
+        long getNumSkipped();
+
+        // returns when all tasks are done
+        void run();
+
+        long getNumRows();
+        void printStats();
+
+        // count committed rows of a file (the writers of the WriterPool)
+        void rowsFlushed(int source, long nrows);
+
+        // add the completed files not recorded yet, e.g. without rows, to
+        // the manifest (after the writers are done)
+        void writeManifest();
+    };
+
+}
+
+#endif
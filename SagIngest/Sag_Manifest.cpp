@@ -0,0 +1,164 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "Sag_Manifest.h"
+#include "sagingest_error.h"
+
+using namespace std;
+
+namespace Sag {
+
+    uint64_t mixHash(uint64_t z) {
+        z += 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t hashBytes(const char * data, size_t n, uint64_t h) {
+        for (size_t i=0; i<n; i++) {
+            h ^= (unsigned char) data[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    uint64_t hashString(const string &s) {
+        return hashBytes(s.data(), s.size());
+    }
+
+    uint64_t hashFileContents(const string &fileName) {
+        ifstream in(fileName.c_str(), ios::binary);
+        vector<char> buffer(1 << 16);
+        uint64_t h = hashBytes(NULL, 0);
+
+        if (!in) {
+            SagIngest_error("hashFileContents: Could not open the file.\n");
+        }
+        while (in) {
+            in.read(&buffer[0], buffer.size());
+            h = hashBytes(&buffer[0], in.gcount(), h);
+        }
+        return h;
+    }
+
+    bool getFileStat(const string &fileName, long &size, long &mtime) {
+        struct stat st;
+        if (stat(fileName.c_str(), &st) != 0) {
+            return false;
+        }
+        size = st.st_size;
+        mtime = st.st_mtime;
+        return true;
+    }
+
+
+    string canonicalPath(const string &fileName) {
+        char *path = realpath(fileName.c_str(), NULL);
+        if (!path) {
+            return fileName;
+        }
+        string result(path);
+        free(path);
+        return result;
+    }
+
+
+    ManifestEntry::ManifestEntry() {
+        size = 0;
+        mtime = 0;
+        contentHash = 0;
+        rows = 0;
+        fieldmapHash = 0;
+        fileNum = 0;
+        snapnums = "";
+    }
+
+
+    Manifest::Manifest(string newFileName) {
+        fileName = newFileName;
+
+        // read the entries of previous runs
+        ifstream in(fileName.c_str());
+        string line;
+        bool exists = false;
+        while (getline(in, line)) {
+            exists = true;
+            if (line.size() == 0 || line[0] == '#') {
+                continue;
+            }
+            stringstream ss(line);
+            ManifestEntry e;
+            string contentHash, fieldmapHash;
+            getline(ss, e.path, '\t');
+            ss >> e.size >> e.mtime >> contentHash >> e.rows >> fieldmapHash >> e.fileNum >> e.snapnums;
+            if (ss.fail()) {
+                cout << "Warning: Skipping invalid line in manifest " << fileName << ": " << line << endl;
+                continue;
+            }
+            e.contentHash = strtoull(contentHash.c_str(), NULL, 16);
+            e.fieldmapHash = strtoull(fieldmapHash.c_str(), NULL, 16);
+            entries[e.path] = e;
+        }
+        in.close();
+
+        out.open(fileName.c_str(), ios::app);
+        if (!out) {
+            SagIngest_error("Manifest: Could not open the manifest file.\n");
+        }
+        if (!exists) {
+            out << "#path\tsize\tmtime\tcontentHash\trows\tfieldmapHash\tfileNum\tsnapnums" << endl;
+        }
+        cout << "Manifest " << fileName << ": " << entries.size() << " files ingested before" << endl;
+    }
+
+    Manifest::~Manifest() {
+        out.close();
+    }
+
+    const ManifestEntry * Manifest::find(const string &path) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        map<string, ManifestEntry>::iterator it = entries.find(path);
+        return (it == entries.end()) ? NULL : &it->second;
+    }
+
+    void Manifest::add(const ManifestEntry &e) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        char contentHash[17], fieldmapHash[17];
+
+        snprintf(contentHash, sizeof(contentHash), "%016llx", (unsigned long long) e.contentHash);
+        snprintf(fieldmapHash, sizeof(fieldmapHash), "%016llx", (unsigned long long) e.fieldmapHash);
+        out << e.path << "\t" << e.size << "\t" << e.mtime << "\t" << contentHash << "\t" << e.rows << "\t"
+            << fieldmapHash << "\t" << e.fileNum << "\t" << (e.snapnums == "" ? "-" : e.snapnums) << endl;
+        entries[e.path] = e;
+    }
+
+    long Manifest::getNumEntries() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return entries.size();
+    }
+
+}
@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+
+#ifndef Sag_Sag_Manifest_h
+#define Sag_Sag_Manifest_h
+
+namespace Sag {
+
+    // mix the bits of z (splitmix64 finalizer)
+    uint64_t mixHash(uint64_t z);
+
+    // FNV-1a hash of some bytes, of a string and of the contents of a file
+    uint64_t hashBytes(const char * data, size_t n, uint64_t h = 14695981039346656037ULL);
+    uint64_t hashString(const std::string &s);
+    uint64_t hashFileContents(const std::string &fileName);
+
+    // size and modification time of a file; false if it does not exist
+    bool getFileStat(const std::string &fileName, long &size, long &mtime);
+
+    // absolute path without symbolic links (the name itself if that fails)
+    std::string canonicalPath(const std::string &fileName);
+
+
+    // One completely ingested file.
+    class ManifestEntry {
+        public:
+            std::string path;       // canonical path
+            long size;
+            long mtime;
+            uint64_t contentHash;   // of the values of all mapped datasets (see SagReader::hashBlock)
+            long rows;
+            uint64_t fieldmapHash;
+            int fileNum;
+            std::string snapnums;   // comma-separated snapnums of the ingested outputs
+
+            ManifestEntry();
+    };
+
+
+    // Tab-separated list of the files ingested so far, one line per
+    // completed file; a later line for the same path replaces earlier ones.
+    // A file is skipped in later runs if its size, modification time and
+    // mapping file are unchanged.
+    class Manifest {
+    private:
+        std::string fileName;
+        std::ofstream out;
+        std::map<std::string, ManifestEntry> entries;
+        boost::mutex mutex;
+
+    public:
+        Manifest(std::string newFileName);
+        ~Manifest();
+
+        // the entry of this path, NULL if it was never ingested
+        const ManifestEntry * find(const std::string &path);
+
+        // append a completed file
+        void add(const ManifestEntry &entry);
+
+        long getNumEntries();
+    };
+
+}
+
+#endif
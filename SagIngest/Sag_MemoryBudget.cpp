@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "Sag_MemoryBudget.h"
+
+using namespace std;
+
+namespace Sag {
+
+    static const char * componentNames[MemoryBudget::NUM_COMPONENTS] = {
+        "column buffers", "read buffers", "sort buffers", "row batches"
+    };
+
+    MemoryBudget::MemoryBudget(long newMaxBytes) {
+        maxBytes = newMaxBytes;
+        for (int c=0; c<NUM_COMPONENTS; c++) {
+            used[c] = 0;
+            peak[c] = 0;
+        }
+        totalUsed = 0;
+        totalPeak = 0;
+        numStalls = 0;
+        stallMicroseconds = 0;
+        numShrunkBlocks = 0;
+    }
+
+    void MemoryBudget::add(int component, long bytes) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        used[component] += bytes;
+        totalUsed += bytes;
+        peak[component] = max(peak[component], used[component]);
+        totalPeak = max(totalPeak, totalUsed);
+    }
+
+    void MemoryBudget::release(int component, long bytes) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        used[component] -= bytes;
+        totalUsed -= bytes;
+        freed.notify_all();
+    }
+
+    void MemoryBudget::wait(int component, long bytes) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (totalUsed + bytes <= maxBytes || used[component] == 0) {
+            return;
+        }
+
+        boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+        numStalls++;
+        while (totalUsed + bytes > maxBytes && used[component] > 0) {
+            freed.wait(lock);
+        }
+        stallMicroseconds += (boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds();
+    }
+
+    void MemoryBudget::waitComponent(int component, long bytes, long limit) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (used[component] + bytes <= limit || used[component] == 0) {
+            return;
+        }
+
+        boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+        numStalls++;
+        while (used[component] + bytes > limit && used[component] > 0) {
+            freed.wait(lock);
+        }
+        stallMicroseconds += (boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds();
+    }
+
+    long MemoryBudget::fitRows(long rowBytes, long wantedRows) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        long rows = (rowBytes > 0) ? (maxBytes - totalUsed) / rowBytes : wantedRows;
+
+        if (rows >= wantedRows) {
+            return wantedRows;
+        }
+        numShrunkBlocks++;
+        return max(rows, 1L);
+    }
+
+    long MemoryBudget::getMaxBytes() {
+        return maxBytes;
+    }
+
+    long MemoryBudget::getUsed() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return totalUsed;
+    }
+
+    long MemoryBudget::getUsed(int component) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return used[component];
+    }
+
+    void MemoryBudget::printReport() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        const double MB = 1024.*1024.;
+
+        cout << "Memory (limit " << maxBytes/MB << " MB), peak per component:" << endl;
+        for (int c=0; c<NUM_COMPONENTS; c++) {
+            cout << "  " << componentNames[c] << ": " << peak[c]/MB << " MB" << endl;
+        }
+        cout << "  total: " << totalPeak/MB << " MB" << endl;
+        cout << "Blocks shrunk to fit: " << numShrunkBlocks << ", batch producers stalled: " << numStalls
+             << " times (" << stallMicroseconds/1.e6 << " s)" << endl;
+    }
+
+}
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#ifndef Sag_Sag_MemoryBudget_h
+#define Sag_Sag_MemoryBudget_h
+
+namespace Sag {
+
+    // Bytes held by the large buffers of an ingest, counted against a limit
+    // (--maxMemory). Readers shrink their blocks to what is still free,
+    // producers of row batches wait until the writers have freed enough;
+    // the peak of each component is reported at the end. Memory of the
+    // database adaptors is not included. Shared by all threads.
+    class MemoryBudget {
+    public:
+        enum Component {
+            COLUMN_BUFFERS = 0, // values of the current block of each reader
+            READ_BUFFERS,       // temporary buffers while reading a block
+            SORT_BUFFERS,       // in-memory runs of the row sorter
+            BATCHES,            // row batches waiting for or held by writers
+            NUM_COMPONENTS
+        };
+
+    private:
+        long maxBytes;
+        long used[NUM_COMPONENTS];
+        long peak[NUM_COMPONENTS];
+        long totalUsed;
+        long totalPeak;
+
+        long numStalls;
+        long stallMicroseconds;
+        long numShrunkBlocks;
+
+        boost::mutex mutex;
+        boost::condition_variable freed;
+
+    public:
+        MemoryBudget(long newMaxBytes);
+
+        // count allocated/freed bytes (never blocks)
+        void add(int component, long bytes);
+        void release(int component, long bytes);
+
+        // block until bytes fit below the limit; returns at once if the
+        // component holds nothing yet, so that the ingest always proceeds
+        void wait(int component, long bytes);
+
+        // the same against a limit of the component's own (a share of the
+        // total limit)
+        void waitComponent(int component, long bytes, long limit);
+
+        // number of rows (at most wantedRows, at least 1) of rowBytes each
+        // that fit into the free memory
+        long fitRows(long rowBytes, long wantedRows);
+
+        long getMaxBytes();
+        long getUsed();
+        long getUsed(int component);
+        void printReport();
+    };
+
+}
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Sag_Metrics.h"
+#include "Sag_RowBatch.h"
+#include "Sag_MemoryBudget.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // e.g. macOS, which has SO_NOSIGPIPE instead
+#endif
+
+using namespace std;
+
+namespace Sag {
+
+    // upper bounds of the histogram buckets in seconds (+Inf is added)
+    static const double bucketBounds[] = {0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 60};
+    static const int numBuckets = sizeof(bucketBounds) / sizeof(bucketBounds[0]);
+
+    static const char * phaseNames[Metrics::NUM_PHASES] = {
+        "read_block", "queue_push", "queue_pop", "write_batch"
+    };
+
+    LatencyHistogram::LatencyHistogram() {
+        counts.assign(numBuckets + 1, 0);
+        count = 0;
+        sum = 0;
+    }
+
+    void LatencyHistogram::add(long microseconds) {
+        double s = microseconds * 1.e-6;
+        int b;
+        for (b=0; b<numBuckets && s > bucketBounds[b]; b++);
+        counts[b]++;
+        count++;
+        sum += s;
+    }
+
+
+    Metrics::Metrics() {
+        startTime = boost::posix_time::microsec_clock::universal_time();
+        rowsRead = 0;
+        bytesRead = 0;
+        blocksRead = 0;
+        currentBlockRows = 0;
+        rowsWritten = 0;
+        batchesWritten = 0;
+        expectedRows = 0;
+        queue = NULL;
+        memory = NULL;
+    }
+
+    void Metrics::addBlock(const string &fileName, long nrows, long bytes, long microseconds) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        rowsRead += nrows;
+        bytesRead += bytes;
+        blocksRead++;
+        currentBlockRows = nrows;
+        currentFile = fileName;
+        phases[READ_BLOCK].add(microseconds);
+    }
+
+    void Metrics::addBatchWritten(long nrows, long microseconds) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        rowsWritten += nrows;
+        batchesWritten++;
+        phases[WRITE_BATCH].add(microseconds);
+    }
+
+    void Metrics::addLatency(int phase, long microseconds) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        phases[phase].add(microseconds);
+    }
+
+    void Metrics::addExpectedRows(long nrows) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        expectedRows += nrows;
+    }
+
+    void Metrics::setQueue(RowBatchQueue * newQueue) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queue = newQueue;
+    }
+
+    void Metrics::setMemoryBudget(MemoryBudget * newMemory) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        memory = newMemory;
+    }
+
+    // label values must escape backslash, quote and newline
+    static string escapeLabel(const string &s) {
+        string r;
+        for (int i=0; i<s.size(); i++) {
+            if (s[i] == '\\' || s[i] == '"') {
+                r += '\\';
+                r += s[i];
+            } else if (s[i] == '\n') {
+                r += "\\n";
+            } else {
+                r += s[i];
+            }
+        }
+        return r;
+    }
+
+    static void writeMetric(stringstream &out, const char *name, const char *type, const char *help, double value) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+        out << name << " " << value << "\n";
+    }
+
+    string Metrics::format() {
+        // the queue and the budget never call back into the metrics
+        // while holding their locks, so they can be asked here
+        boost::unique_lock<boost::mutex> lock(mutex);
+        long queueDepth = queue ? (long) queue->size() : 0;
+        long memoryBytes = memory ? memory->getUsed() : 0;
+        stringstream out;
+        double elapsed = (boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds() * 1.e-6;
+        out.precision(15);
+
+        writeMetric(out, "sagingest_elapsed_seconds", "gauge", "Seconds since the start of the ingest.", elapsed);
+        writeMetric(out, "sagingest_rows_read_total", "counter", "Rows read from the data files.", rowsRead);
+        writeMetric(out, "sagingest_bytes_read_total", "counter", "Bytes of values read from the data files.", bytesRead);
+        writeMetric(out, "sagingest_blocks_read_total", "counter", "Blocks read from the data files.", blocksRead);
+        writeMetric(out, "sagingest_current_block_rows", "gauge", "Rows of the block read last.", currentBlockRows);
+        writeMetric(out, "sagingest_rows_written_total", "counter", "Rows handed to the database.", rowsWritten);
+        writeMetric(out, "sagingest_batches_written_total", "counter", "Batches (or blocks with a single writer) handed to the database.", batchesWritten);
+        writeMetric(out, "sagingest_queue_batches", "gauge", "Batches waiting in the queue for the writers.", queueDepth);
+        if (memory) {
+            writeMetric(out, "sagingest_memory_bytes", "gauge", "Bytes held by the buffers counted against --maxMemory.", memoryBytes);
+        }
+        if (expectedRows > 0) {
+            writeMetric(out, "sagingest_rows_expected", "gauge", "Rows to be read in total.", expectedRows);
+            if (rowsRead > 0) {
+                double eta = (expectedRows - rowsRead) * elapsed / rowsRead;
+                writeMetric(out, "sagingest_eta_seconds", "gauge", "Estimated seconds until all rows are read, at the average rate so far.", max(eta, 0.));
+            }
+        }
+
+        out << "# HELP sagingest_current_file Data file read last.\n";
+        out << "# TYPE sagingest_current_file gauge\n";
+        out << "sagingest_current_file{file=\"" << escapeLabel(currentFile) << "\"} 1\n";
+
+        out << "# HELP sagingest_phase_seconds Duration of the phases of the ingest.\n";
+        out << "# TYPE sagingest_phase_seconds histogram\n";
+        for (int p=0; p<NUM_PHASES; p++) {
+            long cumulative = 0;
+            for (int b=0; b<=numBuckets; b++) {
+                cumulative += phases[p].counts[b];
+                out << "sagingest_phase_seconds_bucket{phase=\"" << phaseNames[p] << "\",le=\"";
+                if (b < numBuckets) {
+                    out << bucketBounds[b];
+                } else {
+                    out << "+Inf";
+                }
+                out << "\"} " << cumulative << "\n";
+            }
+            out << "sagingest_phase_seconds_sum{phase=\"" << phaseNames[p] << "\"} " << phases[p].sum << "\n";
+            out << "sagingest_phase_seconds_count{phase=\"" << phaseNames[p] << "\"} " << phases[p].count << "\n";
+        }
+
+        return out.str();
+    }
+
+
+    MetricsExporter::MetricsExporter(Metrics * newMetrics, string newFileName, string newSocketPath, int newInterval) {
+        metrics = newMetrics;
+        fileName = newFileName;
+        socketPath = newSocketPath;
+        interval = max(newInterval, 1);
+        listenFd = -1;
+        stopping = false;
+        thread = NULL;
+    }
+
+    MetricsExporter::~MetricsExporter() {
+        stop();
+    }
+
+    void MetricsExporter::start() {
+        if (socketPath != "") {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (socketPath.size() >= sizeof(addr.sun_path)) {
+                cout << "ERROR: Metrics socket path " << socketPath << " is too long." << endl;
+                abort();
+            }
+            strcpy(addr.sun_path, socketPath.c_str());
+            unlink(socketPath.c_str());
+            listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listenFd < 0 || bind(listenFd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listenFd, 8) < 0) {
+                cout << "ERROR: Cannot listen on the metrics socket " << socketPath << "." << endl;
+                abort();
+            }
+        }
+        thread = new boost::thread(&MetricsExporter::run, this);
+    }
+
+    void MetricsExporter::stop() {
+        if (!thread) {
+            return;
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            stopping = true;
+        }
+        thread->join();
+        delete thread;
+        thread = NULL;
+
+        if (fileName != "") {
+            writeFile();
+        }
+        if (listenFd >= 0) {
+            close(listenFd);
+            unlink(socketPath.c_str());
+            listenFd = -1;
+        }
+    }
+
+    void MetricsExporter::run() {
+        boost::posix_time::ptime nextWrite = boost::posix_time::microsec_clock::universal_time();
+
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (stopping) {
+                    return;
+                }
+            }
+
+            boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+            if (fileName != "" && now >= nextWrite) {
+                writeFile();
+                nextWrite = now + boost::posix_time::seconds(interval);
+            }
+
+            // wait for clients (or just sleep), but check for stop every 200 ms
+            if (listenFd >= 0) {
+                struct pollfd pfd;
+                pfd.fd = listenFd;
+                pfd.events = POLLIN;
+                if (poll(&pfd, 1, 200) > 0 && (pfd.revents & POLLIN)) {
+                    serveClient();
+                }
+            } else {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+            }
+        }
+    }
+
+    void MetricsExporter::writeFile() {
+        // write to a temporary file and rename it, so that readers never
+        // see a partial file
+        string tmpName = fileName + ".tmp";
+        {
+            ofstream out(tmpName.c_str());
+            if (!out) {
+                cout << "Warning: Cannot write the metrics file " << tmpName << "." << endl;
+                return;
+            }
+            out << metrics->format();
+        }
+        if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
+            cout << "Warning: Cannot rename the metrics file to " << fileName << "." << endl;
+        }
+    }
+
+    void MetricsExporter::serveClient() {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        // a client may go away before reading everything (EPIPE,
+        // ECONNRESET): that is a normal disconnect and must not raise
+        // SIGPIPE, which would kill the ingest
+        string text = metrics->format();
+        size_t done = 0;
+        while (done < text.size()) {
+            ssize_t n = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        close(fd);
+    }
+
+}
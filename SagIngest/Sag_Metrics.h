@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifndef Sag_Sag_Metrics_h
+#define Sag_Sag_Metrics_h
+
+namespace Sag {
+
+    class RowBatchQueue;
+    class MemoryBudget;
+
+    // Latencies of one phase in fixed buckets (seconds), as a Prometheus
+    // histogram.
+    class LatencyHistogram {
+        public:
+            std::vector<long> counts;   // per bucket, not cumulative
+            long count;
+            double sum;                 // seconds
+
+            LatencyHistogram();
+            void add(long microseconds);
+    };
+
+
+    // Live counters and gauges of an ingest, updated by readers, producers
+    // and writers (once per block or batch) and written in the Prometheus
+    // text format by the MetricsExporter. Shared by all threads.
+    class Metrics {
+    public:
+        enum Phase {
+            READ_BLOCK = 0, // reading one block from the data file
+            QUEUE_PUSH,     // producer waiting for room in the batch queue
+            QUEUE_POP,      // writer waiting for a batch
+            WRITE_BATCH,    // writer handing one batch to the database
+            NUM_PHASES
+        };
+
+    private:
+        boost::mutex mutex;
+        boost::posix_time::ptime startTime;
+
+        long rowsRead;
+        long bytesRead;
+        long blocksRead;
+        long currentBlockRows;
+        std::string currentFile;
+        long rowsWritten;
+        long batchesWritten;
+        long expectedRows;      // 0: unknown
+
+        LatencyHistogram phases[NUM_PHASES];
+
+        RowBatchQueue * queue;
+        MemoryBudget * memory;
+
+    public:
+        Metrics();
+
+        void addBlock(const std::string &fileName, long nrows, long bytes, long microseconds);
+        void addBatchWritten(long nrows, long microseconds);
+        void addLatency(int phase, long microseconds);
+
+        // rows to be read in total, for the ETA
+        void addExpectedRows(long nrows);
+
+        // gauges read from these at each export; reset the queue to NULL
+        // before it is destroyed
+        void setQueue(RowBatchQueue * newQueue);
+        void setMemoryBudget(MemoryBudget * newMemory);
+
+        // all metrics in the Prometheus text exposition format
+        std::string format();
+    };
+
+
+    // Writes the metrics every interval seconds to a file (atomically,
+    // e.g. for the textfile collector of the node exporter) and/or serves
+    // them to every client connecting to a Unix socket.
+    class MetricsExporter {
+    private:
+        Metrics * metrics;
+        std::string fileName;
+        std::string socketPath;
+        int interval;
+        int listenFd;
+
+        bool stopping;
+        boost::mutex mutex;
+        boost::thread * thread;
+
+        void run();
+        void writeFile();
+        void serveClient();
+
+    public:
+        MetricsExporter(Metrics * newMetrics, std::string newFileName, std::string newSocketPath, int newInterval);
+        ~MetricsExporter();
+
+        void start();
+        // write the final values and stop the thread
+        void stop();
+    };
+
+}
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <stdlib.h>
+
+#include "Sag_MultiReader.h"
+#include "Sag_Trace.h"
+
+using namespace std;
+using namespace H5;
+
+namespace Sag {
+
+    MultiDataSet::MultiDataSet() {
+        dset = -1;
+        fileSpace = -1;
+        memSpace = -1;
+        memRows = 0;
+        memType = -1;
+        elemsize = 0;
+        rank = 0;
+        dims[0] = dims[1] = 0;
+        firstComp = 0;
+        ncomps = 1;
+    }
+
+
+    MultiReader::MultiReader() {
+    }
+
+    MultiReader::~MultiReader() {
+        close();
+    }
+
+    void MultiReader::open(H5File *fp, const vector<string> &dataSetNames) {
+        close();
+        dataSets.resize(dataSetNames.size());
+
+        for (int k=0; k<dataSetNames.size(); k++) {
+            MultiDataSet &d = dataSets[k];
+            d.name = dataSetNames[k];
+            d.dset = H5Dopen2(fp->getId(), d.name.c_str(), H5P_DEFAULT);
+            if (d.dset < 0) {
+                cout << "ERROR: Cannot open dataset " << d.name << endl;
+                abort();
+            }
+
+            d.fileSpace = H5Dget_space(d.dset);
+            d.rank = H5Sget_simple_extent_ndims(d.fileSpace);
+            if (d.rank != 1 && d.rank != 2) {
+                cout << "ERROR: Cannot cope with multi-dimensional datasets! rank: " << d.rank << endl;
+                abort();
+            }
+            H5Sget_simple_extent_dims(d.fileSpace, d.dims, NULL);
+            if (d.rank == 1) {
+                d.dims[1] = 1;
+            }
+
+            // the same types as supported by SagReader::readDataSet
+            hid_t ftype = H5Dget_type(d.dset);
+            H5T_class_t type_class = H5Tget_class(ftype);
+            size_t dsize = H5Tget_size(ftype);
+            H5Tclose(ftype);
+
+            if (type_class == H5T_INTEGER) {
+                if (sizeof(long) == dsize) {
+                    d.memType = H5T_NATIVE_LONG;
+                    d.type = "long";
+                } else if (sizeof(int8_t) == dsize) {
+                    d.memType = H5T_NATIVE_INT8;
+                    d.type = "int8";
+                } else if (sizeof(int) == dsize) {
+                    cout << "ERROR: Reading datasets of int type not implemented yet!" << endl;
+                    abort();
+                } else {
+                    cout << "ERROR: Do not know how to deal with int-type of size " << dsize << endl;
+                    abort();
+                }
+            } else if (type_class == H5T_FLOAT) {
+                if (sizeof(double) == dsize) {
+                    d.memType = H5T_NATIVE_DOUBLE;
+                    d.type = "double";
+                } else if (sizeof(float) == dsize) {
+                    d.memType = H5T_NATIVE_FLOAT;
+                    d.type = "float";
+                } else {
+                    cout << "ERROR: Do not know how to deal with float-type of size " << dsize << endl;
+                    abort();
+                }
+            } else {
+                cout << "ERROR: Reading datasets of type " << type_class << " not implemented yet!" << endl;
+                abort();
+            }
+            d.elemsize = dsize;
+            d.firstComp = 0;
+            d.ncomps = d.dims[1];
+        }
+    }
+
+    void MultiReader::close() {
+        for (int k=0; k<dataSets.size(); k++) {
+            MultiDataSet &d = dataSets[k];
+            if (d.memSpace >= 0) {
+                H5Sclose(d.memSpace);
+            }
+            if (d.fileSpace >= 0) {
+                H5Sclose(d.fileSpace);
+            }
+            if (d.dset >= 0) {
+                H5Dclose(d.dset);
+            }
+        }
+        dataSets.clear();
+        pending.clear();
+        pendingBuffers.clear();
+    }
+
+    bool MultiReader::isOpen() {
+        return dataSets.size() > 0;
+    }
+
+    MultiDataSet& MultiReader::get(int k) {
+        return dataSets[k];
+    }
+
+    void MultiReader::add(int k, hsize_t row, hsize_t nrows, void *out) {
+        MultiDataSet &d = dataSets[k];
+        hsize_t start[2];
+        hsize_t count[2];
+        hsize_t block[2];
+
+        start[0] = row;
+        start[1] = d.firstComp;
+        count[0] = count[1] = 1;
+        block[0] = nrows;
+        block[1] = d.ncomps;
+        H5Sselect_hyperslab(d.fileSpace, H5S_SELECT_SET, start, NULL, count, block);
+
+        if (d.memSpace < 0 || d.memRows != nrows) {
+            if (d.memSpace >= 0) {
+                H5Sclose(d.memSpace);
+            }
+            d.memSpace = H5Screate_simple(d.rank, block, NULL);
+            d.memRows = nrows;
+        }
+
+        pending.push_back(k);
+        pendingBuffers.push_back(out);
+    }
+
+    void MultiReader::read() {
+        if (pending.size() == 0) {
+            return;
+        }
+
+#if H5_VERSION_GE(1,14,0)
+        TraceSpan span("read_multi", "read");
+        vector<hid_t> dsets(pending.size());
+        vector<hid_t> memTypes(pending.size());
+        vector<hid_t> memSpaces(pending.size());
+        vector<hid_t> fileSpaces(pending.size());
+        for (int i=0; i<pending.size(); i++) {
+            MultiDataSet &d = dataSets[pending[i]];
+            dsets[i] = d.dset;
+            memTypes[i] = d.memType;
+            memSpaces[i] = d.memSpace;
+            fileSpaces[i] = d.fileSpace;
+        }
+        if (H5Dread_multi(pending.size(), &dsets[0], &memTypes[0], &memSpaces[0], &fileSpaces[0], H5P_DEFAULT, &pendingBuffers[0]) < 0) {
+            cout << "ERROR: Reading " << pending.size() << " datasets failed." << endl;
+            abort();
+        }
+#else
+        for (int i=0; i<pending.size(); i++) {
+            MultiDataSet &d = dataSets[pending[i]];
+            TraceSpan span("read_dataset", "read", d.name);
+            if (H5Dread(d.dset, d.memType, d.memSpace, d.fileSpace, H5P_DEFAULT, pendingBuffers[i]) < 0) {
+                cout << "ERROR: Reading dataset " << d.name << " failed." << endl;
+                abort();
+            }
+        }
+#endif
+
+        pending.clear();
+        pendingBuffers.clear();
+    }
+
+}
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include "H5Cpp.h"
+
+#ifndef Sag_Sag_MultiReader_h
+#define Sag_Sag_MultiReader_h
+
+namespace Sag {
+
+    // One dataset of the current output, opened once for all blocks.
+    class MultiDataSet {
+        public:
+            std::string name;
+            hid_t dset;
+            hid_t fileSpace;    // the selection is moved along for each block
+            hid_t memSpace;     // memRows x ncomps, recreated if the block size changes
+            hsize_t memRows;
+            hid_t memType;
+            size_t elemsize;
+            std::string type;   // type name of the datablocks
+            int rank;
+            hsize_t dims[2];    // rows x columns (1 for 1-dim. datasets)
+            hsize_t firstComp;  // range of the columns to be read
+            hsize_t ncomps;
+
+            MultiDataSet();
+    };
+
+
+    // Reads the same row range of many datasets with one call per block.
+    // The datasets, their dataspaces and memory types are kept open for
+    // the whole output instead of being opened, checked and closed again
+    // for each dataset of each block. With HDF5 >= 1.14 all selected
+    // datasets are read with one H5Dread_multi call, otherwise with one
+    // H5Dread per dataset on the open handles.
+    class MultiReader {
+    private:
+        std::vector<MultiDataSet> dataSets;
+        std::vector<int> pending;       // datasets selected for the next read()
+        std::vector<void*> pendingBuffers;
+
+    public:
+        MultiReader();
+        ~MultiReader();
+
+        // open all datasets of an output; aborts on unsupported data types
+        void open(H5::H5File *fp, const std::vector<std::string> &dataSetNames);
+        void close();
+        bool isOpen();
+
+        MultiDataSet& get(int k);
+
+        // select rows [row, row+nrows) and the columns of dataset k,
+        // to be read into out (row-major) by the next read()
+        void add(int k, hsize_t row, hsize_t nrows, void *out);
+
+        // read all selected datasets
+        void read();
+    };
+
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <stdlib.h>
+
+#include "Sag_NullMap.h"
+
+using namespace std;
+
+namespace Sag {
+
+    ColumnNulls::ColumnNulls() {
+        always = false;
+        nan = false;
+        inf = false;
+    }
+
+    bool ColumnNulls::parseOption(const string &option) {
+        if (option.compare(0, 5, "null=") != 0 || option.size() == 5) {
+            return false;
+        }
+
+        stringstream ss(option.substr(5));
+        string value;
+        while (getline(ss, value, ',')) {
+            char *end;
+            if (value == "always") {
+                always = true;
+            } else if (value == "nan") {
+                nan = true;
+            } else if (value == "inf") {
+                inf = true;
+            } else {
+                double d = strtod(value.c_str(), &end);
+                if (value.empty() || *end != '\0') {
+                    return false;
+                }
+                realSentinels.push_back(d);
+                long l = strtol(value.c_str(), &end, 10);
+                if (*end == '\0') {
+                    intSentinels.push_back(l);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool ColumnNulls::hasOnlyIntegers() {
+        return !nan && !inf && intSentinels.size() == realSentinels.size();
+    }
+
+    string ColumnNulls::describe() {
+        stringstream ss;
+        if (always) {
+            return "always NULL";
+        }
+        ss << "NULL for";
+        if (nan) {
+            ss << " NaN";
+        }
+        if (inf) {
+            ss << " Inf";
+        }
+        for (int s=0; s<realSentinels.size(); s++) {
+            ss << " " << realSentinels[s];
+        }
+        return ss.str();
+    }
+
+
+    ValidityMap::ValidityMap() {
+        numNulls = 0;
+    }
+
+
+    // One word of the bitmap is built from 64 values at a time, with
+    // the conditions combined without branches.
+    template <class T>
+    static void markValues(const ColumnNulls &nulls, const vector<T> &sentinels, const T *v, long n, ValidityMap &valid) {
+        const bool checkNan = nulls.nan && !numeric_limits<T>::is_integer;
+        const bool checkInf = nulls.inf && numeric_limits<T>::has_infinity;
+        const T infinity = numeric_limits<T>::has_infinity ? numeric_limits<T>::infinity() : 0;
+        long nwords = (n + 63) / 64;
+        long numNulls = 0;
+
+        valid.words.resize(nwords);
+        for (long w=0; w<nwords; w++) {
+            const T *x = v + w * 64;
+            int m = (int) min(64L, n - w * 64);
+            uint64_t bits = 0;
+            for (int j=0; j<m; j++) {
+                bool isNull = (checkNan & (x[j] != x[j])) | (checkInf & ((x[j] == infinity) | (x[j] == -infinity)));
+                for (int s=0; s<sentinels.size(); s++) {
+                    isNull |= (x[j] == sentinels[s]);
+                }
+                bits |= (uint64_t) !isNull << j;
+            }
+            valid.words[w] = bits;
+            numNulls += m - __builtin_popcountll(bits);
+        }
+        valid.numNulls = numNulls;
+    }
+
+    template <class T, class S>
+    static vector<T> castSentinels(const vector<S> &sentinels) {
+        vector<T> result;
+        for (int s=0; s<sentinels.size(); s++) {
+            result.push_back((T) sentinels[s]);
+        }
+        return result;
+    }
+
+    void markNulls(const ColumnNulls &nulls, const string &type, const void *data, long n, ValidityMap &valid) {
+        if (nulls.always) {
+            valid.words.assign((n + 63) / 64, 0);
+            valid.numNulls = n;
+        } else if (type == "long") {
+            markValues(nulls, nulls.intSentinels, (const long*) data, n, valid);
+        } else if (type == "int8") {
+            markValues(nulls, castSentinels<int8_t>(nulls.intSentinels), (const int8_t*) data, n, valid);
+        } else if (type == "double") {
+            markValues(nulls, nulls.realSentinels, (const double*) data, n, valid);
+        } else if (type == "float") {
+            markValues(nulls, castSentinels<float>(nulls.realSentinels), (const float*) data, n, valid);
+        } else {
+            cout << "ERROR: Cannot check NULL values for type " << type << endl;
+            abort();
+        }
+    }
+
+    template <class T>
+    static long compactValues(const T *v, long n, const ValidityMap &valid, vector<char> &out) {
+        long m = 0;
+        out.resize(n * sizeof(T));
+        T *dst = (T*) &out[0];
+        for (long i=0; i<n; i++) {
+            dst[m] = v[i];
+            m += !valid.isNull(i);
+        }
+        return m;
+    }
+
+    long compactValid(const string &type, const void *data, long n, const ValidityMap &valid, vector<char> &out) {
+        if (n == 0) {
+            return 0;
+        }
+        if (type == "long") {
+            return compactValues((const long*) data, n, valid, out);
+        } else if (type == "int8") {
+            return compactValues((const int8_t*) data, n, valid, out);
+        } else if (type == "double") {
+            return compactValues((const double*) data, n, valid, out);
+        } else if (type == "float") {
+            return compactValues((const float*) data, n, valid, out);
+        }
+        cout << "ERROR: Cannot check NULL values for type " << type << endl;
+        abort();
+    }
+
+}
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifndef Sag_Sag_NullMap_h
+#define Sag_Sag_NullMap_h
+
+namespace Sag {
+
+    // Values of one column which are ingested as NULL, given as options
+    // after the database type in the mapping file (may be repeated):
+    //   null=-99      this value (or a list: null=-99,0) marks missing data
+    //   null=nan      NaN values (REAL4/REAL8 only)
+    //   null=inf      +Inf and -Inf (REAL4/REAL8 only)
+    //   null=always   the column is always NULL, e.g. for columns which
+    //                 are filled later on (forestId, ix, ...)
+    class ColumnNulls {
+        public:
+            bool always;
+            bool nan;
+            bool inf;
+            std::vector<long> intSentinels;     // compared with integer columns
+            std::vector<double> realSentinels;  // compared with float columns
+
+            ColumnNulls();
+
+            // parse one option; false if it is not a null option or the
+            // value is not a number
+            bool parseOption(const std::string &option);
+
+            // true, if there are only integer sentinels (possible for integer columns)
+            bool hasOnlyIntegers();
+            std::string describe();
+    };
+
+    // Which rows of the current block of a column are valid, i.e. not NULL:
+    // one bit per row, evaluated once per block.
+    class ValidityMap {
+        public:
+            std::vector<uint64_t> words;
+            long numNulls;
+
+            ValidityMap();
+
+            inline bool isNull(long i) const {
+                return numNulls > 0 && !((words[i >> 6] >> (i & 63)) & 1);
+            }
+    };
+
+    // evaluate the null options for n values of the given type (as in
+    // DataBlock: long, int8, double or float)
+    void markNulls(const ColumnNulls &nulls, const std::string &type, const void *data, long n, ValidityMap &valid);
+
+    // copy the valid values to out; returns their number
+    long compactValid(const std::string &type, const void *data, long n, const ValidityMap &valid, std::vector<char> &out);
+
+}
+
+#endif
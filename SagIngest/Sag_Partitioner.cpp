@@ -0,0 +1,404 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+
+#include "sagingest_error.h"
+#include "Sag_Partitioner.h"
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Sag {
+
+    QuantileSketch::QuantileSketch(int newK) {
+        k = max(newK, 2);
+        count = 0;
+        seed = 12345;   // fixed, so that plans are reproducible
+        levels.resize(1);
+    }
+
+    void QuantileSketch::add(double v) {
+        levels[0].push_back(v);
+        count++;
+        if (levels[0].size() >= k) {
+            compact(0);
+        }
+    }
+
+    void QuantileSketch::compact(int h) {
+        vector<double> &level = levels[h];
+        double keep = 0;
+        bool odd = (level.size() % 2 == 1);
+
+        sort(level.begin(), level.end());
+        if (odd) {
+            // keep one value here, so that no weight is lost
+            keep = level.back();
+            level.pop_back();
+        }
+
+        // keep the values at even or odd positions, at random
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        int offset = (seed >> 33) & 1;
+        if (levels.size() <= h + 1) {
+            levels.resize(h + 2);
+        }
+        vector<double> &upper = levels[h + 1];
+        vector<double> &current = levels[h];
+        for (int i=offset; i<current.size(); i+=2) {
+            upper.push_back(current[i]);
+        }
+        current.clear();
+        if (odd) {
+            current.push_back(keep);
+        }
+
+        if (upper.size() >= k) {
+            compact(h + 1);
+        }
+    }
+
+    long QuantileSketch::getCount() {
+        return count;
+    }
+
+    vector<double> QuantileSketch::getBoundaries(int n) {
+        vector< pair<double, double> > weighted;   // value, weight
+        double total = 0;
+        vector<double> bounds;
+
+        for (int h=0; h<levels.size(); h++) {
+            double w = (double) (1L << h);
+            for (int i=0; i<levels[h].size(); i++) {
+                weighted.push_back(make_pair(levels[h][i], w));
+                total += w;
+            }
+        }
+        sort(weighted.begin(), weighted.end());
+
+        double cumulative = 0;
+        int next = 1;
+        for (int i=0; i<weighted.size() && next < n; i++) {
+            cumulative += weighted[i].second;
+            while (next < n && cumulative >= total * next / n) {
+                bounds.push_back(weighted[i].first);
+                next++;
+            }
+        }
+        return bounds;
+    }
+
+
+    PartitionSpec::PartitionSpec() {
+        mode = "value";
+        numPartitions = 0;
+        maxPartitions = 0;
+    }
+
+    Partition::Partition() {
+        queue = NULL;
+        pool = NULL;
+        batch = NULL;
+        batchRows = 0;
+        numBatches = 0;
+        numRows = 0;
+    }
+
+
+    int findSchemaColumn(DBDataSchema::Schema * schema, string column) {
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        for (int j=0; j<items.size(); j++) {
+            if (items[j]->getColumnName() == column) {
+                return j;
+            }
+        }
+        return -1;
+    }
+
+    PartitionRouter::PartitionRouter(const PartitionSpec &newSpec, DBDataSchema::Schema * newSchema, SagSchemaMapper * newMapper,
+                                     const DBConnInfo &newConn, int newBufferSize, int newNumWriters, long newBatchRows, int newQueueDepth) {
+        spec = newSpec;
+        schema = newSchema;
+        mapper = newMapper;
+        conn = newConn;
+        bufferSize = newBufferSize;
+        numWriters = max(newNumWriters, 1);
+        batchRows = newBatchRows;
+        queueDepth = newQueueDepth;
+        budget = NULL;
+        metrics = NULL;
+        layout = RowLayout(schema);
+        numRows = 0;
+
+        columnIndex = findSchemaColumn(schema, spec.column);
+        if (columnIndex < 0) {
+            SagIngest_error("PartitionRouter: The partition column is not in the mapping file.\n");
+        }
+        columnType = schema->getArrSchemaItems()[columnIndex]->getDataDesc()->getDataObjDType();
+
+        if (spec.mode == "value" && (columnType == DT_REAL4 || columnType == DT_REAL8)) {
+            SagIngest_error("PartitionRouter: Partitions by value need an integer column.\n");
+        }
+        if (spec.mode == "range") {
+            sort(spec.bounds.begin(), spec.bounds.end());
+            if (spec.bounds.size() == 0) {
+                SagIngest_error("PartitionRouter: Range partitions need boundaries.\n");
+            }
+        } else if (spec.mode == "hash") {
+            if (spec.numPartitions <= 0) {
+                SagIngest_error("PartitionRouter: Hash partitions need a number of partitions.\n");
+            }
+        } else if (spec.mode != "value") {
+            SagIngest_error("PartitionRouter: Unknown partition mode (use value, range or hash).\n");
+        }
+
+        // NULL values of range and hash partitions go to partition 0
+        int fixedPartitions = (spec.mode == "range") ? spec.bounds.size() + 1 : spec.numPartitions;
+        if (spec.mode != "value" && spec.maxPartitions > 0 && fixedPartitions > spec.maxPartitions) {
+            SagIngest_error("PartitionRouter: More partitions than allowed by --maxPartitions.\n");
+        }
+    }
+
+    PartitionRouter::~PartitionRouter() {
+        for (map<long, Partition*>::iterator it=partitions.begin(); it!=partitions.end(); ++it) {
+            Partition * p = it->second;
+            delete p->pool;
+            delete p->queue;
+            for (int i=0; i<p->schemas.size(); i++) {
+                delete p->schemas[i];
+            }
+            delete p;
+        }
+    }
+
+    void PartitionRouter::setMemoryBudget(MemoryBudget * newBudget) {
+        budget = newBudget;
+    }
+
+    void PartitionRouter::setMetrics(Metrics * newMetrics) {
+        metrics = newMetrics;
+    }
+
+    long PartitionRouter::getPartitionKey(const char * row, bool isNull) {
+        // NULL values go to the first partition (an own table for value partitions)
+        const char * p = row + layout.offsets[columnIndex];
+
+        if (spec.mode == "value") {
+            return isNull ? LONG_MIN : getItemLong(columnType, p);
+        }
+        if (isNull) {
+            return 0;
+        }
+        if (spec.mode == "range") {
+            double v = getItemDouble(columnType, p);
+            return upper_bound(spec.bounds.begin(), spec.bounds.end(), v) - spec.bounds.begin();
+        }
+
+        // hash: mix the bits (splitmix64), so that neighbouring keys spread out
+        uint64_t z = (uint64_t) getItemLong(columnType, p) + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z = z ^ (z >> 31);
+        return (long) (z % spec.numPartitions);
+    }
+
+    Partition * PartitionRouter::getPartition(long key) {
+        map<long, Partition*>::iterator it = partitions.find(key);
+        if (it != partitions.end()) {
+            return it->second;
+        }
+
+        // each partition has its own writers and connections, so stop before
+        // e.g. a column with too many distinct values opens a table for each
+        if (spec.maxPartitions > 0 && partitions.size() >= spec.maxPartitions) {
+            stringstream msg;
+            msg << "PartitionRouter: Value " << key << " would need partition " << partitions.size() + 1
+                << ", but --maxPartitions is " << spec.maxPartitions
+                << " (is " << spec.column << " the right column?).\n";
+            SagIngest_error(msg.str().c_str());
+        }
+
+        // new partition: set up its writers
+        Partition * p = new Partition();
+        stringstream ss;
+        ss << conn.table << "_";
+        if (spec.mode == "value") {
+            if (key == LONG_MIN) {
+                ss << "null";
+            } else {
+                ss << key;
+            }
+        } else {
+            ss << ((spec.mode == "range") ? "p" : "h") << key;
+        }
+        p->table = ss.str();
+        p->queue = new RowBatchQueue(queueDepth);
+        p->queue->setMemoryBudget(budget);
+        p->queue->setMetrics(metrics);
+
+        DBConnInfo partConn = conn;
+        partConn.table = p->table;
+        p->pool = new WriterPool(p->queue, partConn, bufferSize);
+        for (int i=0; i<numWriters; i++) {
+            p->schemas.push_back(mapper->generateSchema(conn.dbase, p->table));
+        }
+        cout << "Partition table " << p->table << ":" << endl;
+        p->pool->start(p->schemas);
+
+        partitions[key] = p;
+        return p;
+    }
+
+    void PartitionRouter::newBatch(Partition * p) {
+        p->batchRows = batchRows;
+        if (budget) {
+            // the batches of all partitions (open or queued) share half of
+            // the limit, so that the blocks of the reader keep the other
+            // half; each partition gets rows for its open batch and a full
+            // queue
+            long batchLimit = budget->getMaxBytes() / 2;
+            long rowBytes = layout.rowSize + schema->getArrSchemaItems().size();
+            long share = batchLimit / ((long) partitions.size() * (queueDepth + 1));
+            p->batchRows = max(1L, min(batchRows, share / rowBytes));
+
+            long bytes = p->batchRows * rowBytes;
+            if (budget->getUsed(MemoryBudget::BATCHES) + bytes > batchLimit || budget->getUsed() + bytes > budget->getMaxBytes()) {
+                // the writers can only free batches they got: hand over the
+                // open batches of all partitions before waiting, else the
+                // router may wait for memory it holds itself
+                for (map<long, Partition*>::iterator it=partitions.begin(); it!=partitions.end(); ++it) {
+                    if (it->second->batch) {
+                        pushBatch(it->second);
+                    }
+                }
+                budget->waitComponent(MemoryBudget::BATCHES, bytes, batchLimit);
+                budget->wait(MemoryBudget::BATCHES, bytes);
+            }
+        }
+        p->batch = new RowBatch(p->numBatches, p->batchRows, layout, budget);
+    }
+
+    void PartitionRouter::pushBatch(Partition * p) {
+        p->queue->push(p->batch);
+        p->numBatches++;
+        p->batch = NULL;
+    }
+
+    long PartitionRouter::run(DBReader::Reader * reader) {
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        vector<char> row(layout.rowSize + 1);
+        vector<char> nulls(items.size() + 1);
+        Partition * p = NULL;
+        long lastKey = 0;
+
+        while (reader->getNextRow()) {
+            for (int j=0; j<items.size(); j++) {
+                nulls[j] = reader->getItemInRow(items[j]->getDataDesc(), true, true, &row[layout.offsets[j]]);
+            }
+
+            // consecutive rows often belong to the same partition
+            long key = getPartitionKey(&row[0], nulls[columnIndex]);
+            if (!p || key != lastKey) {
+                p = getPartition(key);
+                lastKey = key;
+            }
+
+            if (!p->batch) {
+                newBatch(p);
+            }
+            memcpy(p->batch->getRow(p->batch->nrows), &row[0], layout.rowSize);
+            memcpy(p->batch->getNulls(p->batch->nrows), &nulls[0], items.size());
+            p->batch->nrows++;
+            p->numRows++;
+            numRows++;
+
+            if (p->batch->nrows == p->batchRows) {
+                pushBatch(p);
+            }
+        }
+
+        return numRows;
+    }
+
+    void PartitionRouter::finish() {
+        map<long, Partition*>::iterator it;
+
+        for (it=partitions.begin(); it!=partitions.end(); ++it) {
+            Partition * p = it->second;
+            if (p->batch) {
+                pushBatch(p);
+            }
+            p->queue->close();
+        }
+
+        cout << "Rows per partition:" << endl;
+        for (it=partitions.begin(); it!=partitions.end(); ++it) {
+            Partition * p = it->second;
+            p->pool->join();
+            cout << "  " << p->table << ": " << p->numRows << " rows, " << p->numBatches << " batches" << endl;
+            if (p->pool->getNumRows() != p->numRows) {
+                SagIngest_error("PartitionRouter: Number of rows flushed by the writers does not match the number of routed rows.\n");
+            }
+        }
+    }
+
+    long PartitionRouter::getNumRows() {
+        return numRows;
+    }
+
+    long PartitionRouter::getNumWrittenRows() {
+        long n = 0;
+        for (map<long, Partition*>::iterator it=partitions.begin(); it!=partitions.end(); ++it) {
+            n += it->second->pool->getNumRows();
+        }
+        return n;
+    }
+
+
+    vector<double> planPartitionBounds(DBReader::Reader * reader, DBDataSchema::Schema * schema, string column, int n) {
+        int j = findSchemaColumn(schema, column);
+        if (j < 0) {
+            SagIngest_error("planPartitionBounds: The partition column is not in the mapping file.\n");
+        }
+        DataObjDesc * desc = schema->getArrSchemaItems()[j]->getDataDesc();
+        DType dtype = desc->getDataObjDType();
+        QuantileSketch sketch(4096);
+        char value[16];
+
+        // only the partition column is needed
+        while (reader->getNextRow()) {
+            if (!reader->getItemInRow(desc, true, true, value)) {
+                sketch.add(getItemDouble(dtype, value));
+            }
+        }
+        cout << "Quantile sketch over " << sketch.getCount() << " values of " << column << endl;
+
+        return sketch.getBoundaries(n);
+    }
+
+}
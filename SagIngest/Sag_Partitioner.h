@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Reader.h>
+#include <Schema.h>
+#include <DType.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "Sag_RowBatch.h"
+#include "Sag_WriterPool.h"
+#include "Sag_DBConnection.h"
+#include "Sag_SchemaMapper.h"
+
+#ifndef Sag_Sag_Partitioner_h
+#define Sag_Sag_Partitioner_h
+
+namespace Sag {
+
+    // Streaming quantile sketch (compactors as in the KLL sketch): level h
+    // holds values standing for 2^h values each; a full level is sorted and
+    // every other value moves up. Keeps O(k log(n/k)) values instead of n,
+    // with a rank error of the order of n/k.
+    class QuantileSketch {
+    private:
+        int k;
+        std::vector< std::vector<double> > levels;
+        long count;
+        unsigned long seed;
+
+        void compact(int h);
+
+    public:
+        QuantileSketch(int newK);
+
+        void add(double v);
+        long getCount();
+
+        // n-1 boundaries which split the values into n parts of equal size
+        std::vector<double> getBoundaries(int n);
+    };
+
+
+    // How rows are assigned to partitions: by the value of a column
+    // (one table per value, e.g. snapnum), by ranges of a column between
+    // the given boundaries, or by a hash of the column into n tables.
+    class PartitionSpec {
+        public:
+            std::string column;     // database column of the main table
+            std::string mode;       // value, range or hash
+            int numPartitions;      // hash
+            std::vector<double> bounds; // range: partition i gets bounds[i-1] <= v < bounds[i]
+            int maxPartitions;      // stop with an error beyond this many tables (0: no limit)
+
+            PartitionSpec();
+    };
+
+
+    // One partition table with its own queue, batches and writers.
+    class Partition {
+        public:
+            std::string table;
+            RowBatchQueue * queue;
+            WriterPool * pool;
+            std::vector<DBDataSchema::Schema*> schemas;
+            RowBatch * batch;
+            long batchRows;         // rows of the open batch (fewer with --maxMemory)
+            long numBatches;
+            long numRows;
+
+            Partition();
+    };
+
+
+    // Reads rows like BatchProducer, but routes each row to the table of its
+    // partition (<table>_<value>, <table>_p<i> or <table>_h<i>), each with
+    // independent insert batches and writer threads, so that the database
+    // does not have to route the rows itself.
+    class PartitionRouter {
+    private:
+        PartitionSpec spec;
+        DBDataSchema::Schema * schema;
+        SagSchemaMapper * mapper;
+        DBConnInfo conn;
+        int bufferSize;
+        int numWriters;
+        long batchRows;
+        int queueDepth;
+        MemoryBudget * budget;
+        Metrics * metrics;
+
+        RowLayout layout;
+        int columnIndex;
+        DBDataSchema::DType columnType;
+
+        std::map<long, Partition*> partitions;
+        long numRows;
+
+        long getPartitionKey(const char * row, bool isNull);
+        Partition * getPartition(long key);
+        void newBatch(Partition * p);
+        void pushBatch(Partition * p);
+
+    public:
+        PartitionRouter(const PartitionSpec &newSpec, DBDataSchema::Schema * newSchema, SagSchemaMapper * newMapper,
+                        const DBConnInfo &newConn, int newBufferSize, int newNumWriters, long newBatchRows, int newQueueDepth);
+        ~PartitionRouter();
+
+        // count the batches of all partitions; the open and queued batches
+        // of all partitions together stay within half of the limit
+        void setMemoryBudget(MemoryBudget * newBudget);
+
+        // count the batches written by the writers of all partitions
+        void setMetrics(Metrics * newMetrics);
+
+        long run(DBReader::Reader * reader);
+
+        // send the last batches, wait for all writers and print statistics
+        void finish();
+
+        long getNumRows();
+        long getNumWrittenRows();
+    };
+
+
+    // planning pass: read the column from all rows into a quantile sketch
+    // and return n-1 boundaries for n balanced range partitions
+    std::vector<double> planPartitionBounds(DBReader::Reader * reader, DBDataSchema::Schema * schema, std::string column, int n);
+
+    // index of the schema item for the given database column, -1 if not found
+    int findSchemaColumn(DBDataSchema::Schema * schema, std::string column);
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <sstream>
+#include <stdlib.h>
+
+#include "Sag_Precision.h"
+
+using namespace std;
+
+namespace Sag {
+
+    ColumnPrecision::ColumnPrecision() {
+        toFloat = false;
+        mantissaBits = -1;
+    }
+
+    bool ColumnPrecision::parseOption(const string &option) {
+        if (option == "float") {
+            toFloat = true;
+            return true;
+        }
+        if (option.compare(0, 5, "bits=") == 0 && option.size() > 5) {
+            char *end;
+            mantissaBits = strtol(option.c_str() + 5, &end, 10);
+            return *end == '\0';
+        }
+        return false;
+    }
+
+    string ColumnPrecision::describe() {
+        stringstream ss;
+        if (toFloat) {
+            ss << "double -> float";
+        }
+        if (mantissaBits >= 0) {
+            ss << (toFloat ? ", " : "") << mantissaBits << " mantissa bits";
+        }
+        return ss.str();
+    }
+
+    void doublesToFloats(const double *in, float *out, long n) {
+        for (long i=0; i<n; i++) {
+            out[i] = (float) in[i];
+        }
+    }
+
+    // The loops below work on the bit patterns with integer operations and
+    // selects only, so that the compiler can vectorise them. Rounding adds
+    // half of the dropped part (minus one, plus the lowest kept bit, i.e.
+    // ties to even) and clears it; a carry into the exponent is correct
+    // rounding. NaN and Inf are kept, finite values which would round up
+    // to Inf are truncated instead.
+
+    void quantizeFloats(float *values, long n, int mantissaBits) {
+        int drop = 23 - mantissaBits;
+        if (mantissaBits < 0 || drop <= 0) {
+            return;
+        }
+        const uint32_t expMask = 0x7f800000u;
+        const uint32_t dropMask = (1u << drop) - 1;
+        const uint32_t half = (1u << (drop - 1)) - 1;
+        uint32_t *bits = (uint32_t*) values;
+
+        for (long i=0; i<n; i++) {
+            uint32_t u = bits[i];
+            uint32_t rounded = (u + half + ((u >> drop) & 1)) & ~dropMask;
+            uint32_t truncated = u & ~dropMask;
+            uint32_t finite = ((rounded & expMask) == expMask) ? truncated : rounded;
+            bits[i] = ((u & expMask) == expMask) ? u : finite;
+        }
+    }
+
+    void quantizeDoubles(double *values, long n, int mantissaBits) {
+        int drop = 52 - mantissaBits;
+        if (mantissaBits < 0 || drop <= 0) {
+            return;
+        }
+        const uint64_t expMask = 0x7ff0000000000000ull;
+        const uint64_t dropMask = (1ull << drop) - 1;
+        const uint64_t half = (1ull << (drop - 1)) - 1;
+        uint64_t *bits = (uint64_t*) values;
+
+        for (long i=0; i<n; i++) {
+            uint64_t u = bits[i];
+            uint64_t rounded = (u + half + ((u >> drop) & 1)) & ~dropMask;
+            uint64_t truncated = u & ~dropMask;
+            uint64_t finite = ((rounded & expMask) == expMask) ? truncated : rounded;
+            bits[i] = ((u & expMask) == expMask) ? u : finite;
+        }
+    }
+
+}
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <stdint.h>
+
+#ifndef Sag_Sag_Precision_h
+#define Sag_Sag_Precision_h
+
+namespace Sag {
+
+    // Precision reduction of one floating point column, given as options
+    // after the database type in the mapping file:
+    //   float    read a double dataset as float (the column type must be REAL4)
+    //   bits=N   keep only N bits of the mantissa, rounded to nearest (even)
+    // Columns with less mantissa compress better in the database and the
+    // values are unchanged up to a relative error of 2^-(N+1).
+    class ColumnPrecision {
+        public:
+            bool toFloat;
+            int mantissaBits;   // -1: keep all
+
+            ColumnPrecision();
+
+            // parse one option; false if it is not a precision option
+            bool parseOption(const std::string &option);
+
+            std::string describe();
+    };
+
+    // the transforms for one block of a column, in place where possible
+    void doublesToFloats(const double *in, float *out, long n);
+    void quantizeFloats(float *values, long n, int mantissaBits);
+    void quantizeDoubles(double *values, long n, int mantissaBits);
+
+}
+
+#endif
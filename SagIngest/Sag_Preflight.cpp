@@ -0,0 +1,425 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+
+#include "Sag_Preflight.h"
+#include "Sag_Reader.h"
+#include "Sag_ThreadPool.h"
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Sag {
+
+    // columns computed by the reader (see SagReader::getDataItem) and the
+    // type of the value it writes for them
+    static const struct {
+        const char *name;
+        DType type;
+    } derivedColumns[] = {
+        {"snapnum", DT_INT4}, {"redshift", DT_REAL4}, {"NInFile", DT_INT8}, {"fileNum", DT_INT4},
+        {"dbId", DT_INT8}, {"forestId", DT_INT8}, {"depthFirstId", DT_INT8},
+        {"ix", DT_INT4}, {"iy", DT_INT4}, {"iz", DT_INT4}, {"phkey", DT_INT8}
+    };
+    static const int numDerivedColumns = sizeof(derivedColumns) / sizeof(derivedColumns[0]);
+
+    static const char * typeName(DType t) {
+        switch (t) {
+            case DT_INT1: return "INT1";
+            case DT_INT2: return "INT2";
+            case DT_INT4: return "INT4";
+            case DT_INT8: return "INT8";
+            case DT_REAL4: return "REAL4";
+            case DT_REAL8: return "REAL8";
+            default: return "other";
+        }
+    }
+
+    // collect the datasets below a group, with their path relative to it
+    static void listDataSets(hid_t gid, const string &prefix, vector<string> &names) {
+        hsize_t nobj = 0;
+        char memb_name[1024];
+
+        H5Gget_num_objs(gid, &nobj);
+        for (hsize_t i=0; i<nobj; i++) {
+            H5Gget_objname_by_idx(gid, i, memb_name, sizeof(memb_name));
+            int otype = H5Gget_objtype_by_idx(gid, (size_t) i);
+            if (otype == H5G_GROUP) {
+                hid_t sub = H5Gopen(gid, memb_name, H5P_DEFAULT);
+                listDataSets(sub, prefix + "/" + memb_name, names);
+                H5Gclose(sub);
+            } else if (otype == H5G_DATASET) {
+                names.push_back(prefix + "/" + memb_name);
+            }
+        }
+    }
+
+
+    PreflightResult::PreflightResult() {
+        numOutputs = 0;
+        rows = 0;
+    }
+
+
+    Preflight::Preflight(const vector<string> &newFieldNames, Schema * schema, const vector<int> &newSnapnums) {
+        fieldNames = newFieldNames;
+        snapnums = newSnapnums;
+
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        for (int j=0; j<items.size(); j++) {
+            DataObjDesc * d = items[j]->getDataDesc();
+            if (!d->getIsConstItem()) {
+                fieldTypes[d->getDataObjName()] = d->getDataObjDType();
+            }
+        }
+
+        // the computed columns do not depend on the files
+        for (int i=0; i<numDerivedColumns; i++) {
+            map<string, DType>::iterator it = fieldTypes.find(derivedColumns[i].name);
+            if (it != fieldTypes.end() && it->second != derivedColumns[i].type) {
+                stringstream ss;
+                ss << it->first << " is " << typeName(it->second) << " in the mapping file, but is computed as "
+                   << typeName(derivedColumns[i].type);
+                fieldMapErrors.push_back(ss.str());
+            }
+        }
+    }
+
+    void Preflight::setPrecisions(const map<string, ColumnPrecision> &newPrecisions) {
+        precisions = newPrecisions;
+    }
+
+    vector<string> Preflight::getFieldMapErrors() {
+        return fieldMapErrors;
+    }
+
+    PreflightResult Preflight::checkFile(const string &fileName) {
+        PreflightResult result;
+        result.fileName = fileName;
+
+        // touch the file without HDF5 first, this part runs in parallel
+        // (e.g. for files on a network file system)
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            result.errors.push_back("cannot open the file");
+            return result;
+        }
+        char superblock[4096];
+        ssize_t n = pread(fd, superblock, sizeof(superblock), 0);
+        close(fd);
+        if (n <= 0) {
+            result.errors.push_back("cannot read the file");
+            return result;
+        }
+
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        hid_t fid = -1;
+        H5E_BEGIN_TRY {
+            fid = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        } H5E_END_TRY;
+        if (fid < 0) {
+            result.errors.push_back("not an HDF5 file or cannot be opened by HDF5");
+            return result;
+        }
+
+        // output groups as found by SagReader::getMeta
+        vector<string> outputNames;
+        hid_t root = H5Gopen(fid, "/", H5P_DEFAULT);
+        hsize_t nobj = 0;
+        char memb_name[1024];
+        H5Gget_num_objs(root, &nobj);
+        for (hsize_t i=0; i<nobj; i++) {
+            H5Gget_objname_by_idx(root, i, memb_name, sizeof(memb_name));
+            if (H5Gget_objtype_by_idx(root, (size_t) i) == H5G_GROUP && string(memb_name).compare(0, 6, "Output") == 0) {
+                outputNames.push_back(string("/") + memb_name);
+            }
+        }
+        H5Gclose(root);
+        if (outputNames.size() == 0) {
+            outputNames.push_back("");
+        }
+
+        vector<int> found;
+        for (int o=0; o<outputNames.size(); o++) {
+            string groupName = (outputNames[o] == "") ? string("/") : outputNames[o];
+            hid_t group = H5Gopen(fid, groupName.c_str(), H5P_DEFAULT);
+            int snapnum = -1;
+
+            if (H5Aexists(group, "Redshift") <= 0) {
+                result.errors.push_back("no Redshift attribute in " + groupName);
+            }
+            if (H5Aexists(group, "Snapshot") > 0) {
+                hid_t att = H5Aopen(group, "Snapshot", H5P_DEFAULT);
+                if (H5Aread(att, H5T_NATIVE_INT, &snapnum) < 0) {
+                    result.errors.push_back("cannot read the Snapshot attribute of " + groupName);
+                }
+                H5Aclose(att);
+            } else if (outputNames[o] != "") {
+                snapnum = atoi(outputNames[o].substr(7).c_str());
+            } else {
+                result.errors.push_back("no Snapshot attribute in /");
+            }
+            H5Gclose(group);
+
+            if (snapnums.size() > 0 && find(snapnums.begin(), snapnums.end(), snapnum) == snapnums.end()) {
+                continue;
+            }
+            found.push_back(snapnum);
+            result.numOutputs++;
+            checkOutput(fid, outputNames[o], result);
+        }
+
+        if (result.numOutputs == 0) {
+            result.errors.push_back("none of the requested snapshots found");
+        } else if (snapnums.size() > found.size()) {
+            stringstream ss;
+            ss << "only " << found.size() << " of " << snapnums.size() << " requested snapshots found";
+            result.warnings.push_back(ss.str());
+        }
+
+        H5Fclose(fid);
+        return result;
+    }
+
+    void Preflight::checkOutput(hid_t fid, const string &outputName, PreflightResult &result) {
+        string groupName = (outputName == "") ? string("/") : outputName;
+        vector<string> all;
+        hid_t group = H5Gopen(fid, groupName.c_str(), H5P_DEFAULT);
+        listDataSets(group, "", all);
+        H5Gclose(group);
+
+        // the mapped columns of each dataset, as in SagReader::selectOutput
+        vector<bool> matched(fieldNames.size(), false);
+        long outputRows = -1;
+        string firstDataSet;
+        for (int k=0; k<all.size(); k++) {
+            vector<string> columns;
+            vector<int> comps;
+            string matchname;
+            int comp;
+            for (int j=0; j<fieldNames.size(); j++) {
+                if (parseColumnName(fieldNames[j], matchname, comp) && all[k] == matchname) {
+                    columns.push_back(fieldNames[j]);
+                    comps.push_back(comp);
+                    matched[j] = true;
+                }
+            }
+            if (columns.size() > 0) {
+                checkDataSet(fid, outputName, all[k], columns, comps, outputRows, firstDataSet, result);
+            }
+        }
+
+        if (outputRows < 0) {
+            result.errors.push_back("no mapped datasets in " + groupName);
+            return;
+        }
+        result.rows += outputRows;
+        if (outputRows == 0) {
+            result.warnings.push_back("no rows in " + groupName);
+        }
+
+        // all other names must be columns computed by the reader
+        for (int j=0; j<fieldNames.size(); j++) {
+            if (matched[j]) {
+                continue;
+            }
+            bool derived = false;
+            for (int i=0; i<numDerivedColumns; i++) {
+                derived = derived || (fieldNames[j] == derivedColumns[i].name);
+            }
+            if (!derived && fieldTypes.find(fieldNames[j]) != fieldTypes.end()) {
+                result.errors.push_back(fieldNames[j] + " not found in " + groupName + " and not a computed column");
+            }
+        }
+    }
+
+    void Preflight::checkDataSet(hid_t fid, const string &outputName, const string &dsname,
+                                 const vector<string> &columns, const vector<int> &comps,
+                                 long &outputRows, string &firstDataSet, PreflightResult &result) {
+        string path = outputName + dsname;
+        hid_t dset = -1;
+        H5E_BEGIN_TRY {
+            dset = H5Dopen2(fid, path.c_str(), H5P_DEFAULT);
+        } H5E_END_TRY;
+        if (dset < 0) {
+            result.errors.push_back("cannot open the dataset " + path);
+            return;
+        }
+
+        hid_t ftype = H5Dget_type(dset);
+        hid_t space = H5Dget_space(dset);
+        hid_t dcpl = H5Dget_create_plist(dset);
+        H5T_class_t typeClass = H5Tget_class(ftype);
+        size_t size = H5Tget_size(ftype);
+        int rank = H5Sget_simple_extent_ndims(space);
+        hsize_t dims[2] = {0, 1};
+        stringstream ss;
+
+        // the types the reader can read, and the type of the values it
+        // hands to the ingestor
+        DType fileType = DT_STRING;
+        if (typeClass == H5T_INTEGER && size == sizeof(long)) {
+            fileType = DT_INT8;
+        } else if (typeClass == H5T_INTEGER && size == sizeof(int8_t)) {
+            fileType = DT_INT1;
+        } else if (typeClass == H5T_FLOAT && size == sizeof(double)) {
+            fileType = DT_REAL8;
+        } else if (typeClass == H5T_FLOAT && size == sizeof(float)) {
+            fileType = DT_REAL4;
+        } else if (typeClass == H5T_INTEGER || typeClass == H5T_FLOAT) {
+            ss << path << ": " << size << "-byte " << ((typeClass == H5T_INTEGER) ? "integer" : "float") << " is not supported";
+            result.errors.push_back(ss.str());
+        } else {
+            ss << path << ": type class " << typeClass << " is not supported";
+            result.errors.push_back(ss.str());
+        }
+        if (typeClass == H5T_INTEGER && H5Tget_sign(ftype) == H5T_SGN_NONE) {
+            result.warnings.push_back(path + ": unsigned integer, values above the signed range are clipped");
+        }
+
+        if (rank == 1 || rank == 2) {
+            H5Sget_simple_extent_dims(space, dims, NULL);
+        } else {
+            ss.str("");
+            ss << path << ": rank " << rank << " is not supported (only 1 or 2)";
+            result.errors.push_back(ss.str());
+        }
+
+        for (int c=0; c<columns.size(); c++) {
+            if ((comps[c] < 0 && dims[1] != 1) || comps[c] >= (int) dims[1]) {
+                ss.str("");
+                ss << columns[c] << ": " << path << " has " << dims[1] << " columns";
+                result.errors.push_back(ss.str());
+            }
+            map<string, DType>::iterator it = fieldTypes.find(columns[c]);
+            DType readType = fileType;
+            if (fileType == DT_REAL8 && precisions.count(columns[c]) && precisions[columns[c]].toFloat) {
+                readType = DT_REAL4;
+            }
+            if (fileType != DT_STRING && it != fieldTypes.end() && it->second != readType) {
+                ss.str("");
+                ss << columns[c] << " is " << typeName(it->second) << " in the mapping file, but " << typeName(fileType) << " in " << path;
+                result.errors.push_back(ss.str());
+            }
+        }
+
+        // all mapped datasets of an output are read with the rows of the first one
+        if (rank == 1 || rank == 2) {
+            if (outputRows < 0) {
+                outputRows = dims[0];
+                firstDataSet = path;
+            } else if ((long) dims[0] != outputRows) {
+                ss.str("");
+                ss << path << " has " << dims[0] << " rows, " << firstDataSet << " has " << outputRows;
+                result.errors.push_back(ss.str());
+            }
+        }
+
+        // HDF5 reads missing source files of virtual datasets as fill values
+        if (H5Pget_layout(dcpl) == H5D_VIRTUAL) {
+            char name[4096];
+            H5Fget_name(fid, name, sizeof(name));
+            string virtualName(name);
+            string virtualDir = (virtualName.find('/') == string::npos) ? string("") : virtualName.substr(0, virtualName.find_last_of('/') + 1);
+            size_t count = 0;
+            H5Pget_virtual_count(dcpl, &count);
+            for (size_t i=0; i<count; i++) {
+                H5Pget_virtual_filename(dcpl, i, name, sizeof(name));
+                string source(name);
+                if (source == ".") {
+                    continue;
+                }
+                if (access(source.c_str(), R_OK) != 0 && (source[0] == '/' || access((virtualDir + source).c_str(), R_OK) != 0)) {
+                    result.errors.push_back(path + ": source file " + source + " not found");
+                }
+            }
+        }
+
+        H5Pclose(dcpl);
+        H5Sclose(space);
+        H5Tclose(ftype);
+        H5Dclose(dset);
+    }
+
+
+    // checks one file on the pool
+    class PreflightTask : public PoolTask {
+        public:
+            Preflight * preflight;
+            PreflightResult result;
+
+            void run() {
+                result = preflight->checkFile(result.fileName);
+            }
+    };
+
+    bool Preflight::run(const vector<string> &fileNames, int numThreads) {
+        boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+        numThreads = max(1, min(numThreads, (int) fileNames.size()));
+        cout << "Preflight: checking " << fileNames.size() << " files with " << numThreads << " threads ..." << endl;
+
+        for (int i=0; i<fieldMapErrors.size(); i++) {
+            cout << "  ERROR (mapping file): " << fieldMapErrors[i] << endl;
+        }
+
+        vector<PreflightTask> tasks(fileNames.size());
+        {
+            ThreadPool pool(numThreads);
+            for (int i=0; i<fileNames.size(); i++) {
+                tasks[i].preflight = this;
+                tasks[i].result.fileName = fileNames[i];
+                pool.submit(&tasks[i]);
+            }
+            pool.wait();
+        }
+
+        long rows = 0;
+        long failed = 0;
+        long warnings = 0;
+        for (int i=0; i<tasks.size(); i++) {
+            PreflightResult &r = tasks[i].result;
+            bool ok = (r.errors.size() == 0);
+            cout << (ok ? "  OK      " : "  FAILED  ") << r.fileName << ": " << r.numOutputs << " outputs, " << r.rows << " rows" << endl;
+            for (int k=0; k<r.errors.size(); k++) {
+                cout << "          ERROR: " << r.errors[k] << endl;
+            }
+            for (int k=0; k<r.warnings.size(); k++) {
+                cout << "          Warning: " << r.warnings[k] << endl;
+            }
+            rows += r.rows;
+            failed += ok ? 0 : 1;
+            warnings += r.warnings.size();
+        }
+
+        double seconds = (boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds() / 1.e6;
+        cout << "Preflight: " << fileNames.size() << " files, " << rows << " rows, " << failed << " files with errors, "
+             << warnings << " warnings (" << seconds << " s)" << endl;
+
+        return failed == 0 && fieldMapErrors.size() == 0;
+    }
+
+}
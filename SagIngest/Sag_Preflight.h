@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <Schema.h>
+#include <DType.h>
+#include "H5Cpp.h"
+
+#include "Sag_Precision.h"
+
+#ifndef Sag_Sag_Preflight_h
+#define Sag_Sag_Preflight_h
+
+namespace Sag {
+
+    // What the preflight found in one data file.
+    class PreflightResult {
+        public:
+            std::string fileName;
+            int numOutputs;     // selected outputs
+            long rows;          // in the selected outputs
+            std::vector<std::string> errors;
+            std::vector<std::string> warnings;
+
+            PreflightResult();
+    };
+
+
+    // Checks data files against the mapping file before anything is
+    // written to the database, so that problems the reader would only
+    // find (and abort on) in the middle of an ingest are reported at once:
+    // the file cannot be opened, Redshift/Snapshot attributes are missing,
+    // none of the requested snapshots is there, a mapped dataset is
+    // missing, has an unsupported type or rank, lacks a requested column,
+    // its type does not match the type in the mapping file, or the mapped
+    // datasets of an output differ in their number of rows; virtual
+    // datasets must have all their source files.
+    class Preflight {
+    private:
+        std::vector<std::string> fieldNames;
+        std::map<std::string, DBDataSchema::DType> fieldTypes;
+        std::vector<int> snapnums;
+        std::vector<std::string> fieldMapErrors;
+        std::map<std::string, ColumnPrecision> precisions;
+
+        void checkOutput(hid_t fid, const std::string &outputName, PreflightResult &result);
+        void checkDataSet(hid_t fid, const std::string &outputName, const std::string &dsname,
+                          const std::vector<std::string> &columns, const std::vector<int> &comps,
+                          long &outputRows, std::string &firstDataSet, PreflightResult &result);
+
+    public:
+        Preflight(const std::vector<std::string> &newFieldNames, DBDataSchema::Schema * schema, const std::vector<int> &newSnapnums);
+
+        // columns read as float may be double in the files
+        void setPrecisions(const std::map<std::string, ColumnPrecision> &newPrecisions);
+
+        PreflightResult checkFile(const std::string &fileName);
+
+        // problems of the mapping file itself (the same for all files)
+        std::vector<std::string> getFieldMapErrors();
+
+        // check all files with numThreads threads and print a report;
+        // false if the mapping file or any of the files has errors
+        bool run(const std::vector<std::string> &fileNames, int numThreads);
+    };
+
+}
+
+#endif
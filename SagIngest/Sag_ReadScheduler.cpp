@@ -0,0 +1,226 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+
+#include "Sag_ReadScheduler.h"
+#include "Sag_Trace.h"
+
+using namespace std;
+using namespace H5;
+
+namespace Sag {
+
+    DataSetExtent::DataSetExtent() {
+        chunked = false;
+        address = HADDR_UNDEF;
+        rowBytes = 0;
+        chunkRows = 0;
+        raw = false;
+    }
+
+    haddr_t DataSetExtent::getAddress(hsize_t row) {
+        if (!chunked) {
+            return (address == HADDR_UNDEF) ? HADDR_UNDEF : address + row * rowBytes;
+        }
+        if (chunkRows == 0 || row / chunkRows >= chunkAddresses.size()) {
+            return HADDR_UNDEF;
+        }
+        return chunkAddresses[row / chunkRows];
+    }
+
+
+    // sorts dataset indices by their file address for one block
+    class AddressOrder {
+        public:
+            vector<haddr_t> *addresses;
+            bool operator()(int a, int b) const {
+                return (*addresses)[a] < (*addresses)[b];
+            }
+    };
+
+
+    ReadScheduler::ReadScheduler() {
+        mergeGap = 0;
+        fd = -1;
+    }
+
+    void ReadScheduler::setMergeGap(long newMergeGap) {
+        mergeGap = newMergeGap;
+    }
+
+    void ReadScheduler::scan(H5File *fp, const vector<string> &dataSetNames) {
+        hid_t fid = fp->getId();
+        hid_t fapl, fcpl;
+        hsize_t userblock = 0;
+
+        TraceSpan span("scan_extents", "meta");
+        extents.clear();
+        extents.resize(dataSetNames.size());
+
+        // merged reads go directly to the file, only possible with the
+        // default (sec2) driver; addresses are relative to the superblock
+        fd = -1;
+        fapl = H5Fget_access_plist(fid);
+        fcpl = H5Fget_create_plist(fid);
+        H5Pget_userblock(fcpl, &userblock);
+        if (H5Pget_driver(fapl) == H5FD_SEC2 && userblock == 0) {
+            void *handle = NULL;
+            if (H5Fget_vfd_handle(fid, fapl, &handle) >= 0 && handle) {
+                fd = *(int*) handle;
+            }
+        }
+        H5Pclose(fapl);
+        H5Pclose(fcpl);
+
+        for (int k=0; k<dataSetNames.size(); k++) {
+            DataSetExtent &e = extents[k];
+            hid_t dset = H5Dopen2(fid, dataSetNames[k].c_str(), H5P_DEFAULT);
+            hid_t space = H5Dget_space(dset);
+            hid_t dcpl = H5Dget_create_plist(dset);
+            hid_t ftype = H5Dget_type(dset);
+            hsize_t dims[2] = {0, 1};
+            int rank = H5Sget_simple_extent_ndims(space);
+
+            if (rank == 1 || rank == 2) {
+                H5Sget_simple_extent_dims(space, dims, NULL);
+            }
+            if (rank == 1) {
+                dims[1] = 1;
+            }
+            e.rowBytes = H5Tget_size(ftype) * dims[1];
+
+            if (H5Pget_layout(dcpl) == H5D_CHUNKED) {
+                e.chunked = true;
+                hsize_t chunkDims[2] = {0, 1};
+                H5Pget_chunk(dcpl, 2, chunkDims);
+                e.chunkRows = chunkDims[0];
+#if H5_VERSION_GE(1,10,5)
+                hsize_t nchunks = 0;
+                if (e.chunkRows > 0) {
+                    e.chunkAddresses.assign((dims[0] + e.chunkRows - 1) / e.chunkRows, HADDR_UNDEF);
+                    H5Dget_num_chunks(dset, space, &nchunks);
+                }
+                for (hsize_t i=0; i<nchunks; i++) {
+                    hsize_t chunkOffset[2] = {0, 0};
+                    unsigned filterMask;
+                    haddr_t addr;
+                    hsize_t size;
+                    if (H5Dget_chunk_info(dset, space, i, chunkOffset, &filterMask, &addr, &size) >= 0
+                        && (rank == 1 || chunkOffset[1] == 0)) {
+                        e.chunkAddresses[chunkOffset[0] / e.chunkRows] = addr;
+                    }
+                }
+#endif
+            } else {
+                e.address = H5Dget_offset(dset);
+
+                // raw reads only without any conversion
+                H5T_class_t typeClass = H5Tget_class(ftype);
+                size_t size = H5Tget_size(ftype);
+                hid_t native = -1;
+                if (typeClass == H5T_INTEGER && size == sizeof(long)) {
+                    native = H5T_NATIVE_LONG;
+                } else if (typeClass == H5T_INTEGER && size == sizeof(int8_t)) {
+                    native = H5T_NATIVE_INT8;
+                } else if (typeClass == H5T_FLOAT && size == sizeof(double)) {
+                    native = H5T_NATIVE_DOUBLE;
+                } else if (typeClass == H5T_FLOAT && size == sizeof(float)) {
+                    native = H5T_NATIVE_FLOAT;
+                }
+                e.raw = (fd >= 0 && e.address != HADDR_UNDEF && native >= 0 && H5Tequal(ftype, native) > 0
+                         && H5Pget_external_count(dcpl) == 0);
+            }
+
+            H5Tclose(ftype);
+            H5Pclose(dcpl);
+            H5Sclose(space);
+            H5Dclose(dset);
+        }
+    }
+
+    vector<int> ReadScheduler::getReadOrder(hsize_t row) {
+        vector<int> order(extents.size());
+        vector<haddr_t> addresses(extents.size());
+        AddressOrder cmp;
+
+        for (int k=0; k<extents.size(); k++) {
+            order[k] = k;
+            addresses[k] = extents[k].getAddress(row); // HADDR_UNDEF is the largest address
+        }
+        cmp.addresses = &addresses;
+        stable_sort(order.begin(), order.end(), cmp);
+
+        return order;
+    }
+
+    vector< vector<int> > ReadScheduler::getReadGroups(hsize_t row, hsize_t nrows) {
+        vector<int> order = getReadOrder(row);
+        vector< vector<int> > groups;
+        haddr_t end = 0;
+
+        for (int i=0; i<order.size(); i++) {
+            DataSetExtent &e = extents[order[i]];
+            haddr_t start = e.getAddress(row);
+
+            // join the previous group, if this block of data follows closely
+            bool join = (mergeGap >= 0 && i > 0 && e.raw && extents[groups.back().back()].raw
+                         && start >= end && start - end <= (haddr_t) mergeGap);
+            if (join) {
+                groups.back().push_back(order[i]);
+            } else {
+                groups.push_back(vector<int>(1, order[i]));
+            }
+            if (e.raw) {
+                end = start + nrows * e.rowBytes;
+            }
+        }
+
+        return groups;
+    }
+
+    bool ReadScheduler::readGroup(const vector<int> &group, hsize_t row, hsize_t nrows, vector<char> &buffer, vector<size_t> &offsets) {
+        DataSetExtent &first = extents[group.front()];
+        DataSetExtent &last = extents[group.back()];
+        haddr_t start = first.getAddress(row);
+        haddr_t end = last.getAddress(row) + nrows * last.rowBytes;
+        size_t done = 0;
+        ssize_t n;
+        TraceSpan span("read_merged", "read");
+
+        buffer.resize(end - start);
+        while (done < buffer.size()) {
+            n = pread(fd, &buffer[done], buffer.size() - done, start + done);
+            if (n <= 0) {
+                cout << "Warning: Merged read failed, reading datasets one by one." << endl;
+                return false;
+            }
+            done += n;
+        }
+
+        offsets.resize(group.size());
+        for (int i=0; i<group.size(); i++) {
+            offsets[i] = extents[group[i]].getAddress(row) - start;
+        }
+        return true;
+    }
+
+}
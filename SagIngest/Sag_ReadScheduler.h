@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include "H5Cpp.h"
+
+#ifndef Sag_Sag_ReadScheduler_h
+#define Sag_Sag_ReadScheduler_h
+
+namespace Sag {
+
+    // Where the data of one dataset is stored in the file.
+    class DataSetExtent {
+        public:
+            bool chunked;
+            haddr_t address;        // contiguous layout: start of the data
+            hsize_t rowBytes;       // bytes per row (all columns) in the file
+            hsize_t chunkRows;
+            std::vector<haddr_t> chunkAddresses; // chunked: address of each chunk of rows
+            bool raw;               // contiguous, native type: can be read without HDF5
+
+            DataSetExtent();
+
+            // address of the data of the given row (HADDR_UNDEF if unknown)
+            haddr_t getAddress(hsize_t row);
+    };
+
+
+    // Orders the dataset reads of a block by their position in the file,
+    // so that reading a block becomes a forward sweep instead of seeking
+    // back and forth in the order of the dataset names. Datasets with
+    // contiguous layout whose data for the block are adjacent in the file
+    // (or at most mergeGap bytes apart) are read together with one read.
+    class ReadScheduler {
+    private:
+        std::vector<DataSetExtent> extents;
+        long mergeGap;  // < 0: do not merge
+        int fd;         // file descriptor for merged reads, -1 if not possible
+
+    public:
+        ReadScheduler();
+
+        // get the file positions once (for each output group)
+        void scan(H5::H5File *fp, const std::vector<std::string> &dataSetNames);
+        void setMergeGap(long newMergeGap);
+
+        // indices of the datasets in order of their data in the file, for
+        // a block starting at row; datasets with unknown position keep
+        // their order, after the others
+        std::vector<int> getReadOrder(hsize_t row);
+
+        // the read order, split into groups to be read with one read each
+        std::vector< std::vector<int> > getReadGroups(hsize_t row, hsize_t nrows);
+
+        // read the rows of a group of datasets at once; the data of each
+        // dataset (nrows x all columns) starts at buffer[offsets[i]]
+        bool readGroup(const std::vector<int> &group, hsize_t row, hsize_t nrows, std::vector<char> &buffer, std::vector<size_t> &offsets);
+    };
+
+}
+
+#endif
@@ -26,8 +26,10 @@
 //#include <boost/filesystem.hpp>
 //#include <boost/serialization/string.hpp> // needed on erebos for conversion from boost-path to string()
 #include <boost/regex.hpp> // for string regex match/replace to remove redshift from dataSetNames
+#include <algorithm>
 
 #include "Sag_Reader.h"
+#include "Sag_Trace.h"
 
 //using namespace boost::filesystem;
 
@@ -39,8 +41,50 @@
 namespace Sag {
     SagReader::SagReader() {
         fp = NULL;
+        fileNum = 0;
+        baseFileNum = 0;
+        numDataSets = 0;
 
         currRow = 0;
+        countInBlock = 0;
+        nInBlock = 0;
+        ioutput = 0;
+        numOutputs = 0;
+
+        sorter = NULL;
+        sortKey = "";
+        boxSize = 0;
+        phBits = 20;
+        computePHKey = false;
+
+        chunkReader = NULL;
+        ioOrder = true;
+        prefetched = NULL;
+        multiRead = true;
+        zoneMap = NULL;
+        checksums = NULL;
+        metrics = NULL;
+        countWritten = false;
+        rowLimit = -1;
+        virtualSource = -1;
+        sourceFirstRow = 0;
+
+        memory = NULL;
+        columnBytes = 0;
+        rowBytes = 0;
+        readBufferBytes = 0;
+        readBufferPeak = 0;
+        broadcastVersion = 0;
+        hashContent = false;
+        contentHash = 0;
+        hashedRows = 0;
+
+        blockSizer = NULL;
+        lastBlockRows = 0;
+        lastReadMicroseconds = 0;
+
+        readMicroseconds = 0;
+        numBlocksRead = 0;
     }
     
     SagReader::SagReader(string newFileName, int newFileNum, int newBlocksize, vector<string>datafileFieldNames) {
@@ -50,11 +94,16 @@ namespace Sag {
         // get directory number and file number from file name?
         // no, just let the user provide a file number 
         fileNum = newFileNum;
+        baseFileNum = newFileNum;
 
         fp = NULL;
+        numDataSets = 0;
 
         currRow = 0;
         countInBlock = 0;   // counts values in each datablock (output)
+        nInBlock = 0;
+        ioutput = 0;
+        numOutputs = 0;
 
         blocksize = newBlocksize;
 
@@ -64,6 +113,44 @@ namespace Sag {
 
         posfactor = 1.e-3;
 
+        // no sorting by default, rows are served in file order
+        sorter = NULL;
+        sortKey = "";
+        sortMemory = 1024L*1024L*1024L;
+        sortTmpDir = ".";
+        boxSize = 0;
+        phBits = 20;
+        computePHKey = false;
+
+        chunkReader = NULL;
+        ioOrder = true;
+        prefetched = NULL;
+        multiRead = true;
+        zoneMap = NULL;
+        checksums = NULL;
+        metrics = NULL;
+        countWritten = false;
+        rowLimit = -1;
+        virtualSource = -1;
+        sourceFirstRow = 0;
+
+        memory = NULL;
+        columnBytes = 0;
+        rowBytes = 0;
+        readBufferBytes = 0;
+        readBufferPeak = 0;
+        broadcastVersion = 0;
+        hashContent = false;
+        contentHash = 0;
+        hashedRows = 0;
+
+        blockSizer = NULL;
+        lastBlockRows = 0;
+        lastReadMicroseconds = 0;
+
+        readMicroseconds = 0;
+        numBlocksRead = 0;
+
         openFile(newFileName);
 
         getMeta(datafileFieldNames);
@@ -71,21 +158,102 @@ namespace Sag {
     }
 
 
+    boost::recursive_mutex& sagH5Mutex() {
+        // the HDF5 library is usually not built thread-safe, so all
+        // readers in one process share this lock for their HDF5 calls
+        static boost::recursive_mutex h5mutex;
+        return h5mutex;
+    }
+
+    ReaderSettings::ReaderSettings() {
+        blocksize = 100000;
+        sortKey = "";
+        sortMemory = 1024L*1024L*1024L;
+        sortTmpDir = ".";
+        boxSize = 0;
+        phBits = 20;
+        computePHKey = false;
+        decompressThreads = 0;
+        ioOrder = true;
+        mergeGap = 0;
+        multiRead = true;
+        zoneMap = NULL;
+        checksums = NULL;
+        memory = NULL;
+        adaptiveBlocksize = false;
+        metrics = NULL;
+    }
+
+    void SagReader::applySettings(const ReaderSettings &settings) {
+        blocksize = settings.blocksize;
+        if (settings.snapnums.size() > 0) {
+            setUserSnapnums(settings.snapnums);
+        }
+        setPHKeyParams(settings.boxSize, settings.phBits);
+        setSortKey(settings.sortKey, settings.sortMemory, settings.sortTmpDir);
+        setComputePHKey(settings.computePHKey);
+        setDecompressThreads(settings.decompressThreads);
+        setIOOrder(settings.ioOrder, settings.mergeGap);
+        setMultiRead(settings.multiRead);
+        setAdaptiveBlocksize(settings.adaptiveBlocksize);
+        setZoneMap(settings.zoneMap);
+        setChecksums(settings.checksums);
+        setMemoryBudget(settings.memory);
+        setMetrics(settings.metrics);
+        setPrecisions(settings.precisions);
+        setNulls(settings.nulls);
+    }
+
+    void SagReader::setFile(string newFileName, int newFileNum) {
+        // continue with another file, using the same mapping and settings
+        fileName = newFileName;
+        fileNum = newFileNum;
+        baseFileNum = newFileNum;
+        broadcastVersion++;
+
+        openFile(newFileName);
+        getMeta(fieldNames);
+        cout << "size of dataSetMap: " << dataSetMap.size() << endl;
+    }
+
+    string SagReader::getFileName() {
+        return fileName;
+    }
+
     SagReader::~SagReader() {
         closeFile();
+        clearDataBlocks();
+        if (sorter) {
+            delete sorter;
+            if (memory) {
+                memory->release(MemoryBudget::SORT_BUFFERS, sortMemory);
+            }
+        }
+        if (chunkReader) {
+            delete chunkReader;
+        }
+        if (blockSizer) {
+            delete blockSizer;
+        }
         // delete data sets? i.e. call DataBlock::deleteData?
     }
     
     void SagReader::openFile(string newFileName) {
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
         // open file as hdf5-file
         H5std_string h5fileName;
         h5fileName = (H5std_string) newFileName;
 
+        multiReader.close();
         if (fp) {
             fp->close();
             delete fp;
         }
 
+        if (chunkReader) {
+            chunkReader->clear();
+        }
+
         // TODO: catch error, if file does not exist or not accessible? before using H5 lib?
         fp = new H5File(h5fileName, H5F_ACC_RDONLY); // allocates properly
         
@@ -95,6 +263,8 @@ namespace Sag {
     }
     
     void SagReader::closeFile() {
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        multiReader.close();
         if (fp) {
             fp->close();
             delete fp;
@@ -103,10 +273,104 @@ namespace Sag {
     }
 
     void SagReader::getMeta(vector<string> datafileFieldNames) {
-        char line[1000];
-        int snapnum;
-        float redshift;
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        // Find the output groups in the file. Some SAG variants store 
+        // several snapshots in one file, as groups Output* with their own
+        // Redshift and Snapshot attributes; otherwise all datasets are at
+        // the root level and the attributes belong to the root group.
+        hid_t grp;
+        hsize_t nobj;
+        char memb_name[1024];
+        int otype;
+
+        fieldNames = datafileFieldNames;
+
+        outputs.clear();
+        grp = H5Gopen(fp->getId(), "/", H5P_DEFAULT);
+        H5Gget_num_objs(grp, &nobj);
+        for (hsize_t i=0; i<nobj; i++) {
+            H5Gget_objname_by_idx(grp, i, memb_name, (size_t) 1024);
+            otype = H5Gget_objtype_by_idx(grp, (size_t) i);
+            if (otype == H5G_GROUP && string(memb_name).compare(0, 6, "Output") == 0) {
+                OutputMeta o;
+                o.outputName = string("/") + memb_name;
+                readOutputAttributes(o);
+                o.ioutput = outputs.size();
+                outputs.push_back(o);
+            }
+        }
+        H5Gclose(grp);
+
+        if (outputs.size() == 0) {
+            // just one snapshot, at root level
+            OutputMeta o;
+            o.outputName = "";
+            readOutputAttributes(o);
+            outputs.push_back(o);
+        } else {
+            cout << "Found " << outputs.size() << " output groups in the file." << endl;
+        }
+
+        setUserSnapnums(user_snapnums);
+
+        return;
+    }
+
+    void SagReader::readOutputAttributes(OutputMeta &o) {
+        // get the constant attributes (redshift, snapshot number) for an output group
+        string groupName = (o.outputName == "") ? string("/") : o.outputName;
+        Group group(fp->openGroup(groupName));
+
+        if (H5Aexists(group.getId(), "Redshift") > 0) {
+            Attribute att = group.openAttribute("Redshift");
+            att.read(PredType::NATIVE_FLOAT, &o.redshift);
+        } else {
+            cout << "ERROR: No Redshift attribute found for group " << groupName << endl;
+            abort();
+        }
+
+        if (H5Aexists(group.getId(), "Snapshot") > 0) {
+            Attribute att2 = group.openAttribute("Snapshot");
+            att2.read(PredType::NATIVE_INT, &o.snapnum);
+        } else if (o.outputName != "") {
+            // use the number in the group name instead, e.g. Output125
+            o.snapnum = atoi(o.outputName.substr(7).c_str());
+        } else {
+            cout << "ERROR: No Snapshot attribute found for group " << groupName << endl;
+            abort();
+        }
+        o.outputExpansionFactor = 1./(1. + o.redshift);
+
+        // should close the group now
+        group.close();
+    }
+
+    void SagReader::setUserSnapnums(vector<int> newSnapnums) {
+        // restrict ingest to the given snapshot numbers (all, if empty)
+        // and start with the first selected output
+        user_snapnums = newSnapnums;
+
+        selectedOutputs.clear();
+        for (int i=0; i<outputs.size(); i++) {
+            if (user_snapnums.size() == 0 || find(user_snapnums.begin(), user_snapnums.end(), outputs[i].snapnum) != user_snapnums.end()) {
+                selectedOutputs.push_back(i);
+            }
+        }
+        numOutputs = selectedOutputs.size();
+        cout << "Number of outputs to be ingested: " << numOutputs << endl;
+
+        if (numOutputs == 0) {
+            cout << "ERROR: None of the requested snapshots found in file." << endl;
+            exit(1);
+        }
+
+        selectOutput(0);
+    }
 
+    void SagReader::selectOutput(long newIoutput) {
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        // switch to the given (selected) output: find its datasets, set
+        // snapnum and redshift and start again at its first row
         string s;
         string dsname;
         string matchname;
@@ -116,29 +380,49 @@ namespace Sag {
 
         vector<string> dataSetNames_all;
 
+        ioutput = newIoutput;
+        OutputMeta &o = outputs[selectedOutputs[ioutput]];
+        TraceSpan span("scan_output", "meta", o.outputName);
+        multiReader.close();
+        broadcastVersion++;
+        outputName = o.outputName;
+
         cout << "Finding dataset names in the file ... " << endl;
-        Group group(fp->openGroup("/"));
-        grp = H5Gopen(group.getId(),"/", H5P_DEFAULT);
+        Group group(fp->openGroup((outputName == "") ? string("/") : outputName));
+        grp = H5Gopen(group.getId(), ".", H5P_DEFAULT);
 
         dataSetNames_all.clear();
         scan_group(grp, &dataSetNames_all);
+        H5Gclose(grp);
 
         numDataSets = dataSetNames_all.size();
         cout << "Total number of dataSets: " << numDataSets << endl;
-
-        // filter out what we actually need/don't need using data read from mapping file
+        // filter out what we actually need/don't need using data read from mapping file;
+        // names like /Pos[1] refer to one column of a 2-dimensional dataset,
+        // each dataset is read only once per block, with all its columns
         dataSetNames.clear();
+        dataSetColumns.clear();
+        dataSetComps.clear();
         for (int k=0; k<numDataSets; k++) {
-            dsname = dataSetNames_all[k];
-            
-            for (int j=0; j<datafileFieldNames.size(); j++) {
-                if (dsname == datafileFieldNames[j]) {
+            // names in the mapping file are relative to the output group
+            dsname = dataSetNames_all[k].substr(outputName.size());
+            vector<string> columns;
+            vector<int> comps;
+
+            for (int j=0; j<fieldNames.size(); j++) {
+                int comp;
+                if (parseColumnName(fieldNames[j], matchname, comp) && dsname == matchname) {
                     // found it! 
-                    dataSetNames.push_back(dsname);
-                    break;
+                    columns.push_back(fieldNames[j]);
+                    comps.push_back(comp);
                 }
             }
 
+            if (columns.size() > 0) {
+                dataSetNames.push_back(dataSetNames_all[k]);
+                dataSetColumns.push_back(columns);
+                dataSetComps.push_back(comps);
+            }
         }
         numDataSets = dataSetNames.size();
         cout << "Desired number of dataSets: " << numDataSets << endl;
@@ -148,33 +432,64 @@ namespace Sag {
             exit(1);
         }
 
-        // create a key-value map for the dataset names, do it once for each file
+        // create a key-value map for the column names, do it once for each file;
+        // the values are the indices of the datablocks, which are filled
+        // in the same order as here (datasets, then columns per dataset)
         // TODO: should actually check here already, if the dataSet-types match
         //      the expectations from the mapping file;
         //      Exit, if types do not match
 
         herr_t status;
         dataSetMap.clear();
+        itemSources.clear();
 
         for (int k=0; k<numDataSets; k++) {
-            dsname = dataSetNames[k];
-            dataSetMap[dsname] = k;
+            for (int c=0; c<dataSetColumns[k].size(); c++) {
+                int idx = dataSetMap.size();
+                dataSetMap[dataSetColumns[k][c]] = idx;
+            }
         }
 
-        // get the constant attributes for the main group
-        Attribute att = group.openAttribute("Redshift");
-        DataType type = att.getDataType();
-        att.read(type, &redshift);
-        cout << "redshift: " << redshift << endl;
+        // rows of the virtual datasets come from several files
+        virtualSources = getVirtualSources(fp->getId(), outputName, dataSetNames[0]);
+        virtualSource = -1;
+        sourceFirstRow = 0;
+        fileNum = baseFileNum;
+        if (virtualSources.size() > 0) {
+            cout << "Virtual datasets with " << virtualSources.size() << " source files" << endl;
+        }
+
+        // positions of the datasets in the file, for ordering the reads
+        if (ioOrder) {
+            scheduler.scan(fp, dataSetNames);
+        }
+
+        // keep the datasets open for reading all blocks of this output
+        if (multiRead) {
+            openMultiReader();
+        }
 
-        Attribute att2 = group.openAttribute("Snapshot");
-        DataType type2 = att2.getDataType();
-        att2.read(type2, &snapnum);
-        cout << "snapnum: " << snapnum << endl;
-        
         // store in global variables:
-        current_snapnum = snapnum;
-        current_redshift = redshift;
+        current_snapnum = o.snapnum;
+        current_redshift = o.redshift;
+        scale = o.outputExpansionFactor;
+        cout << "output: " << ((outputName == "") ? string("/") : outputName) << endl;
+        cout << "redshift: " << current_redshift << endl;
+        cout << "snapnum: " << current_snapnum << endl;
+
+        // start at the beginning of this output
+        currRow = 0;
+        rowLimit = -1;
+        countInBlock = 0;
+        nInBlock = 0;
+        clearDataBlocks();
+        if (sorter) {
+            delete sorter;
+            sorter = NULL;
+            if (memory) {
+                memory->release(MemoryBudget::SORT_BUFFERS, sortMemory);
+            }
+        }
 
         // should close the group now
         group.close();
@@ -182,11 +497,16 @@ namespace Sag {
         return;
     }
 
+    int SagReader::getSnapnum(long ioutput) {
+        return outputs[selectedOutputs[ioutput]].snapnum;
+    }
+
     void filter_dataSetNames() {
 
     }
 
     long SagReader::getNumRowsInDataSet(string s) {
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
         // get number of rows (data entries) in given dataset
         // just check with the one given dataset and assume that all datasets
         // have the same size!
@@ -222,18 +542,21 @@ namespace Sag {
 
         // get one line from already read datasets (using readNextBlock)
         // use readNextBlock to read the next blocks from datasets, if necessary
-        // readNextblock returns blocksize = number of read values; this 
-        // may be adjusted at the end of the file, new value is then returned
-        // and can beused to check here, when we reach the end of the file
-        if (currRow == 0) {
-            // we are at the very beginning
-            // read block, initialize counter
-            blocksize = readNextBlock(blocksize);
-            //cout << "nvalues in getNextRow: " << nvalues << endl;
-            countInBlock = 0;
-        } else if (countInBlock == blocksize-1) {
-            // end of block reached, read the next block
-            blocksize = readNextBlock(blocksize);
+        // readNextblock returns the number of read values; this 
+        // may be smaller at the end of the output, it is 0 when we reach
+        // the end of the output; then continue with the next output group
+        if (currRow == 0 || nInBlock <= 0 || countInBlock == nInBlock-1) {
+            // we are at the very beginning or at the end of the block,
+            // read the next block, initialize counter
+            if (countWritten && metrics && currRow > 0 && nInBlock > 0) {
+                // all rows of the last block were handed to the database
+                metrics->addBatchWritten(nInBlock, (boost::posix_time::microsec_clock::universal_time()-lastBlockEnd).total_microseconds());
+            }
+            nInBlock = readNextBlock(blocksize);
+            while (nInBlock <= 0 && ioutput < numOutputs-1 && rowLimit < 0) {
+                selectOutput(ioutput+1);
+                nInBlock = readNextBlock(blocksize);
+            }
             //cout << "nvalues in getNextRow: " << nvalues << endl;
             countInBlock = 0;
         } else {
@@ -241,7 +564,7 @@ namespace Sag {
             countInBlock++;
         }
 
-        if (blocksize <= 0) {
+        if (nInBlock <= 0) {
             return 0;
         }
 
@@ -259,6 +582,24 @@ namespace Sag {
     }
 
     int SagReader::readNextBlock(long blocksize) {
+        // the rows of the last block are consumed now (including waiting
+        // for the lock, i.e. for the other readers)
+        boost::posix_time::ptime requestTime = boost::posix_time::microsec_clock::universal_time();
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        if (Tracer::isEnabled()) {
+            if (numBlocksRead > 0) {
+                Tracer::add("consume_block", "ingest", "", lastBlockEnd, requestTime);
+            }
+            Tracer::add("h5_lock", "read", "", requestTime, boost::posix_time::microsec_clock::universal_time());
+        }
+
+        if (blockSizer) {
+            if (lastBlockRows > 0) {
+                blockSizer->addBlock(lastBlockRows, lastReadMicroseconds, (requestTime-lastBlockEnd).total_microseconds());
+                lastBlockRows = 0;
+            }
+            blocksize = blockSizer->getBlockRows();
+        }
         //cout << "read next block: with numDataSets: " << numDataSets << endl;
 
         // read one block from SAG HDF5-file, max. blocksize values
@@ -267,35 +608,23 @@ namespace Sag {
         //performance output stuff
         boost::posix_time::ptime startTime;
         boost::posix_time::ptime endTime;
-        
-        string s;
-        string dsname;
-
-        IntType intype;
-        FloatType ftype;
-        size_t dsize; 
-        
-        herr_t status;
-        hsize_t count[2];       // size of the hyperslab in the file (number of blocks)
-        hsize_t offset[2];      // hyperslab offset in the file
-        hsize_t nblock[2];      // block size to be read
 
         // clear datablocks from previous block, before reading new ones:
-        datablocks.clear();
+        clearDataBlocks();
 
-        nvalues = getNumRowsInDataSet(dataSetNames[0]); // could do this already outside of this function!
+        if (multiReader.isOpen()) {
+            nvalues = multiReader.get(0).dims[0];
+        } else {
+            nvalues = getNumRowsInDataSet(dataSetNames[0]); // could do this already outside of this function!
+        }
 
         // make sure that we are not exceeding the max. number 
-        // of values in this dataset:
+        // of values in this dataset (or in the selected range of rows):
+        if (rowLimit >= 0) {
+            nvalues = min(nvalues, rowLimit);
+        }
         blocksize = min(blocksize, nvalues-currRow);
 
-        offset[0] = currRow;
-        offset[1] = 0; // we actually only have one dimension > 1 for SAG data
-
-        nblock[0] = blocksize;
-        nblock[1] = 1;
-
-        
         //cout << "nvalues, currRow, blocksize: " << nvalues << ", " << currRow << ", " << blocksize << endl;
         if (currRow >= nvalues) {
             // already reached end of file, no more data available
@@ -303,61 +632,212 @@ namespace Sag {
             return 0;
         }
 
+        if (virtualSources.size() > 0 && sortKey == "") {
+            // blocks do not cross files, so that fileNum is the same for all rows
+            blocksize = selectVirtualSource(currRow, blocksize);
+        }
+
         startTime = boost::posix_time::microsec_clock::universal_time();
 
-        // read each desired data set, use corresponding read routine for different types
-        for (int k=0; k<numDataSets; k++) {
+        if (sortKey != "") {
+            // sort all rows of the file first, then serve them block by block
+            if (!sorter) {
+                sortRows();
+            }
+            long allocRows = fitBlockRows(blocksize);
+            blocksize = readSortedBlock(allocRows);
+            countDataBlocks(allocRows);
+        } else {
+            blocksize = fitBlockRows(blocksize);
+            readDataSetBlocks(currRow, blocksize);
+            reducePrecision(blocksize);
+            countDataBlocks(blocksize);
+        }
+        markBlockNulls(blocksize);
 
-            dsname = dataSetNames[k];
-            //s = string("/") + dsname;
-            s = dsname;
-            //cout << "s-name: " << s << endl;
-            DataSet *dptr = new DataSet(fp->openDataSet(s));
-            DataSet dataset = *dptr; // for convenience
-
-            // check class type
-            H5T_class_t type_class = dataset.getTypeClass();
-            //cout << "type_class " << type_class << endl;
-
-            if (type_class == H5T_INTEGER) {
-                // check exactly, if int or long int
-                intype = dataset.getIntType();
-                dsize = intype.getSize();
-                if (sizeof(long) == dsize) {
-                    //cout << "DataSet has long type!" << endl;
-                    //long *data = readLongDataSet(s, nvalues);  
-                    long *data = readLongDataSet(s, nvalues, nblock, offset);
-                } else if (sizeof(int) == dsize) {
-                    //cout << "DataSet has int type!" << endl;
-                     //int *data2 = readIntDataSet(s, nvalues);
-                    cout << "ERROR: Reading datasets of int type not implemented yet!" << endl;
-                    abort();
-                } else if (sizeof(int8_t) == dsize) {
-                    //cout << "DataSet has tinyint type! (8 bits)" << endl;
-                    int8_t *data3 = readTinyIntDataSet(s, nvalues, nblock, offset);
-                } else {
-                    cout << "ERROR: Do not know how to deal with int-type of size " << dsize << endl;
-                    abort();
-                }
-            } else if (type_class == H5T_FLOAT) {
-                // check exactly, if float or double
-                ftype = dataset.getFloatType();
-                dsize = ftype.getSize();
-                if (sizeof(double) == dsize) {
-                    //cout << "DataSet has double type!" << endl;
-                    double *data4 = readDoubleDataSet(s, nvalues, nblock, offset);
-                } else if (sizeof(float) == dsize) {
-                    //cout << "DataSet has float type!" << endl;
-                    float *data5 = readFloatDataSet(s, nvalues, nblock, offset);
-                } else {
-                    cout << "ERROR: Do not know how to deal with float-type of size " << dsize << endl;
-                    abort();
+        endTime = boost::posix_time::microsec_clock::universal_time();
+        readMicroseconds += (endTime-startTime).total_microseconds();
+        numBlocksRead++;
+        lastBlockRows = blocksize;
+        lastReadMicroseconds = (endTime-startTime).total_microseconds();
+        lastBlockEnd = endTime;
+        Tracer::add("read_block", "read", fileName, startTime, endTime);
+
+        if (metrics && blocksize > 0) {
+            long bytes = 0;
+            for (int k=0; k<datablocks.size(); k++) {
+                bytes += blocksize * datablocks[k].getElemSize();
+            }
+            string currentFile = (virtualSource >= 0) ? virtualSources[virtualSource].fileName : fileName;
+            metrics->addBlock(currentFile, blocksize, bytes, lastReadMicroseconds);
+        }
+        if ((zoneMap || checksums) && blocksize > 0) {
+            writeBlockStats(blocksize);
+        }
+        if (hashContent && blocksize > 0) {
+            hashBlock(blocksize);
+        }
+        //printf("Time for reading (%ld rows): %lld ms\n", blocksize, (long long int) (endTime-startTime).total_milliseconds());
+        fflush(stdout);
+            
+        return blocksize; // number of read values
+    }
+
+    void SagReader::writeBlockStats(long nrows) {
+        // min, max, NaN count, sum (and histogram) of each column of the
+        // block just read, in database units
+        TraceSpan span("block_stats", "transform");
+        BlockStats block;
+
+        block.fileNum = fileNum;
+        block.snapnum = current_snapnum;
+
+        if (!sorter) {
+            block.firstRow = currRow - sourceFirstRow + 1;   // NInFile of the first row
+            block.lastRow = currRow - sourceFirstRow + nrows;
+            block.nrows = nrows;
+            computeBlockStats(block, NULL, nrows);
+            addBlockStats(block);
+            return;
+        }
+
+        // sorted rows: the NInFile range of the block is the range of its
+        // original rows; rows of a virtual dataset may come from several
+        // files, one entry per file then
+        map<int, vector<long> > sourceRows;
+        map<int, long> firstRows;
+        map<int, long> lastRows;
+        for (long i=0; i<nrows; i++) {
+            int rowFileNum;
+            long rowInFile;
+            getRowSource(blockRows[i], rowFileNum, rowInFile);
+            if (sourceRows.find(rowFileNum) == sourceRows.end()) {
+                firstRows[rowFileNum] = rowInFile + 1;
+                lastRows[rowFileNum] = rowInFile + 1;
+            }
+            sourceRows[rowFileNum].push_back(i);
+            firstRows[rowFileNum] = min(firstRows[rowFileNum], rowInFile + 1);
+            lastRows[rowFileNum] = max(lastRows[rowFileNum], rowInFile + 1);
+        }
+        for (map<int, vector<long> >::iterator it=sourceRows.begin(); it!=sourceRows.end(); ++it) {
+            block.fileNum = it->first;
+            block.firstRow = firstRows[it->first];
+            block.lastRow = lastRows[it->first];
+            block.nrows = it->second.size();
+            // all rows of the block: no need to pick them
+            computeBlockStats(block, (sourceRows.size() > 1) ? &it->second : NULL, nrows);
+            addBlockStats(block);
+        }
+    }
+
+    void SagReader::computeBlockStats(BlockStats &block, const vector<long> *rows, long nrows) {
+        // statistics of the given rows of the block (all nrows rows, if
+        // rows is NULL), without the NULL values
+        int numBins = zoneMap ? zoneMap->getNumBins() : 0;
+
+        block.columns.clear();
+        block.columns.resize(datablocks.size());
+        for (int k=0; k<datablocks.size(); k++) {
+            DataBlock &b = datablocks[k];
+            double factor = (b.name == "/X" || b.name == "/Y" || b.name == "/Z") ? posfactor : 1;
+            long total = rows ? rows->size() : nrows;
+            block.columns[k].name = b.name;
+            if (rows) {
+                // copy the values of the rows which are not NULL
+                size_t elemsize = b.getElemSize();
+                vector<char> values(total * elemsize);
+                long n = 0;
+                for (long i=0; i<total; i++) {
+                    long row = (*rows)[i];
+                    if (!validity[k].isNull(row)) {
+                        memcpy(&values[n * elemsize], b.getValuePtr(row), elemsize);
+                        n++;
+                    }
                 }
+                computeColumnStats(b.type, n > 0 ? &values[0] : NULL, n, factor, numBins, block.columns[k]);
+                block.columns[k].nrows = total;
+                block.columns[k].nulls += total - n;
+            } else if (validity[k].numNulls > 0) {
+                // statistics of the values which are not NULL
+                vector<char> values;
+                long n = compactValid(b.type, b.getValuePtr(0), nrows, validity[k], values);
+                computeColumnStats(b.type, n > 0 ? &values[0] : NULL, n, factor, numBins, block.columns[k]);
+                block.columns[k].nrows = nrows;
+                block.columns[k].nulls += nrows - n;
             } else {
-                cout << "ERROR: Reading datasets of type " << type_class << " not implemented yet!" << endl;
-                abort();
+                computeColumnStats(b.type, b.getValuePtr(0), nrows, factor, numBins, block.columns[k]);
+            }
+        }
+    }
+
+    void SagReader::addBlockStats(const BlockStats &block) {
+        if (zoneMap) {
+            zoneMap->write(block);
+        }
+        if (checksums) {
+            checksums->add(block);
+        }
+    }
+
+    void SagReader::readDataSetBlocks(long newOffset, long nrows) {
+        // read nrows values, starting at row newOffset, from each desired
+        // data set into datablocks
+        hsize_t offset[2];      // hyperslab offset in the file
+        hsize_t nblock[2];      // block size to be read
+
+        offset[0] = newOffset;
+        offset[1] = 0; // we actually only have one dimension > 1 for SAG data
+
+        nblock[0] = nrows;
+        nblock[1] = 1;
+
+        // read the datasets in the order of their data in the file, datasets
+        // lying next to each other are read together (see ReadScheduler)
+        vector< vector<int> > groups;
+        if (ioOrder) {
+            groups = scheduler.getReadGroups(newOffset, nrows);
+        } else {
+            for (int k=0; k<numDataSets; k++) {
+                groups.push_back(vector<int>(1, k));
+            }
+        }
+
+        if (multiRead) {
+            readDataSetsMulti(groups, newOffset, nrows);
+            return;
+        }
+
+        vector<size_t> firstBlock(numDataSets);
+        vector<char> groupBuffer;
+        vector<size_t> groupOffsets;
+
+        // read each desired data set, use corresponding read routine for different types
+        for (int g=0; g<groups.size(); g++) {
+            bool merged = (groups[g].size() > 1 && scheduler.readGroup(groups[g], newOffset, nrows, groupBuffer, groupOffsets));
+            if (merged) {
+                addReadBuffer(groupBuffer.size());
+            }
+            for (int i=0; i<groups[g].size(); i++) {
+                int k = groups[g][i];
+                prefetched = merged ? &groupBuffer[groupOffsets[i]] : NULL;
+                firstBlock[k] = datablocks.size();
+                readDataSet(k, nblock, offset);
+            }
+            if (merged) {
+                releaseReadBuffer(groupBuffer.size());
+            }
+        }
+        prefetched = NULL;
+
+        // datablocks must be in the order of dataSetMap (datasets, then columns)
+        if (ioOrder) {
+            vector<DataBlock> ordered;
+            for (int k=0; k<numDataSets; k++) {
+                for (int c=0; c<dataSetColumns[k].size(); c++) {
+                    ordered.push_back(datablocks[firstBlock[k] + c]);
+                }
             }
-            //cout << nvalues << " values read." << endl;
+            datablocks.swap(ordered);
         }
 
         // How to proceed from here onwards??
@@ -371,12 +851,261 @@ namespace Sag {
         // use vector<newclass> to create a vector of these datasets.
         // maybe can use datasets themselves, so no need to define own class?
         // => assigning to the new class has already happened now inside the read-class.
+    }
 
-        endTime = boost::posix_time::microsec_clock::universal_time();
-        //printf("Time for reading (%ld rows): %lld ms\n", blocksize, (long long int) (endTime-startTime).total_milliseconds());
-        fflush(stdout);
-            
-        return blocksize; // number of read values
+    void SagReader::readDataSetsMulti(const vector< vector<int> > &groups, long newOffset, long nrows) {
+        // read the block of all datasets on the handles kept open by the
+        // MultiReader: merged groups and direct chunk reads are served
+        // first, all remaining datasets are then read with one call
+        vector<DataBlock> firsts(numDataSets);
+        vector<char*> rdatas(numDataSets);
+        vector<bool> direct(numDataSets);
+        vector<char> groupBuffer;
+        vector<size_t> groupOffsets;
+
+        for (int g=0; g<groups.size(); g++) {
+            bool merged = (groups[g].size() > 1 && scheduler.readGroup(groups[g], newOffset, nrows, groupBuffer, groupOffsets));
+            if (merged) {
+                addReadBuffer(groupBuffer.size());
+            }
+            for (int i=0; i<groups[g].size(); i++) {
+                int k = groups[g][i];
+                MultiDataSet &d = multiReader.get(k);
+
+                // a single column is read directly into its datablock
+                direct[k] = (d.ncomps == 1 && dataSetComps[k].size() == 1);
+                firsts[k].type = d.type;
+                if (direct[k]) {
+                    firsts[k].allocData(nrows);
+                    rdatas[k] = firsts[k].getValuePtr(0);
+                } else {
+                    rdatas[k] = new char[nrows * d.ncomps * d.elemsize];
+                    addReadBuffer(nrows * d.ncomps * d.elemsize);
+                }
+
+                if (merged) {
+                    copyPrefetched(&groupBuffer[groupOffsets[i]], d.dims[1], nrows, d.firstComp, d.ncomps, d.elemsize, rdatas[k]);
+                } else if (!chunkReader || !chunkReader->read(d.name, d.dset, d.memType, newOffset, nrows, d.firstComp, d.ncomps, rdatas[k])) {
+                    multiReader.add(k, newOffset, nrows, rdatas[k]);
+                }
+            }
+            if (merged) {
+                releaseReadBuffer(groupBuffer.size());
+            }
+        }
+
+        multiReader.read();
+
+        // datablocks in the order of dataSetMap (datasets, then columns)
+        for (int k=0; k<numDataSets; k++) {
+            MultiDataSet &d = multiReader.get(k);
+            nvalues = d.dims[0];
+            addColumnBlocks(k, firsts[k], rdatas[k], direct[k], nrows, nvalues, d.firstComp, d.ncomps, d.elemsize);
+            if (!direct[k]) {
+                delete[] rdatas[k];
+                releaseReadBuffer(nrows * d.ncomps * d.elemsize);
+            }
+        }
+    }
+
+    void SagReader::readDataSet(int k, hsize_t *nblock, hsize_t *offset) {
+        // read the block of one dataset with the routine for its type
+        string s;
+        string dsname;
+
+        IntType intype;
+        FloatType ftype;
+        size_t dsize;
+
+        dsname = dataSetNames[k];
+        TraceSpan span("read_dataset", "read", dsname);
+        //s = string("/") + dsname;
+        s = dsname;
+        //cout << "s-name: " << s << endl;
+        DataSet *dptr = new DataSet(fp->openDataSet(s));
+        DataSet dataset = *dptr; // for convenience
+
+        // check class type
+        H5T_class_t type_class = dataset.getTypeClass();
+        //cout << "type_class " << type_class << endl;
+
+        if (type_class == H5T_INTEGER) {
+            // check exactly, if int or long int
+            intype = dataset.getIntType();
+            dsize = intype.getSize();
+            if (sizeof(long) == dsize) {
+                //cout << "DataSet has long type!" << endl;
+                //long *data = readLongDataSet(s, nvalues);  
+                long *data = readLongDataSet(s, nvalues, nblock, offset);
+            } else if (sizeof(int) == dsize) {
+                //cout << "DataSet has int type!" << endl;
+                 //int *data2 = readIntDataSet(s, nvalues);
+                cout << "ERROR: Reading datasets of int type not implemented yet!" << endl;
+                abort();
+            } else if (sizeof(int8_t) == dsize) {
+                //cout << "DataSet has tinyint type! (8 bits)" << endl;
+                int8_t *data3 = readTinyIntDataSet(s, nvalues, nblock, offset);
+            } else {
+                cout << "ERROR: Do not know how to deal with int-type of size " << dsize << endl;
+                abort();
+            }
+        } else if (type_class == H5T_FLOAT) {
+            // check exactly, if float or double
+            ftype = dataset.getFloatType();
+            dsize = ftype.getSize();
+            if (sizeof(double) == dsize) {
+                //cout << "DataSet has double type!" << endl;
+                double *data4 = readDoubleDataSet(s, nvalues, nblock, offset);
+            } else if (sizeof(float) == dsize) {
+                //cout << "DataSet has float type!" << endl;
+                float *data5 = readFloatDataSet(s, nvalues, nblock, offset);
+            } else {
+                cout << "ERROR: Do not know how to deal with float-type of size " << dsize << endl;
+                abort();
+            }
+        } else {
+            cout << "ERROR: Reading datasets of type " << type_class << " not implemented yet!" << endl;
+            abort();
+        }
+        //cout << nvalues << " values read." << endl;
+        delete dptr;
+    }
+
+    uint64_t SagReader::getRowPHKey(long i) {
+        // Peano-Hilbert key from the positions of row i of the current
+        // datablocks, in the same units as they are written to the
+        // database (i.e. after using posfactor)
+        map<string,int>::iterator it;
+        double x[3];
+        uint32_t ipos[3];
+        double cells;
+        const char *posNames[3] = {"/X", "/Y", "/Z"};
+
+        cells = (double) (1L << phBits);
+        for (int d=0; d<3; d++) {
+            it = dataSetMap.find(posNames[d]);
+            DataBlock &b = datablocks[it->second];
+            x[d] = (b.floatval) ? b.floatval[i] : b.doubleval[i];
+            x[d] = x[d] * posfactor / boxSize * cells;
+            x[d] = max(0., min(x[d], cells - 1.)); // periodic boxes can have x == boxSize
+            ipos[d] = (uint32_t) x[d];
+        }
+        return peanoHilbertKey(ipos[0], ipos[1], ipos[2], phBits);
+    }
+
+    uint64_t SagReader::getRowSortKey(long i) {
+        // get the sort key for row i of the current datablocks
+        map<string,int>::iterator it;
+        DataBlock b;
+
+        if (sortKey == "phkey") {
+            return getRowPHKey(i);
+        }
+
+        it = dataSetMap.find(sortKey);
+        b = datablocks[it->second];
+        if (b.longval) {
+            return sortableKey(b.longval[i]);
+        } else if (b.tinyintval) {
+            return sortableKey((long) b.tinyintval[i]);
+        } else if (b.doubleval) {
+            return sortableKey(b.doubleval[i]);
+        } else {
+            return sortableKey((double) b.floatval[i]);
+        }
+    }
+
+    void SagReader::sortRows() {
+        // Read all rows of the file block by block and pass them to the
+        // RowSorter, together with their sort key. The RowSorter keeps them
+        // in memory, if possible, and writes sorted runs to disk otherwise.
+        long offset;
+        long nrows;
+        size_t payloadSize;
+        vector<char> payload;
+        char *p;
+
+        cout << "Sorting rows by " << sortKey << " ..." << endl;
+        TraceSpan span("sort_rows", "transform", fileName);
+
+        offset = 0;
+        while (offset < nvalues) {
+            nrows = fitBlockRows(min(blocksize, nvalues - offset));
+
+            clearDataBlocks();
+            readDataSetBlocks(offset, nrows);
+            reducePrecision(nrows);
+            countDataBlocks(nrows);
+
+            if (!sorter) {
+                // remember the layout of the datablocks, so that we can
+                // recreate it when serving the sorted rows
+                payloadSize = 0;
+                sortedLayout.clear();
+                for (int k=0; k<datablocks.size(); k++) {
+                    payloadSize += datablocks[k].getElemSize();
+                    DataBlock b;
+                    b.name = datablocks[k].name;
+                    b.type = datablocks[k].type;
+                    sortedLayout.push_back(b);
+                }
+                payload.resize(payloadSize);
+                sorter = new RowSorter(payloadSize, sortMemory, sortTmpDir);
+                if (memory) {
+                    memory->add(MemoryBudget::SORT_BUFFERS, sortMemory);
+                }
+            }
+
+            for (long i=0; i<nrows; i++) {
+                p = &payload[0];
+                for (int k=0; k<datablocks.size(); k++) {
+                    memcpy(p, datablocks[k].getValuePtr(i), datablocks[k].getElemSize());
+                    p += datablocks[k].getElemSize();
+                }
+                sorter->addRow(getRowSortKey(i), offset + i, &payload[0]);
+            }
+
+            // the values are copied to the sorter now
+            clearDataBlocks();
+
+            offset += nrows;
+        }
+
+        sorter->finish();
+        cout << "Sorted " << sorter->getNumRows() << " rows (" << sorter->getNumRuns() << " runs on disk)." << endl;
+    }
+
+    long SagReader::readSortedBlock(long nrows) {
+        // fill datablocks with the next nrows sorted rows
+        vector<char> payload;
+        uint64_t key;
+        long row;
+        long n;
+        char *p;
+
+        datablocks = sortedLayout;
+        payload.resize(0);
+        for (int k=0; k<datablocks.size(); k++) {
+            datablocks[k].allocData(nrows);
+            payload.resize(payload.size() + datablocks[k].getElemSize());
+        }
+        blockRows.resize(nrows);
+        blockKeys.resize(nrows);
+
+        for (n=0; n<nrows; n++) {
+            if (!sorter->nextRow(key, row, &payload[0])) {
+                break;
+            }
+            p = &payload[0];
+            for (int k=0; k<datablocks.size(); k++) {
+                memcpy(datablocks[k].getValuePtr(n), p, datablocks[k].getElemSize());
+                p += datablocks[k].getElemSize();
+            }
+            blockRows[n] = row;
+            blockKeys[n] = key;
+        }
+
+        return n;
     }
 
 
@@ -384,9 +1113,6 @@ namespace Sag {
         // read a long-type dataset
 
         //cout << "Reading DataSet '" << s << "'" << endl;
-        hsize_t count[2];   // size of the hyperslab in the file
-        hsize_t stride[2];  // should be 1,1
-        hsize_t block[2];   // block size, should use nblock-values
 
         // DataSet dataset = fp->openDataSet(s);
         // rather need pointer to dataset in order to delete it later on:
@@ -411,99 +1137,16 @@ namespace Sag {
             abort();
         }
 
-        size_t dsize = intype.getSize();
-        //cout << "Data size is " << dsize << endl;
+        long *buffer = (long*) readHyperslab(dataset, s, PredType::NATIVE_LONG, sizeof(long), "long", nvalues, nblock, offset);
 
-        // get dataspace of the dataset
-        DataSpace dataspace = dataset.getSpace();
-        //cout << "Dataspace is " << dataspace << endl;
+        dataset.close();
+        delete dptr;
 
-        // get number of dimensions in dataspace
-        int rank = dataspace.getSimpleExtentNdims();
-        //cout << "Dataspace rank is " << rank << endl;
-
-        // I expect this to be 2 for all SAG datasets!
-        // There are no more-dimensional arrays stored in one dataset, are there?
-        if (rank == 1) {
-            hsize_t dims_out[1];
-            int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
-            //cout << "dimension " << (unsigned long)(dims_out[0]) << endl;
-            nvalues = dims_out[0];
-        } else if (rank == 2) {
-            hsize_t dims_out[2];
-            int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
-            if (dims_out[rank-1] == 1) {
-                //cout << "rank " << rank << ", dimensions " <<
-                //    (unsigned long)(dims_out[0]) << " x " <<
-                //    (unsigned long)(dims_out[1]) << endl;
-                nvalues = dims_out[0];
-            } else {
-                cout << "ERROR: Cannot cope with this dataset, dimensions too high:" << 
-                    (unsigned long)(dims_out[0]) << " x " <<
-                    (unsigned long)(dims_out[1]) << endl;
-                abort();
-            }
-        } else {
-            cout << "ERROR: Cannot cope with multi-dimensional datasets! rank: " << rank << endl;
-            abort();
-        }
-
-        // define hyperslab
-        // offset already provided when calling this function, no need to redefine here
-        count[0]  = 1;  // just use 1 block, so count = 1
-        count[1]  = 1;
-
-        stride[0] = 1;
-        stride[1] = 1;
-        
-        block[0] = nblock[0]; // use block instead of count, might be faster
-        block[1] = 1;
-
-        hsize_t dimsm[2]; // memory space dimensions, must be the same as hyperslab-size
-        dimsm[0] = nblock[0];
-        dimsm[1] = 1;
-
-        // define memory space
-        DataSpace memspace(rank, dimsm, NULL);
-
-        // selec the hyperslap from the dataspace
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block); 
-        //dataspace.selectHyperslab( H5S_SELECT_SET, count, offset ); 
-        
-        // read data from selection
-        long rdata[nblock[0]][1]; // read requirer buffer to have same dimensions as dataset
-        dataset.read(rdata,PredType::NATIVE_LONG, memspace, dataspace);
-        
-        // copy over to an array with 1 dim. only, for convenience
-        long *buffer = new long[nblock[0]]; // = same as malloc
-        memcpy(buffer, &rdata[0][0], nblock[0]*sizeof(long));
-        // only works, because buffer[i] = rdata[i][0]
-
-        // the data is stored in buffer now, so we can delete the dataset etc.;
-        // to do this, call delete on the pointer to the dataset
-        dataspace.close();
-        memspace.close();
-        dataset.close();
-        // delete dataset is not necessary, if it is a variable on the heap.
-        // Then it is removed automatically when the function ends.
-        delete dptr;
-
-        DataBlock b;
-        b.nvalues = nvalues;
-        b.longval = buffer;
-        b.name = s;
-        datablocks.push_back(b);
-        // block b with the data is added to datablocks-vector now
-
-        return buffer;
-    }
+        return buffer;
+    }
 
     int8_t * SagReader::readTinyIntDataSet(const std::string s, long &nvalues, hsize_t *nblock, hsize_t *offset) {
         // read a tinyInt-dataset; use int8_t for C++ equivalent
- 
-        hsize_t count[2];   // size of the hyperslab in the file
-        hsize_t stride[2];  // should be 1,1
-        hsize_t block[2];   // block size, should use nblock-values
 
         // DataSet dataset = fp->openDataSet(s);
         // rather need pointer to dataset in order to delete it later on:
@@ -530,99 +1173,18 @@ namespace Sag {
         }
         //cout << "Data size is " << dsize << endl;
 
-        // get dataspace of the dataset
-        DataSpace dataspace = dataset.getSpace();
-        //cout << "Dataspace is " << dataspace << endl;
-
-        // get number of dimensions in dataspace
-        int rank = dataspace.getSimpleExtentNdims();
-        //cout << "Dataspace rank is " << rank << endl;
+        int8_t *buffer = (int8_t*) readHyperslab(dataset, s, PredType::NATIVE_INT8, sizeof(int8_t), "int8", nvalues, nblock, offset);
 
-        // I expect this to be 2 for all SAG datasets!
-        // There are no more-dimensional arrays stored in one dataset, are there?
-        if (rank == 1) {
-            hsize_t dims_out[1];
-            int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
-            //cout << "dimension " << (unsigned long)(dims_out[0]) << endl;
-            nvalues = dims_out[0];
-        } else if (rank == 2) {
-            hsize_t dims_out[2];
-            int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
-            if (dims_out[rank-1] == 1) {
-                //cout << "rank " << rank << ", dimensions " <<
-                //    (unsigned long)(dims_out[0]) << " x " <<
-                //    (unsigned long)(dims_out[1]) << endl;
-                nvalues = dims_out[0];
-            } else {
-                cout << "ERROR: Cannot cope with this dataset, dimensions too high:" << 
-                    (unsigned long)(dims_out[0]) << " x " <<
-                    (unsigned long)(dims_out[1]) << endl;
-                abort();
-            }
-        } else {
-            cout << "ERROR: Cannot cope with multi-dimensional datasets! rank: " << rank << endl;
-            abort();
-        }
-
-        // define hyperslab
-        // offset already provided when calling this function, no need to redefine here
-        count[0]  = 1;  // just use 1 block, so count = 1
-        count[1]  = 1;
-
-        stride[0] = 1;
-        stride[1] = 1;
-        
-        block[0] = nblock[0]; // use block instead of count, might be faster
-        block[1] = 1;
-
-        hsize_t dimsm[2]; // memory space dimensions, must be the same as hyperslab-size
-        dimsm[0] = nblock[0];
-        dimsm[1] = 1;
-
-        // define memory space
-        DataSpace memspace(rank, dimsm, NULL);
-
-        // selec the hyperslap from the dataspace
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block); 
-        //dataspace.selectHyperslab( H5S_SELECT_SET, count, offset ); 
-        
-        // read data from selection
-        int8_t rdata[nblock[0]][1]; // read requirer buffer to have same dimensions as dataset
-        dataset.read(rdata,PredType::NATIVE_INT8, memspace, dataspace);
-        
-        // copy over to an array with 1 dim. only, for convenience
-        int8_t *buffer = new int8_t[nblock[0]]; // = same as malloc
-        memcpy(buffer, &rdata[0][0], nblock[0]*sizeof(int8_t));
-        // only works, because buffer[i] = rdata[i][0]
-
-        // the data is stored in buffer now, so we can delete the dataset etc.;
-        // to do this, call delete on the pointer to the dataset
-        dataspace.close();
-        memspace.close();
         dataset.close();
-        // delete dataset is not necessary, if it is a variable on the heap.
-        // Then it is removed automatically when the function ends.
         delete dptr;
 
-        DataBlock b;
-        b.nvalues = nvalues;
-        b.tinyintval = buffer;
-        b.name = s;
-        datablocks.push_back(b);
-        // block b with the data is added to datablocks-vector now
-
         return buffer;
-
     }
  
     double* SagReader::readDoubleDataSet(const std::string s, long &nvalues, hsize_t *nblock, hsize_t *offset) {
         // read a double-type dataset
         // TODO: not tested yet, since SAG-data only contain floats (4 byte)
 
-        hsize_t count[2];   // size of the hyperslab in the file
-        hsize_t stride[2];  // should be 1,1
-        hsize_t block[2];   // block size, should use nblock-values
-
         //cout << "Reading DataSet '" << s << "'" << endl;
 
         DataSet *dptr = new DataSet(fp->openDataSet(s));
@@ -646,87 +1208,11 @@ namespace Sag {
             abort();
         }
 
-        size_t dsize = intype.getSize();
-        //cout << "Data size is " << dsize << endl;
-
-        // get dataspace of the dataset (the array length or so)
-        DataSpace dataspace = dataset.getSpace();
-        //hid_t dataspace = H5Dget_space(dataset); --> this does not work!! At least not with dataset defined as above!
-
-        // get number of dimensions in dataspace
-        int rank = dataspace.getSimpleExtentNdims();
-        //cout << "Dataspace rank is " << rank << endl;
-
-        // I expect this to be 2 for all SAG datasets!
-        // There are no more-dimensional arrays stored in one dataset, are there?
-        if (rank == 1) {
-            hsize_t dims_out[1];
-            int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
-            nvalues = dims_out[0];
-        }
-        else if (rank == 2) {
-            hsize_t dims_out[2];
-            int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
-            if (dims_out[rank-1] == 1) {
-                nvalues = dims_out[0];
-            } else {
-                cout << "ERROR: Cannot cope with this dataset, dimensions too high:" << 
-                    (unsigned long)(dims_out[0]) << " x " <<
-                    (unsigned long)(dims_out[1]) << endl;
-                abort();
-            }
-        } else {
-            cout << "ERROR: Cannot cope with multi-dimensional datasets! rank: " << rank << endl;
-            abort();
-        }
-
-        // define hyperslab
-        // offset already provided when calling this function, no need to redefine here
-        count[0]  = 1;  // just use 1 block, so count = 1
-        count[1]  = 1;
-
-        stride[0] = 1;
-        stride[1] = 1;
-        
-        block[0] = nblock[0]; // use block instead of count, might be faster
-        block[1] = 1;
-
-        hsize_t dimsm[2]; // memory space dimensions, must be the same as hyperslab-size
-        dimsm[0] = nblock[0];
-        dimsm[1] = 1;
-
-        // define memory space
-        DataSpace memspace(rank, dimsm, NULL);
-
-        // selec the hyperslap from the dataspace
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block); 
-        //dataspace.selectHyperslab( H5S_SELECT_SET, count, offset ); 
-        
-        // read data from selection
-        double rdata[nblock[0]][1]; // read requires buffer to have the same dimensions as dataset
-        dataset.read(rdata,PredType::NATIVE_DOUBLE, memspace, dataspace);
-
-        // copy over to an array with 1 dim. only, for convenience
-        double *buffer = new double[nblock[0]]; // = same as malloc
-        memcpy(buffer, &rdata[0][0], nblock[0]*sizeof(double));
-        // only works, because buffer[i] = rdata[i][0]
+        double *buffer = (double*) readHyperslab(dataset, s, PredType::NATIVE_DOUBLE, sizeof(double), "double", nvalues, nblock, offset);
 
-        // the data is stored in buffer now, so we can delete the dataset etc.;
-        // to do this, call delete on the pointer to the dataset
-        dataspace.close();
-        memspace.close();
         dataset.close();
-        // delete dataset is not necessary, if it is a variable on the heap.
-        // Then it is removed automatically when the function ends.
         delete dptr;
 
-        DataBlock b;
-        b.nvalues = nvalues;
-        b.doubleval = buffer;
-        b.name = s;
-        datablocks.push_back(b);
-        // block b with the data is added to datablocks-vector now
-
         return buffer;
     }
 
@@ -734,10 +1220,6 @@ namespace Sag {
     float* SagReader::readFloatDataSet(const std::string s, long &nvalues, hsize_t *nblock, hsize_t *offset) {
         // read a float-type dataset (4 bytes, not double)
 
-        hsize_t count[2];   // size of the hyperslab in the file
-        hsize_t stride[2];  // should be 1,1
-        hsize_t block[2];   // block size, should use nblock-values
-
         //cout << "Reading DataSet '" << s << "'" << endl;
 
         DataSet *dptr = new DataSet(fp->openDataSet(s));
@@ -764,39 +1246,55 @@ namespace Sag {
             abort();
         }
 
-        // get dataspace of the dataset (the array length or so)
+        float *buffer = (float*) readHyperslab(dataset, s, PredType::NATIVE_FLOAT, sizeof(float), "float", nvalues, nblock, offset);
+
+        dataset.close();
+        delete dptr;
+
+        return buffer;
+    }
+
+    void* SagReader::readHyperslab(DataSet &dataset, const std::string s, const PredType &memtype, size_t elemsize, const std::string type, long &nvalues, hsize_t *nblock, hsize_t *offset) {
+        // Read nblock[0] rows, starting at offset[0], from the given dataset.
+        // For 2-dimensional datasets (N x k), all columns requested in the
+        // mapping file (s[j]) are read with one hyperslab and then
+        // de-interleaved into one datablock per column.
+        // Returns the buffer of the first column.
+        hsize_t count[2];   // size of the hyperslab in the file
+        hsize_t stride[2];  // should be 1,1
+        hsize_t block[2];   // block size, should use nblock-values
+        hsize_t slaboffset[2];
+        hsize_t dims_out[2];
+        hsize_t ncomps;
+        hsize_t firstComp;
+        int k;
+
+        k = dataSetIndex(s);
+
+        // get dataspace of the dataset
         DataSpace dataspace = dataset.getSpace();
- 
+
         // get number of dimensions in dataspace
-        int rank;
-        rank = dataspace.getSimpleExtentNdims();
+        int rank = dataspace.getSimpleExtentNdims();
+        //cout << "Dataspace rank is " << rank << endl;
 
-        // I expect this to be 2 for all SAG datasets!
-        // There are no more-dimensional arrays stored in one dataset, are there?
         if (rank == 1) {
-            hsize_t dims_out[1];
             int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
             //cout << "dimension " << (unsigned long)(dims_out[0]) << endl;
             nvalues = dims_out[0];
-        }
-        else if (rank == 2) {
-            hsize_t dims_out[2];
+            dims_out[1] = 1;
+        } else if (rank == 2) {
             int ndims = dataspace.getSimpleExtentDims(dims_out, NULL);
-            if (dims_out[rank-1] == 1) {
-                nvalues = dims_out[0];
-            } else {
-                cout << "ERROR: Cannot cope with this dataset, dimensions too high:" << 
-                    (unsigned long)(dims_out[0]) << " x " <<
-                    (unsigned long)(dims_out[1]) << endl;
-                abort();
-            }
+            nvalues = dims_out[0];
         } else {
             cout << "ERROR: Cannot cope with multi-dimensional datasets! rank: " << rank << endl;
             abort();
         }
 
+        // only read the range of columns we need
+        getColumnRange(k, dims_out[1], firstComp, ncomps);
+
         // define hyperslab
-        // offset already provided when calling this function, no need to redefine here
         count[0]  = 1;  // just use 1 block, so count = 1
         count[1]  = 1;
 
@@ -804,58 +1302,132 @@ namespace Sag {
         stride[1] = 1;
         
         block[0] = nblock[0]; // use block instead of count, might be faster
-        block[1] = 1;
+        block[1] = ncomps;
+
+        slaboffset[0] = offset[0];
+        slaboffset[1] = firstComp;
 
         hsize_t dimsm[2]; // memory space dimensions, must be the same as hyperslab-size
         dimsm[0] = nblock[0];
-        dimsm[1] = 1;
+        dimsm[1] = ncomps;
 
         // define memory space
         DataSpace memspace(rank, dimsm, NULL);
 
-        // select the hyperslap from the dataspace
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block); 
-        
-        // read data from selection
-        float rdata[nblock[0]][1]; // read requires buffer to have the same dimensions as dataset
-        dataset.read(rdata,PredType::NATIVE_FLOAT, memspace, dataspace);
-        
-        // copy over to an array with 1 dim. only, for convenience
-        float *buffer = new float[nblock[0]]; // = same as malloc
-        memcpy(buffer, &rdata[0][0], nblock[0]*sizeof(float));
-        // only works, because buffer[i] = rdata[i][0]
+        // select the hyperslab from the dataspace
+        dataspace.selectHyperslab(H5S_SELECT_SET, count, slaboffset, stride, block); 
+
+        // read data from selection; a single column is read directly into
+        // its datablock, otherwise the columns are de-interleaved afterwards
+        bool direct = (ncomps == 1 && dataSetComps[k].size() == 1);
+        DataBlock first;
+        char *rdata;
+
+        first.type = type;
+        if (direct) {
+            first.allocData(nblock[0]);
+            rdata = first.getValuePtr(0);
+        } else {
+            rdata = new char[nblock[0] * ncomps * elemsize];
+            addReadBuffer(nblock[0] * ncomps * elemsize);
+        }
+        if (prefetched) {
+            // already read together with other datasets: all columns of the rows
+            copyPrefetched(prefetched, dims_out[1], nblock[0], firstComp, ncomps, elemsize, rdata);
+        } else if (!chunkReader || !chunkReader->read(s, dataset.getId(), memtype.getId(), offset[0], nblock[0], firstComp, ncomps, rdata)) {
+            dataset.read(rdata, memtype, memspace, dataspace);
+        }
 
-        // the data is stored in buffer now, so we can delete the dataset etc.;
-        // to do this, call delete on the pointer to the dataset
         dataspace.close();
         memspace.close();
-        dataset.close();
-        // delete dataset is not necessary, if it is a variable on the heap.
-        // Then it is removed automatically when the function ends.
-        delete dptr;
 
-        DataBlock b;
-        b.nvalues = nvalues;
-        b.floatval = buffer;
-        b.name = s;
-        datablocks.push_back(b);
-        // block b with the data is added to datablocks-vector now
+        char *firstBuffer = addColumnBlocks(k, first, rdata, direct, nblock[0], nvalues, firstComp, ncomps, elemsize);
 
-        return buffer;
+        if (!direct) {
+            delete[] rdata;
+            releaseReadBuffer(nblock[0] * ncomps * elemsize);
+        }
+
+        return firstBuffer;
     }
 
-    bool SagReader::getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result) {
-        //reroute constant items:
+    void SagReader::getColumnRange(int k, hsize_t ncols, hsize_t &firstComp, hsize_t &ncomps) {
+        // check the columns requested for dataset k (which has ncols
+        // columns) and get the range of columns covering all of them
+        vector<int> &comps = dataSetComps[k];
+        int first = max(comps[0], 0);
+        int last = first;
+
+        for (int c=0; c<comps.size(); c++) {
+            if (comps[c] < 0 && ncols != 1) {
+                cout << "ERROR: Cannot cope with this dataset, dimensions too high: " <<
+                    (unsigned long)(ncols) << " columns" << endl;
+                cout << "Use " << dataSetNames[k] << "[j] in the mapping file to select column j." << endl;
+                abort();
+            }
+            if (comps[c] >= (long) ncols) {
+                cout << "ERROR: Column " << comps[c] << " requested for dataset " << dataSetNames[k]
+                     << ", but it has only " << (unsigned long)(ncols) << " columns." << endl;
+                abort();
+            }
+            first = min(first, max(comps[c], 0));
+            last = max(last, max(comps[c], 0));
+        }
+        firstComp = first;
+        ncomps = last - first + 1;
+    }
 
-        //cout << "Name in getItemInRow: " << thisItem->getDataObjName()<< endl;
-        if(thisItem->getIsConstItem() == true) {
-            getConstItem(thisItem, result);
-        } else if (thisItem->getIsHeaderItem() == true) {
-            printf("We never told you to read headers...\n");
-            exit(EXIT_FAILURE);
-        } else {
-            getDataItem(thisItem, result);
+    char* SagReader::addColumnBlocks(int k, DataBlock &first, char *rdata, bool direct, long nrows, long nvalues, hsize_t firstComp, hsize_t ncomps, size_t elemsize) {
+        // add one datablock per requested column of dataset k; rdata holds
+        // nrows x ncomps values, starting at column firstComp (for direct
+        // reads it is already the buffer of the first datablock)
+        // Returns the buffer of the first column.
+        char *firstBuffer = NULL;
+        for (int c=0; c<dataSetComps[k].size(); c++) {
+            DataBlock b = first;
+            int comp = max(dataSetComps[k][c], 0) - firstComp;
+
+            if (!direct) {
+                b.allocData(nrows);
+                char *dst = b.getValuePtr(0);
+                for (long i=0; i<nrows; i++) {
+                    memcpy(dst + i*elemsize, rdata + (i*ncomps + comp)*elemsize, elemsize);
+                }
+            }
+            b.nvalues = nvalues;
+            b.name = dataSetColumns[k][c];
+            if (c == 0) {
+                firstBuffer = b.getValuePtr(0);
+            }
+            datablocks.push_back(b);
+            // block b with the data is added to datablocks-vector now
+        }
+
+        return firstBuffer;
+    }
+
+    void SagReader::copyPrefetched(const char *src, hsize_t ncols, hsize_t nrows, hsize_t firstComp, hsize_t ncomps, size_t elemsize, char *out) {
+        // copy the requested columns out of rows read with all their columns
+        for (hsize_t i=0; i<nrows; i++) {
+            memcpy(out + i*ncomps*elemsize, src + (i*ncols + firstComp)*elemsize, ncomps*elemsize);
         }
+    }
+
+    int SagReader::dataSetIndex(const std::string s) {
+        // index of the dataset in dataSetNames
+        for (int k=0; k<dataSetNames.size(); k++) {
+            if (dataSetNames[k] == s) {
+                return k;
+            }
+        }
+        cout << "ERROR: Dataset " << s << " not found in the list of desired datasets." << endl;
+        abort();
+    }
+
+    bool SagReader::getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result) {
+        // constant items are served by getDataItem as well (see resolveItem)
+        bool isNull = getDataItem(thisItem, result);
+
         //cout << " again ioutput: " << ioutput << endl;
         //check assertions
         //checkAssertions(thisItem, result);
@@ -863,157 +1435,551 @@ namespace Sag {
         //apply conversion
         //applyConversions(thisItem, result);
 
-        return 0;
+        return isNull;
     }
 
-    bool SagReader::getDataItem(DBDataSchema::DataObjDesc * thisItem, void* result) {
-        // check which DB column is requested and assign the corresponding data value,
-        // variables are declared already in Sag_Reader.h
-        // and the values were read in getNextRow()
-        bool isNull;
-        
-        // go through all data items and assign the correct column numbers for the DB columns, 
-        // maybe depending on a previously read schema-file:
-        
-        //cout << "dataobjname: " << thisItem->getDataObjName() << endl;
-
-        isNull = false;
+    ItemSource SagReader::resolveItem(DBDataSchema::DataObjDesc * thisItem) {
+        // find out once where the values of this item come from
+        ItemSource source;
+        string name = thisItem->getDataObjName();
 
-        DataBlock b;
-        string name;
+        source.size = DBDataSchema::getByteLenOfDType(thisItem->getDataObjDType());
+        if (thisItem->getIsConstItem()) {
+            source.kind = ItemSource::CONSTANT;
+            source.data = thisItem->getConstData();
+            return source;
+        }
+        if (thisItem->getIsHeaderItem()) {
+            printf("We never told you to read headers...\n");
+            exit(EXIT_FAILURE);
+        }
+        if (isAlwaysNull(name)) {
+            source.kind = ItemSource::ALWAYS_NULL;
+            return source;
+        }
 
         // quickly access the correct data block by name (should have redshift removed already),
         // but make sure that key really exists in the map
-        map<string,int>::iterator it = dataSetMap.find(thisItem->getDataObjName());
-
+        map<string,int>::iterator it = dataSetMap.find(name);
         if (it != dataSetMap.end()) {
-            b = datablocks[it->second];
-            //cout << "b.name: " << b.name << endl;
-
-            if (b.longval) {
-                *(long*)(result) = b.longval[countInBlock];
-                return isNull;
-            } else if (b.tinyintval) {
-                *(int8_t*)(result) = b.tinyintval[countInBlock];
-                return isNull;
-            } else if (b.doubleval) {
-                *(double*)(result) = b.doubleval[countInBlock];
-                return isNull;
-            } else if (b.floatval) {
-                // customize for positions, since I need to multiply posfactor
-                // TODO: use an extrac column in mapping file for this or
-                // use additional functions or ... Find a cleaner solution
-                // than putting it right here.
-                if (b.name == "/X" || b.name == "/Y" || b.name == "/Z") {
-                    *(float*)(result) = b.floatval[countInBlock] * posfactor;
+            source.kind = ItemSource::DATASET;
+            source.block = it->second;
+            // customize for positions, since I need to multiply posfactor
+            // TODO: use an extrac column in mapping file for this or
+            // use additional functions or ... Find a cleaner solution
+            // than putting it right here.
+            source.scaled = (name == "/X" || name == "/Y" || name == "/Z");
+            return source;
+        }
+
+        // get snapshot number and expansion factor from already read metadata 
+        // for this output
+        if (name == "snapnum") {
+            source.kind = ItemSource::SNAPNUM;
+        } else if (name == "redshift") {
+            source.kind = ItemSource::REDSHIFT;
+        } else if (name == "NInFile") {
+            source.kind = ItemSource::NINFILE;
+        } else if (name == "fileNum") {
+            source.kind = ItemSource::FILENUM;
+        } else if (name == "dbId") {
+            source.kind = ItemSource::DBID;
+        } else if (name == "phkey") {
+            // computed anyway for sorting, or on request (e.g. for partitioning)
+            if (sortKey == "phkey") {
+                source.kind = ItemSource::SORTED_PHKEY;
+            } else if (computePHKey) {
+                source.kind = ItemSource::PHKEY;
+            } else {
+                source.kind = ItemSource::ALWAYS_NULL;
+            }
+        } else {
+            // --> do it on the database side;
+            // or: put current x, y, z in global reader variables,
+            // could calculate ix, iy, iz here, but can only do this AFTER x,y,z
+            // were assigned!  => i.e. would need to check in generated schema
+            // that it is in correct order!
+            fflush(stdout);
+            fflush(stderr);
+            printf("\nERROR: Something went wrong... (no dataItem for schemaItem %s found)\n", name.c_str());
+            exit(EXIT_FAILURE);
+        }
+        return source;
+    }
+
+    const ItemSource& SagReader::getItemSource(DBDataSchema::DataObjDesc * thisItem) {
+        map<DataObjDesc*, ItemSource>::iterator it = itemSources.find(thisItem);
+        if (it == itemSources.end()) {
+            it = itemSources.insert(make_pair(thisItem, resolveItem(thisItem))).first;
+        }
+        return it->second;
+    }
+
+    bool SagReader::getDataItem(DBDataSchema::DataObjDesc * thisItem, void* result) {
+        // check which DB column is requested and assign the corresponding data value,
+        // variables are declared already in Sag_Reader.h
+        // and the values were read in getNextRow();
+        // returns true for NULL values
+        const ItemSource &source = getItemSource(thisItem);
+
+        switch (source.kind) {
+            case ItemSource::CONSTANT:
+                copyItem(result, source.data, source.size);
+                return false;
+
+            case ItemSource::DATASET: {
+                DataBlock &b = datablocks[source.block];
+                if (b.longval) {
+                    *(long*)(result) = b.longval[countInBlock];
+                } else if (b.tinyintval) {
+                    *(int8_t*)(result) = b.tinyintval[countInBlock];
+                } else if (b.doubleval) {
+                    *(double*)(result) = b.doubleval[countInBlock];
+                } else if (b.floatval) {
+                    if (source.scaled) {
+                        *(float*)(result) = b.floatval[countInBlock] * posfactor;
+                    } else {
+                        *(float*)(result) = b.floatval[countInBlock];
+                    }
                 } else {
-                    *(float*)(result) = b.floatval[countInBlock];
+                    cout << "Error: No corresponding data found!" << " (" << thisItem->getDataObjName() << ")" << endl;
+                    abort();
                 }
-                return isNull;
-            } else {
-                cout << "Error: No corresponding data found!" << " (" << thisItem->getDataObjName() << ")" << endl;
-                abort();
+                return validity[source.block].isNull(countInBlock);
             }
+
+            case ItemSource::SNAPNUM:
+                *(int*)(result) = current_snapnum;
+                return false;
+
+            case ItemSource::REDSHIFT:
+                *(float*)(result) = current_redshift;
+                return false;
+
+            case ItemSource::NINFILE:
+                if (sorter) {
+                    // row number of this row in the file, not in the sorted order
+                    int rowFileNum;
+                    long rowInFile;
+                    getRowSource(blockRows[countInBlock], rowFileNum, rowInFile);
+                    *(long*)(result) = rowInFile + 1;
+                    return false;
+                }
+                *(long*)(result) = currRow - sourceFirstRow;
+                return false;
+
+            case ItemSource::FILENUM:
+                if (sorter && virtualSources.size() > 0) {
+                    long rowInFile;
+                    getRowSource(blockRows[countInBlock], *(int*) result, rowInFile);
+                    return false;
+                }
+                *(int*) result = fileNum;
+                return false;
+
+            case ItemSource::DBID:
+                if (sorter) {
+                    int rowFileNum;
+                    long rowInFile;
+                    getRowSource(blockRows[countInBlock], rowFileNum, rowInFile);
+                    *(long*)(result) = (current_snapnum * snapnumfactor + rowFileNum) * rowfactor + rowInFile + 1;
+                    return false;
+                }
+                *(long*)(result) = (current_snapnum * snapnumfactor + fileNum) * rowfactor + currRow - sourceFirstRow;
+                return false;
+
+            case ItemSource::SORTED_PHKEY:
+                if (sorter) {
+                    *(long*) result = (long) blockKeys[countInBlock];
+                    return false;
+                }
+                *(long*) result = 0;
+                return true;
+
+            case ItemSource::PHKEY:
+                *(long*) result = (long) getRowPHKey(countInBlock);
+                return false;
+
+            case ItemSource::ALWAYS_NULL:
+                memset(result, 0, source.size);
+                return true;
         }
-            
-        // get snapshot number and expansion factor from already read metadata 
-        // for this output
-        if (thisItem->getDataObjName().compare("snapnum") == 0) {
-            *(int*)(result) = current_snapnum;
-            return isNull;
+
+        return true;
+    }
+
+    void SagReader::getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result) {
+        const ItemSource &source = getItemSource(thisItem);
+        copyItem(result, source.data, source.size);
+    }
+
+    bool SagReader::isBroadcastItem(DBDataSchema::DataObjDesc * thisItem) {
+        // items which do not change within one output of a file (see
+        // getDataItem), unless a dataset of the same name is mapped
+        string name = thisItem->getDataObjName();
+
+        if (thisItem->getIsConstItem()) {
+            return true;
+        }
+        if (isAlwaysNull(name)) {
+            return true;
+        }
+        if (thisItem->getIsHeaderItem() || dataSetMap.find(name) != dataSetMap.end()) {
+            return false;
+        }
+        if (name == "phkey") {
+            return (sortKey != "phkey" && !computePHKey);
+        }
+        if (name == "fileNum") {
+            // sorted rows of a virtual dataset come from all its files
+            return (sortKey == "" || virtualSources.size() == 0);
         }
+        return (name == "snapnum" || name == "redshift");
+    }
+
+    long SagReader::getBroadcastVersion() {
+        return broadcastVersion;
+    }
 
-        if (thisItem->getDataObjName().compare("redshift") == 0) {
-            *(float*)(result) = current_redshift;
-            return isNull;
+    void SagReader::setCurrRow(long n) {
+        currRow = n;
+        return;
+    }
+
+    long SagReader::getCurrRow() {
+        return currRow;
+    }
+
+    void SagReader::setDecompressThreads(int numThreads) {
+        // read compressed chunks directly and decompress them with
+        // numThreads threads
+        if (chunkReader) {
+            delete chunkReader;
+            chunkReader = NULL;
         }
+        if (numThreads > 0) {
+            chunkReader = new ChunkReader(numThreads);
+        }
+    }
+
+    void SagReader::setIOOrder(bool newIOOrder, long newMergeGap) {
+        ioOrder = newIOOrder;
+        scheduler.setMergeGap(ioOrder ? newMergeGap : -1);
+        if (ioOrder && fp && numDataSets > 0) {
+            scheduler.scan(fp, dataSetNames);
+        }
+    }
 
-        if (thisItem->getDataObjName().compare("NInFile") == 0) {
-            *(long*)(result) = currRow;
-            //result = (void *) countInBlock;
-            return isNull;
+    void SagReader::setMultiRead(bool newMultiRead) {
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        multiRead = newMultiRead;
+        multiReader.close();
+        if (multiRead && fp && numDataSets > 0) {
+            openMultiReader();
         }
+    }
+
+    void SagReader::setAdaptiveBlocksize(bool adaptive) {
+        if (!adaptive || blockSizer) {
+            return;
+        }
+        if (sortKey != "") {
+            // the sorted rows are served from memory, nothing to adapt
+            cout << "Adaptive blocksize is not used for sorted rows." << endl;
+            return;
+        }
+        blockSizer = new BlockSizer(blocksize);
+    }
+
+    void SagReader::setMemoryBudget(MemoryBudget *newMemory) {
+        memory = newMemory;
+    }
+
+    void SagReader::setMetrics(Metrics *newMetrics) {
+        metrics = newMetrics;
+    }
+
+    void SagReader::setCountWritten(bool newCountWritten) {
+        countWritten = newCountWritten;
+    }
+
+    void SagReader::setPrecisions(const map<string, ColumnPrecision> &newPrecisions) {
+        precisions = newPrecisions;
+    }
 
-        if (thisItem->getDataObjName().compare("fileNum") == 0) {
-            *(int*) result = fileNum;
-            return isNull;
+    void SagReader::reducePrecision(long nrows) {
+        // convert double columns to float and/or round away mantissa bits,
+        // as requested in the mapping file, right after reading a block; all
+        // later steps (statistics, sorting, ingest) see the reduced values
+        if (precisions.size() == 0) {
+            return;
+        }
+        TraceSpan span("reduce_precision", "transform");
+        for (int k=0; k<datablocks.size(); k++) {
+            DataBlock &b = datablocks[k];
+            map<string, ColumnPrecision>::iterator it = precisions.find(b.name);
+            if (it == precisions.end()) {
+                continue;
+            }
+            if (it->second.toFloat && b.doubleval) {
+                float *values = new float[nrows];
+                doublesToFloats(b.doubleval, values, nrows);
+                delete[] b.doubleval;
+                b.doubleval = NULL;
+                b.floatval = values;
+                b.type = "float";
+            }
+            if (b.floatval) {
+                quantizeFloats(b.floatval, nrows, it->second.mantissaBits);
+            } else if (b.doubleval) {
+                quantizeDoubles(b.doubleval, nrows, it->second.mantissaBits);
+            }
         }
+    }
+
+    void SagReader::setNulls(const map<string, ColumnNulls> &newNulls) {
+        nulls = newNulls;
+        itemSources.clear();
+    }
 
+    bool SagReader::isAlwaysNull(const string &name) {
+        map<string, ColumnNulls>::iterator it = nulls.find(name);
+        return (it != nulls.end() && it->second.always);
+    }
 
-        if (thisItem->getDataObjName().compare("dbId") == 0) {
-            *(long*)(result) = (current_snapnum * snapnumfactor + fileNum) * rowfactor + currRow;
-            return isNull;
+    void SagReader::markBlockNulls(long nrows) {
+        // find the NULL values of each column of the block once, so that
+        // serving a row only needs to look up a bit
+        validity.resize(datablocks.size());
+        for (int k=0; k<datablocks.size(); k++) {
+            validity[k].numNulls = 0;
+        }
+        if (nulls.size() == 0 || nrows <= 0) {
+            return;
+        }
+        TraceSpan span("mark_nulls", "transform");
+        for (int k=0; k<datablocks.size(); k++) {
+            map<string, ColumnNulls>::iterator it = nulls.find(datablocks[k].name);
+            if (it != nulls.end()) {
+                markNulls(it->second, datablocks[k].type, datablocks[k].getValuePtr(0), nrows, validity[k]);
+            }
         }
+    }
 
+    void SagReader::clearDataBlocks() {
+        // free the values of the current block
+        for (int k=0; k<datablocks.size(); k++) {
+            datablocks[k].deleteData();
+        }
+        datablocks.clear();
+        if (memory && columnBytes > 0) {
+            memory->release(MemoryBudget::COLUMN_BUFFERS, columnBytes);
+        }
+        columnBytes = 0;
+    }
 
-        if (thisItem->getDataObjName().compare("forestId") == 0) {
-            *(long*) result = 0;
-            isNull = true;
-            return isNull;
+    void SagReader::countDataBlocks(long nrows) {
+        // count the datablocks just allocated for nrows rows and remember
+        // how much a row needed, including the temporary read buffers
+        if (!memory || nrows <= 0) {
+            return;
         }
+        columnBytes = 0;
+        for (int k=0; k<datablocks.size(); k++) {
+            columnBytes += nrows * datablocks[k].getElemSize();
+        }
+        memory->add(MemoryBudget::COLUMN_BUFFERS, columnBytes);
+        rowBytes = (columnBytes + readBufferPeak) / nrows + 1;
+        readBufferPeak = readBufferBytes;
+    }
 
-        if (thisItem->getDataObjName().compare("depthFirstId") == 0) {
-            *(long*) result = 0;
-            isNull = true;
-            return isNull;
+    long SagReader::fitBlockRows(long nrows) {
+        // shrink the block to the free memory; the very first block is
+        // small, to measure the bytes per row
+        if (!memory) {
+            return nrows;
+        }
+        if (rowBytes == 0) {
+            return min(nrows, 1024L);
         }
+        return memory->fitRows(rowBytes, nrows);
+    }
 
-        if (thisItem->getDataObjName().compare("ix") == 0) {
-            *(int*) result = 0;
-            isNull = true;
-            return isNull;
+    void SagReader::addReadBuffer(long bytes) {
+        readBufferBytes += bytes;
+        readBufferPeak = max(readBufferPeak, readBufferBytes);
+        if (memory) {
+            memory->add(MemoryBudget::READ_BUFFERS, bytes);
         }
+    }
 
-        if (thisItem->getDataObjName().compare("iy") == 0) {
-            *(int*) result = 0;
-            isNull = true;
-            return isNull;
+    void SagReader::releaseReadBuffer(long bytes) {
+        readBufferBytes -= bytes;
+        if (memory) {
+            memory->release(MemoryBudget::READ_BUFFERS, bytes);
         }
+    }
 
-        if (thisItem->getDataObjName().compare("iz") == 0) {
-            *(int*) result = 0;
-            isNull = true;
-            return isNull;
+    void SagReader::setContentHash(bool newHashContent) {
+        hashContent = newHashContent;
+        resetContentHash();
+    }
+
+    void SagReader::hashBlock(long nrows) {
+        // add a hash of each value of the block, mixed with its column, row
+        // and snapnum; the sum does not depend on the order of the rows,
+        // the block sizes or how a file is split into row ranges
+        TraceSpan span("hash_block", "transform");
+        for (int k=0; k<datablocks.size(); k++) {
+            DataBlock &b = datablocks[k];
+            size_t elemsize = b.getElemSize();
+            uint64_t columnSeed = hashString(b.name) ^ ((uint64_t) current_snapnum << 40);
+            const char *p = b.getValuePtr(0);
+            for (long i=0; i<nrows; i++) {
+                uint64_t value = 0;
+                long row = sorter ? blockRows[i] : currRow + i;
+                memcpy(&value, p + i*elemsize, elemsize);
+                contentHash += mixHash(value ^ mixHash(columnSeed + row));
+            }
         }
+        hashedRows += nrows;
+    }
+
+    uint64_t SagReader::getContentHash() {
+        return contentHash;
+    }
 
-        if (thisItem->getDataObjName().compare("phkey") == 0) {
-            *(long*) result = 0;
-            isNull = true;
-            return isNull;
+    long SagReader::getHashedRows() {
+        return hashedRows;
+    }
+
+    void SagReader::resetContentHash() {
+        contentHash = 0;
+        hashedRows = 0;
+    }
+
+    void SagReader::setRowRange(long newIoutput, long firstRow, long nrows) {
+        // serve only rows [firstRow, firstRow+nrows) of the given output,
+        // e.g. for one part of a file split into several tasks;
+        // NInFile and dbId still count from the start of the output
+        if (sortKey != "") {
+            SagIngest_error("SagReader: Row ranges cannot be combined with sorting.\n");
         }
+        selectOutput(newIoutput);
+        currRow = firstRow;
+        rowLimit = firstRow + nrows;
+    }
 
-        // --> do it on the database side;
-        // or: put current x, y, z in global reader variables,
-        // could calculate ix, iy, iz here, but can only do this AFTER x,y,z
-        // were assigned!  => i.e. would need to check in generated schema
-        // that it is in correct order!
+    long SagReader::selectVirtualSource(long row, long nrows) {
+        // switch fileNum and NInFile to the source file of the given row of
+        // a virtual dataset; returns nrows, limited to the end of this file
+        int i = findVirtualSource(virtualSources, row, virtualSource);
 
-        // if we still did not return ...
-        fflush(stdout);
-        fflush(stderr);
-        printf("\nERROR: Something went wrong... (no dataItem for schemaItem %s found)\n", thisItem->getDataObjName().c_str());
-        exit(EXIT_FAILURE);
+        if (i != virtualSource) {
+            virtualSource = i;
+            fileNum = (i >= 0) ? virtualSources[i].fileNum : baseFileNum;
+            sourceFirstRow = (i >= 0) ? virtualSources[i].firstRow : 0;
+            broadcastVersion++;
+        }
+        if (i < 0) {
+            // not mapped to any file: up to the next source
+            for (i=0; i<virtualSources.size() && virtualSources[i].firstRow <= row; i++);
+            return (i < virtualSources.size()) ? min(nrows, virtualSources[i].firstRow - row) : nrows;
+        }
+        return min(nrows, virtualSources[i].firstRow + virtualSources[i].nrows - row);
+    }
 
-        return isNull;
+    void SagReader::getRowSource(long row, int &rowFileNum, long &rowInFile) {
+        // fileNum and row number (from 0) in its file of the given row of
+        // the output, for rows served out of order
+        int i = (virtualSources.size() > 0) ? findVirtualSource(virtualSources, row, -1) : -1;
+
+        rowFileNum = (i >= 0) ? virtualSources[i].fileNum : fileNum;
+        rowInFile = (i >= 0) ? row - virtualSources[i].firstRow : row;
     }
 
-    void SagReader::getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result) {
-        memcpy(result, thisItem->getConstData(), DBDataSchema::getByteLenOfDType(thisItem->getDataObjDType()));
+    void SagReader::setZoneMap(ZoneMapWriter *newZoneMap) {
+        zoneMap = newZoneMap;
     }
 
-    void SagReader::setCurrRow(long n) {
-        currRow = n;
-        return;
+    void SagReader::setChecksums(ChecksumSet *newChecksums) {
+        checksums = newChecksums;
     }
 
-    long SagReader::getCurrRow() {
-        return currRow;
+    void SagReader::openMultiReader() {
+        // open the datasets of the current output and fix the range of
+        // columns read from each of them
+        multiReader.open(fp, dataSetNames);
+        for (int k=0; k<numDataSets; k++) {
+            MultiDataSet &d = multiReader.get(k);
+            getColumnRange(k, d.dims[1], d.firstComp, d.ncomps);
+        }
+    }
+
+    long SagReader::getReadMicroseconds() {
+        return readMicroseconds;
+    }
+
+    long SagReader::getNumBlocksRead() {
+        return numBlocksRead;
     }
 
     long SagReader::getNumOutputs() {
         return numOutputs;
     }
 
+    long SagReader::countRows() {
+        // number of rows of all selected outputs; only before reading, as
+        // it starts again with the first output
+        long nrows = 0;
+        for (long i=0; i<numOutputs; i++) {
+            selectOutput(i);
+            nrows += getNumRowsInDataSet(dataSetNames[0]);
+        }
+        selectOutput(0);
+        return nrows;
+    }
+
+    void SagReader::setSortKey(string newSortKey, long newSortMemory, string newSortTmpDir) {
+        // sort key must be "phkey" or one of the datasets from the mapping file
+        if (newSortKey != "" && newSortKey != "phkey" && dataSetMap.find(newSortKey) == dataSetMap.end()) {
+            cout << "ERROR: Sort key " << newSortKey << " is neither phkey nor a dataset from the mapping file." << endl;
+            abort();
+        }
+        if (newSortKey == "phkey") {
+            if (dataSetMap.find("/X") == dataSetMap.end() || dataSetMap.find("/Y") == dataSetMap.end() || dataSetMap.find("/Z") == dataSetMap.end()) {
+                cout << "ERROR: Sorting by phkey requires /X, /Y and /Z in the mapping file." << endl;
+                abort();
+            }
+        }
+        sortKey = newSortKey;
+        itemSources.clear();
+        sortMemory = newSortMemory;
+        sortTmpDir = newSortTmpDir;
+    }
+
+    void SagReader::setComputePHKey(bool newComputePHKey) {
+        if (newComputePHKey && (dataSetMap.find("/X") == dataSetMap.end() || dataSetMap.find("/Y") == dataSetMap.end() || dataSetMap.find("/Z") == dataSetMap.end())) {
+            cout << "ERROR: Computing phkey requires /X, /Y and /Z in the mapping file." << endl;
+            abort();
+        }
+        if (newComputePHKey && boxSize <= 0) {
+            cout << "ERROR: Computing phkey requires a positive boxSize." << endl;
+            abort();
+        }
+        computePHKey = newComputePHKey;
+        itemSources.clear();
+    }
+
+    void SagReader::setPHKeyParams(double newBoxSize, int newPhBits) {
+        if (newPhBits < 1 || newPhBits > 21) {
+            cout << "ERROR: Number of bits per dimension for phkey must be between 1 and 21." << endl;
+            abort();
+        }
+        boxSize = newBoxSize;
+        phBits = newPhBits;
+    }
+
 
     DataBlock::DataBlock() {
         nvalues = 0;
@@ -1039,35 +2005,112 @@ namespace Sag {
 
     void DataBlock::deleteData() {
         if (longval) {
-            delete longval;
+            delete[] longval;
+            longval = NULL;
             nvalues = 0;
         }
         if (tinyintval) {
-            delete tinyintval;
+            delete[] tinyintval;
+            tinyintval = NULL;
             nvalues = 0;
         }
-       if (doubleval) {
-            delete doubleval;
+        if (doubleval) {
+            delete[] doubleval;
+            doubleval = NULL;
             nvalues = 0;
         }
         if (floatval) {
-            delete floatval;
+            delete[] floatval;
+            floatval = NULL;
             nvalues = 0;
         }
 
     }
 
+    void DataBlock::allocData(long n) {
+        // allocate a buffer of the type given in type
+        if (type == "long") {
+            longval = new long[n];
+        } else if (type == "int8") {
+            tinyintval = new int8_t[n];
+        } else if (type == "double") {
+            doubleval = new double[n];
+        } else if (type == "float") {
+            floatval = new float[n];
+        } else {
+            cout << "ERROR: Cannot allocate data for DataBlock of type " << type << endl;
+            abort();
+        }
+        nvalues = n;
+    }
+
+    size_t DataBlock::getElemSize() {
+        if (longval || type == "long") {
+            return sizeof(long);
+        } else if (tinyintval || type == "int8") {
+            return sizeof(int8_t);
+        } else if (doubleval || type == "double") {
+            return sizeof(double);
+        } else {
+            return sizeof(float);
+        }
+    }
+
+    char* DataBlock::getValuePtr(long i) {
+        if (longval) {
+            return (char*) &longval[i];
+        } else if (tinyintval) {
+            return (char*) &tinyintval[i];
+        } else if (doubleval) {
+            return (char*) &doubleval[i];
+        } else {
+            return (char*) &floatval[i];
+        }
+    }
+
     OutputMeta::OutputMeta() {
         ioutput = 0;
+        snapnum = 0;
+        redshift = 0;
+        outputName = "";
         outputExpansionFactor = 0;
         outputTime = 0;
     };
 
     /* OutputMeta::deleteData() {
     }; */
+
+    ItemSource::ItemSource() {
+        kind = ALWAYS_NULL;
+        block = -1;
+        scaled = false;
+        size = 0;
+        data = NULL;
+    }
 }
 
 
+namespace Sag {
+    bool parseColumnName(const string name, string &dsname, int &comp) {
+        // split a column name from the mapping file like /Pos[1] into
+        // dataset name and column index; comp is -1, if no index is given
+        size_t open = name.find('[');
+        size_t close = name.find(']');
+
+        if (open == string::npos) {
+            dsname = name;
+            comp = -1;
+            return true;
+        }
+        if (close == string::npos || close < open + 2 || close != name.size() - 1) {
+            return false;
+        }
+        dsname = name.substr(0, open);
+        comp = atoi(name.substr(open + 1, close - open - 1).c_str());
+        return (comp >= 0);
+    }
+}
+
 // Here comes a call back function, thus it lives outside of the Sag-Reader class;
 // operator function, must reside outside of Sag-class, because it's extern C?
 herr_t file_info(hid_t loc_id, const char *name, const H5L_info_t *linfo, void *opdata) {
@@ -1113,7 +2156,7 @@ void scan_group(hid_t gid, void *opdata) {
     int otype;
     hid_t grpid;
     hid_t datatypeid;
-    id_t  dsid;
+    hid_t dsid;
     char group_name[MAX_NAME];
     char memb_name[MAX_NAME];
     char dataset_name[MAX_NAME];
@@ -25,6 +25,8 @@
 #include <list>
 #include <sstream>
 #include <map>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #ifndef Sag_Sag_Reader_h
 #define Sag_Sag_Reader_h
@@ -37,6 +39,21 @@ using namespace std;
 #include "H5Cpp.h"
 using namespace H5;
 
+#include "Sag_RowSorter.h"
+#include "Sag_ChunkReader.h"
+#include "Sag_ReadScheduler.h"
+#include "Sag_MultiReader.h"
+#include "Sag_ZoneMap.h"
+#include "Sag_Checksums.h"
+#include "Sag_MemoryBudget.h"
+#include "Sag_Metrics.h"
+#include "Sag_RowBatch.h"
+#include "Sag_Manifest.h"
+#include "Sag_VirtualFile.h"
+#include "Sag_BlockSizer.h"
+#include "Sag_Precision.h"
+#include "Sag_NullMap.h"
+
 extern "C" herr_t file_info(hid_t loc_id, const char *name, const H5L_info_t *linfo,
                                     void *opdata);
 extern "C" void scan_group(hid_t gid, void *opdata);
@@ -47,7 +64,8 @@ namespace Sag {
         public:
             int ioutput;
             int snapnum; // usually the same as ioutput, but we never know ...
-            string outputName;
+            string outputName; // name of the group, empty if datasets are at root level
+            float redshift;
             float outputExpansionFactor; // scale
             float outputTime;
 
@@ -70,11 +88,60 @@ namespace Sag {
             //DataBlock(DataBlock &source);
 
             void deleteData();
+            void allocData(long n);
+            size_t getElemSize();
+            char* getValuePtr(long i);
     };
     // This custom DataBlock-class is similar to the DataSet-class, 
     // but if using hyperslabs, it contains only a part of the data.
+
+    // How getDataItem serves an item, resolved once per output instead of
+    // comparing its name for each row.
+    class ItemSource {
+        public:
+            enum Kind {CONSTANT, DATASET, SNAPNUM, REDSHIFT, NINFILE, FILENUM, DBID, SORTED_PHKEY, PHKEY, ALWAYS_NULL};
+            Kind kind;
+            int block;      // index in datablocks (DATASET)
+            bool scaled;    // positions, multiplied by posfactor
+            size_t size;    // bytes of the value (CONSTANT, ALWAYS_NULL)
+            const void * data;  // value of a constant item (CONSTANT)
+
+            ItemSource();
+    };
+
+    // lock for all HDF5 calls, shared by all readers of the process
+    boost::recursive_mutex& sagH5Mutex();
+
+    // user settings for the reader, the same for each file
+    class ReaderSettings {
+        public:
+            long blocksize;
+            vector<int> snapnums;
+            string sortKey;
+            long sortMemory; // in bytes
+            string sortTmpDir;
+            double boxSize;
+            int phBits;
+            bool computePHKey;  // compute phkey for each row, also without sorting by it
+            int decompressThreads; // 0: let HDF5 decompress the chunks
+            bool ioOrder;       // read datasets in the order of their position in the file
+            long mergeGap;      // max. gap (bytes) between datasets read together, < 0: never
+            bool multiRead;     // read all datasets of a block with one call on open handles
+            ZoneMapWriter *zoneMap; // statistics of each block are written here, if set
+            ChecksumSet *checksums; // column checksums of the whole run are summed here, if set
+            MemoryBudget *memory;   // buffers are counted here and blocks shrunk to fit, if set
+            bool adaptiveBlocksize; // adapt the block size to the measured throughput
+            Metrics *metrics;       // rows, bytes and read times of the blocks are counted here, if set
+            map<string, ColumnPrecision> precisions; // precision reduction per column (from the mapping file)
+            map<string, ColumnNulls> nulls;         // values ingested as NULL per column (from the mapping file)
+
+            ReaderSettings();
+    };
+
+    // split a column name like /Pos[1] into dataset name and column index
+    bool parseColumnName(const string name, string &dsname, int &comp);
     
-    class SagReader : public Reader {
+    class SagReader : public Reader, public BroadcastSource {
     private:
         string fileName;
         string mapFile;
@@ -82,8 +149,11 @@ namespace Sag {
         ifstream fileStream;
 
         H5File* fp; //holds the opened hdf5 file
-        long ioutput; // number of current output
-        long numOutputs; // total number of outputs (one for reach redshift)
+        long ioutput; // number of current output (index in selectedOutputs)
+        long numOutputs; // total number of outputs (one for reach redshift) to be ingested
+        vector<OutputMeta> outputs; // all outputs found in the file
+        vector<int> selectedOutputs; // indices of the outputs matching user_snapnums
+        vector<string> fieldNames; // data file field names from the mapping file
         long numDataSets; // number of DataSets (= row fields, = columns) in each output
         long nvalues; // values in one dataset (assume the same number for each dataset of the same output group (redshift))
         long blocksize; // number of elements in one read-block, should be small enough to fit (blocksize * number of datasets) into memory
@@ -93,13 +163,17 @@ namespace Sag {
         float posfactor; // factor to multiply with coordinates, to get correct units (Mpc from kpc)
 
         vector<string> dataSetNames; // vector containing names of the HDF5 datasets
-        map<string,int> dataSetMap;
+        vector< vector<string> > dataSetColumns; // names of the columns (from mapping file) for each dataset
+        vector< vector<int> > dataSetComps; // column index in 2-dimensional datasets for each of them (-1 for 1-dim.)
+        map<string,int> dataSetMap; // column name -> index in datablocks
 
         // improve performance by defining it here (instead of inside getItemInRow)
         string tmpStr;
 
         long currRow;
+        long rowLimit; // stop before this row of the output (see setRowRange), -1: read all outputs
         long countInBlock;
+        long nInBlock; // number of rows in the current block
         int countSnap;
 
         int current_snapnum;
@@ -110,11 +184,91 @@ namespace Sag {
 
         int fileNum;
 
+        // source files of the current output, if its datasets are virtual;
+        // fileNum and NInFile then refer to the source file of each row
+        int baseFileNum;        // fileNum given for the (virtual) file
+        vector<VirtualSource> virtualSources;
+        int virtualSource;      // source of the current block, -1: none yet
+        long sourceFirstRow;    // first row of this source in the output
+
         int ix;
         int iy;
         int iz;
         long phkey;
 
+        // optional sorting of all rows of a file before serving them,
+        // e.g. by phkey, so that they arrive in clustered-index order
+        string sortKey;
+        long sortMemory;
+        string sortTmpDir;
+        RowSorter *sorter;
+        vector<long> blockRows;         // original row numbers of the current (sorted) block
+        vector<uint64_t> blockKeys;     // sort keys of the current (sorted) block
+        vector<DataBlock> sortedLayout; // names and types of the datablocks to be served
+
+        // parameters for computing Peano-Hilbert keys from positions
+        double boxSize;
+        int phBits;
+        bool computePHKey;
+
+        // optional parallel decompression of chunked datasets
+        ChunkReader *chunkReader;
+
+        // order of the dataset reads by position in the file
+        bool ioOrder;
+        ReadScheduler scheduler;
+        const char *prefetched; // data of the current dataset, if already read with others
+
+        // datasets of the current output kept open, read together for each block
+        bool multiRead;
+        MultiReader multiReader;
+
+        // optional statistics (zone maps) of each block
+        ZoneMapWriter *zoneMap;
+        ChecksumSet *checksums;
+
+        // optional live counters of the ingest; with countWritten, the
+        // consumed rows are counted as written (single writer, no queue)
+        Metrics *metrics;
+        bool countWritten;
+
+        // optional precision reduction of float columns, per column name
+        map<string, ColumnPrecision> precisions;
+
+        // optional values to be ingested as NULL, per column name, and
+        // which rows of each datablock of the current block are valid
+        map<string, ColumnNulls> nulls;
+        vector<ValidityMap> validity;
+
+        // items resolved so far for the current output (see getDataItem)
+        map<DataObjDesc*, ItemSource> itemSources;
+
+        // optional limit for the memory of the buffers
+        MemoryBudget *memory;
+        long columnBytes;       // bytes held by the datablocks of the current block
+        long rowBytes;          // bytes per row needed for reading a block (measured)
+        long readBufferBytes;   // temporary buffers while reading the current block
+        long readBufferPeak;
+
+        // incremented whenever snapnum, redshift or fileNum change
+        long broadcastVersion;
+
+        // optional hash of all values read (see hashBlock)
+        bool hashContent;
+        uint64_t contentHash;
+        long hashedRows;
+
+        // optional block size adapted at runtime: the last block is
+        // measured when the next one is requested
+        BlockSizer *blockSizer;
+        long lastBlockRows;
+        long lastReadMicroseconds;
+        boost::posix_time::ptime lastBlockEnd;
+
+        // time spent in readNextBlock and number of blocks read so far
+        long readMicroseconds;
+        long numBlocksRead;
+
 
         // define something to hold all datasets from one read block 
         // (one complete Output* block or a part of it)
@@ -127,18 +281,39 @@ namespace Sag {
         ~SagReader();
 
         void openFile(string newFileName);
+        void setFile(string newFileName, int newFileNum);
+        string getFileName();
+        void applySettings(const ReaderSettings &settings);
 
         void closeFile();
 
         void getMeta(vector<string> datafileFieldNames);
+        void readOutputAttributes(OutputMeta &o);
+        void selectOutput(long newIoutput);
+        void setUserSnapnums(vector<int> newSnapnums);
 
         int getNextRow();
         int readNextBlock(long blocksize);
+        void readDataSetBlocks(long offset, long nrows);
+        void readDataSet(int k, hsize_t *nblock, hsize_t *offset);
+        void writeBlockStats(long nrows);
+        void computeBlockStats(BlockStats &block, const vector<long> *rows, long nrows);
+        void addBlockStats(const BlockStats &block);
+        void readDataSetsMulti(const vector< vector<int> > &groups, long offset, long nrows);
+        void openMultiReader();
+        void getColumnRange(int k, hsize_t ncols, hsize_t &firstComp, hsize_t &ncomps);
+        char* addColumnBlocks(int k, DataBlock &first, char *rdata, bool direct, long nrows, long nvalues, hsize_t firstComp, hsize_t ncomps, size_t elemsize);
+        void copyPrefetched(const char *src, hsize_t ncols, hsize_t nrows, hsize_t firstComp, hsize_t ncomps, size_t elemsize, char *out);
+        void sortRows();
+        long readSortedBlock(long nrows);
+        uint64_t getRowSortKey(long i);
         long* readLongDataSet(const std::string s, long &nvalues, hsize_t *nblock, hsize_t *offset);
         int8_t* readTinyIntDataSet(const std::string s, long &nvalues, hsize_t *nblock, hsize_t *offset);
     
         double* readDoubleDataSet(const string s, long &nvalues, hsize_t *nblock, hsize_t *offset);
         float* readFloatDataSet(const std::string s, long &nvalues, hsize_t *nblock, hsize_t *offset);
+        void* readHyperslab(DataSet &dataset, const std::string s, const PredType &memtype, size_t elemsize, const std::string type, long &nvalues, hsize_t *nblock, hsize_t *offset);
+        int dataSetIndex(const std::string s);
  
         long getNumRowsInDataSet(string s);
 
@@ -148,6 +323,44 @@ namespace Sag {
         long getCurrRow();
         long getNumOutputs();
 
+        long getReadMicroseconds();
+        long getNumBlocksRead();
+
+        void setSortKey(string newSortKey, long newSortMemory, string newSortTmpDir);
+        void setPHKeyParams(double newBoxSize, int newPhBits);
+        void setComputePHKey(bool newComputePHKey);
+        uint64_t getRowPHKey(long i);
+        void setDecompressThreads(int numThreads);
+        void setIOOrder(bool newIOOrder, long newMergeGap);
+        void setMultiRead(bool newMultiRead);
+        void setAdaptiveBlocksize(bool adaptive);
+        void setZoneMap(ZoneMapWriter *newZoneMap);
+        void setChecksums(ChecksumSet *newChecksums);
+        void setMemoryBudget(MemoryBudget *newMemory);
+        void setMetrics(Metrics *newMetrics);
+        void setCountWritten(bool newCountWritten);
+        void setPrecisions(const map<string, ColumnPrecision> &newPrecisions);
+        void reducePrecision(long nrows);
+        void setNulls(const map<string, ColumnNulls> &newNulls);
+        void markBlockNulls(long nrows);
+        bool isAlwaysNull(const string &name);
+        ItemSource resolveItem(DBDataSchema::DataObjDesc * thisItem);
+        const ItemSource& getItemSource(DBDataSchema::DataObjDesc * thisItem);
+        long countRows();
+        void clearDataBlocks();
+        void countDataBlocks(long nrows);
+        long fitBlockRows(long nrows);
+        void addReadBuffer(long bytes);
+        void releaseReadBuffer(long bytes);
+        void setRowRange(long newIoutput, long firstRow, long nrows);
+        long selectVirtualSource(long row, long nrows);
+        void getRowSource(long row, int &rowFileNum, long &rowInFile);
+        void setContentHash(bool newHashContent);
+        void hashBlock(long nrows);
+        uint64_t getContentHash();
+        long getHashedRows();
+        void resetContentHash();
+
         int getSnapnum(long ioutput);
         
         bool getItemInRow(DBDataSchema::DataObjDesc * thisItem, bool applyAsserters, bool applyConverters, void* result);
@@ -155,6 +368,9 @@ namespace Sag {
         bool getDataItem(DBDataSchema::DataObjDesc * thisItem, void* result);
 
         void getConstItem(DBDataSchema::DataObjDesc * thisItem, void* result);
+
+        bool isBroadcastItem(DBDataSchema::DataObjDesc * thisItem);
+        long getBroadcastVersion();
     };
     
 }
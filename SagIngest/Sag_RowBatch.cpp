@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+#include <DType.h>
+#include "sagingest_error.h"
+
+#include "Sag_RowBatch.h"
+#include "Sag_Trace.h"
+
+using namespace std;
+using namespace DBDataSchema;
+
+namespace Sag {
+
+    RowLayout::RowLayout() {
+        rowSize = 0;
+    }
+
+    RowLayout::RowLayout(Schema * schema) {
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        int size;
+
+        rowSize = 0;
+        for (int j=0; j<items.size(); j++) {
+            if (items[j]->getDataDesc()->getDataObjDType() == DT_STRING) {
+                SagIngest_error("RowLayout: String columns are not supported for batched ingest.\n");
+            }
+            size = getByteLenOfDType(items[j]->getDataDesc()->getDataObjDType());
+            offsets.push_back(rowSize);
+            sizes.push_back(size);
+            rowSize += size;
+        }
+    }
+
+
+    double getItemDouble(DType dtype, const void * p) {
+        switch (dtype) {
+            case DT_REAL4: return *(const float*) p;
+            case DT_REAL8: return *(const double*) p;
+            default: return getItemLong(dtype, p);
+        }
+    }
+
+    long getItemLong(DType dtype, const void * p) {
+        switch (dtype) {
+            case DT_INT1: return *(const int8_t*) p;
+            case DT_INT2: return *(const int16_t*) p;
+            case DT_INT4: return *(const int32_t*) p;
+            case DT_INT8: return *(const int64_t*) p;
+            case DT_UINT1: return *(const uint8_t*) p;
+            case DT_UINT2: return *(const uint16_t*) p;
+            case DT_UINT4: return *(const uint32_t*) p;
+            case DT_UINT8: return *(const uint64_t*) p;
+            case DT_REAL4: return (long) *(const float*) p;
+            case DT_REAL8: return (long) *(const double*) p;
+            default: return 0;
+        }
+    }
+
+
+    RowBatch::RowBatch(long newBatchId, long maxRows, const RowLayout &layout, MemoryBudget * newBudget) {
+        batchId = newBatchId;
+        source = -1;
+        nrows = 0;
+        rowSize = layout.rowSize;
+        numItems = layout.sizes.size();
+        data.resize(maxRows * rowSize);
+        nulls.resize(maxRows * numItems);
+
+        budget = newBudget;
+        if (budget) {
+            budget->add(MemoryBudget::BATCHES, getBytes());
+        }
+    }
+
+    RowBatch::~RowBatch() {
+        if (budget) {
+            budget->release(MemoryBudget::BATCHES, getBytes());
+        }
+    }
+
+    long RowBatch::getBytes() {
+        return data.size() + nulls.size();
+    }
+
+    char* RowBatch::getRow(long i) {
+        return &data[i * rowSize];
+    }
+
+    char* RowBatch::getNulls(long i) {
+        return &nulls[i * numItems];
+    }
+
+    void RowBatch::setBroadcast(const vector<char> &newBroadcast) {
+        broadcast = newBroadcast;
+        broadcastRow.assign(rowSize, 0);
+        broadcastNulls.assign(numItems, 0);
+    }
+
+    bool RowBatch::isBroadcast(int j) {
+        return broadcast.size() > 0 && broadcast[j];
+    }
+
+
+    RowBatchQueue::RowBatchQueue(size_t newMaxBatches) {
+        maxBatches = max(newMaxBatches, (size_t) 1);
+        closed = false;
+        budget = NULL;
+        metrics = NULL;
+    }
+
+    void RowBatchQueue::push(RowBatch * batch) {
+        boost::posix_time::ptime startTime;
+        if (metrics || Tracer::isEnabled()) {
+            startTime = boost::posix_time::microsec_clock::universal_time();
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (batches.size() >= maxBatches) {
+                notFull.wait(lock);
+            }
+            batches.push_back(batch);
+            notEmpty.notify_one();
+        }
+        if (metrics || Tracer::isEnabled()) {
+            boost::posix_time::ptime endTime = boost::posix_time::microsec_clock::universal_time();
+            if (metrics) {
+                metrics->addLatency(Metrics::QUEUE_PUSH, (endTime-startTime).total_microseconds());
+            }
+            Tracer::add("queue_push", "queue", "", startTime, endTime);
+        }
+    }
+
+    RowBatch * RowBatchQueue::pop() {
+        RowBatch * batch;
+        boost::posix_time::ptime startTime;
+        if (metrics || Tracer::isEnabled()) {
+            startTime = boost::posix_time::microsec_clock::universal_time();
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (batches.empty() && !closed) {
+                notEmpty.wait(lock);
+            }
+            if (batches.empty()) {
+                return NULL;
+            }
+            batch = batches.front();
+            batches.pop_front();
+            notFull.notify_one();
+        }
+        if (metrics || Tracer::isEnabled()) {
+            boost::posix_time::ptime endTime = boost::posix_time::microsec_clock::universal_time();
+            if (metrics) {
+                metrics->addLatency(Metrics::QUEUE_POP, (endTime-startTime).total_microseconds());
+            }
+            Tracer::add("queue_pop", "queue", "", startTime, endTime);
+        }
+        return batch;
+    }
+
+    void RowBatchQueue::close() {
+        // no more batches will come; wake up all waiting consumers
+        boost::unique_lock<boost::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+    size_t RowBatchQueue::size() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return batches.size();
+    }
+
+    void RowBatchQueue::setMemoryBudget(MemoryBudget * newBudget) {
+        budget = newBudget;
+    }
+
+    MemoryBudget * RowBatchQueue::getMemoryBudget() {
+        return budget;
+    }
+
+    void RowBatchQueue::setMetrics(Metrics * newMetrics) {
+        metrics = newMetrics;
+    }
+
+    Metrics * RowBatchQueue::getMetrics() {
+        return metrics;
+    }
+
+
+    BatchProducer::BatchProducer(DBReader::Reader * newReader, Schema * newSchema, RowBatchQueue * newQueue, long newBatchRows) {
+        reader = newReader;
+        schema = newSchema;
+        queue = newQueue;
+        batchRows = newBatchRows;
+        layout = RowLayout(schema);
+        source = -1;
+
+        numBatches = 0;
+        numRows = 0;
+    }
+
+    void BatchProducer::setSource(int newSource) {
+        source = newSource;
+    }
+
+    long BatchProducer::run() {
+        // read all rows and push them to the queue in batches of batchRows
+        vector<SchemaItem*> items = schema->getArrSchemaItems();
+        RowBatch * batch = NULL;
+        MemoryBudget * budget = queue->getMemoryBudget();
+        long batchBytes = batchRows * (layout.rowSize + items.size());
+        char * row;
+        char * nulls;
+        boost::posix_time::ptime batchStart;   // for the trace
+
+        // items with the same value for many rows are read once per batch
+        BroadcastSource * broadcaster = dynamic_cast<BroadcastSource*>(reader);
+        vector<char> broadcast(items.size(), 0);
+        vector<int> rowItems;
+        vector<int> batchItems;
+        long version = 0;
+        for (int j=0; j<items.size(); j++) {
+            if (broadcaster && broadcaster->isBroadcastItem(items[j]->getDataDesc())) {
+                broadcast[j] = 1;
+                batchItems.push_back(j);
+            } else {
+                rowItems.push_back(j);
+            }
+        }
+
+        while (reader->getNextRow()) {
+            if (batch && batchItems.size() > 0 && broadcaster->getBroadcastVersion() != version) {
+                // new output or file: broadcast values may differ, new batch
+                traceBatch(batchStart);
+                queue->push(batch);
+                numBatches++;
+                batch = NULL;
+            }
+            if (!batch) {
+                if (budget) {
+                    // backpressure: wait for the writers to free batches
+                    budget->wait(MemoryBudget::BATCHES, batchBytes);
+                }
+                batch = new RowBatch(numBatches, batchRows, layout, budget);
+                batch->source = source;
+                if (Tracer::isEnabled()) {
+                    batchStart = boost::posix_time::microsec_clock::universal_time();
+                }
+                if (batchItems.size() > 0) {
+                    batch->setBroadcast(broadcast);
+                    for (int k=0; k<batchItems.size(); k++) {
+                        int j = batchItems[k];
+                        batch->broadcastNulls[j] = reader->getItemInRow(items[j]->getDataDesc(), true, true, &batch->broadcastRow[layout.offsets[j]]);
+                    }
+                    version = broadcaster->getBroadcastVersion();
+                }
+            }
+
+            row = batch->getRow(batch->nrows);
+            nulls = batch->getNulls(batch->nrows);
+            for (int k=0; k<rowItems.size(); k++) {
+                int j = rowItems[k];
+                nulls[j] = reader->getItemInRow(items[j]->getDataDesc(), true, true, row + layout.offsets[j]);
+            }
+            batch->nrows++;
+            numRows++;
+
+            if (batch->nrows == batchRows) {
+                traceBatch(batchStart);
+                queue->push(batch);
+                numBatches++;
+                batch = NULL;
+            }
+        }
+
+        if (batch) {
+            traceBatch(batchStart);
+            queue->push(batch);
+            numBatches++;
+        }
+
+        return numRows;
+    }
+
+    void BatchProducer::traceBatch(boost::posix_time::ptime batchStart) {
+        // time for filling one batch (reading the rows, including the
+        // block reads they trigger)
+        if (Tracer::isEnabled()) {
+            Tracer::add("build_batch", "transform", "", batchStart, boost::posix_time::microsec_clock::universal_time());
+        }
+    }
+
+    long BatchProducer::getNumBatches() {
+        return numBatches;
+    }
+
+    long BatchProducer::getNumRows() {
+        return numRows;
+    }
+
+}
@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Reader.h>
+#include <Schema.h>
+#include <DType.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <string.h>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "Sag_MemoryBudget.h"
+#include "Sag_Metrics.h"
+
+#ifndef Sag_Sag_RowBatch_h
+#define Sag_Sag_RowBatch_h
+
+namespace Sag {
+
+    // Layout of one row in a RowBatch: one fixed-size slot per schema item,
+    // in the order of the schema items.
+    class RowLayout {
+        public:
+            std::vector<int> offsets;
+            std::vector<int> sizes;
+            int rowSize;
+
+            RowLayout();
+            RowLayout(DBDataSchema::Schema * schema);
+    };
+
+
+    // numeric value of an item, as written by getItemInRow
+    double getItemDouble(DBDataSchema::DType dtype, const void * p);
+    long getItemLong(DBDataSchema::DType dtype, const void * p);
+
+    // copy a value of size bytes (as in RowLayout), the usual sizes without
+    // calling memcpy
+    inline void copyItem(void * result, const void * value, int size) {
+        switch (size) {
+            case 8: *(int64_t*) result = *(const int64_t*) value; break;
+            case 4: *(int32_t*) result = *(const int32_t*) value; break;
+            case 1: *(int8_t*) result = *(const int8_t*) value; break;
+            default: memcpy(result, value, size);
+        }
+    }
+
+
+    // A reader which knows items that have the same value for many rows
+    // (snapnum, fileNum, constants from the mapping file, ...). Producers
+    // of batches read them only once per batch.
+    class BroadcastSource {
+        public:
+            virtual ~BroadcastSource() {}
+
+            // same value for all rows until the broadcast version changes?
+            virtual bool isBroadcastItem(DBDataSchema::DataObjDesc * thisItem) = 0;
+
+            // changes whenever broadcast values may change (new output or file)
+            virtual long getBroadcastVersion() = 0;
+    };
+
+
+    // A number of rows, as they were returned by a reader's getItemInRow,
+    // together with their NULL flags. Broadcast items are stored only once
+    // for the whole batch, their slots in the rows are not used.
+    class RowBatch {
+        public:
+            long batchId;
+            int source;     // e.g. index of the file in a file list (-1: none)
+            long nrows;
+            int rowSize;
+            int numItems;
+            std::vector<char> data;
+            std::vector<char> nulls; // one flag per item and row
+            MemoryBudget * budget;   // counts the buffers of the batch, if not NULL
+
+            std::vector<char> broadcast;        // per item: same value for all rows? (empty: none)
+            std::vector<char> broadcastRow;     // values of the broadcast items, in the row layout
+            std::vector<char> broadcastNulls;
+
+            RowBatch(long newBatchId, long maxRows, const RowLayout &layout, MemoryBudget * newBudget = NULL);
+            ~RowBatch();
+
+            long getBytes();
+
+            char* getRow(long i);
+            char* getNulls(long i);
+
+            void setBroadcast(const std::vector<char> &newBroadcast);
+            bool isBroadcast(int j);
+    };
+
+
+    // Bounded queue of row batches: push blocks while the queue is full,
+    // pop blocks while it is empty and returns NULL once the queue was
+    // closed and all batches are taken.
+    class RowBatchQueue {
+    private:
+        std::deque<RowBatch*> batches;
+        size_t maxBatches;
+        bool closed;
+        MemoryBudget * budget;
+        Metrics * metrics;
+
+        boost::mutex mutex;
+        boost::condition_variable notFull;
+        boost::condition_variable notEmpty;
+
+    public:
+        RowBatchQueue(size_t newMaxBatches);
+
+        void push(RowBatch * batch);
+        RowBatch * pop();
+        void close();
+        size_t size();
+
+        // batches for this queue are counted in the budget, and producers
+        // wait when it is exhausted
+        void setMemoryBudget(MemoryBudget * newBudget);
+        MemoryBudget * getMemoryBudget();
+
+        // waiting times of push and pop are counted here, if set
+        void setMetrics(Metrics * newMetrics);
+        Metrics * getMetrics();
+    };
+
+
+    // Reads rows from a reader, the way DBIngestor::ingestData does, and
+    // packs them into batches for the queue.
+    class BatchProducer {
+    private:
+        DBReader::Reader * reader;
+        DBDataSchema::Schema * schema;
+        RowBatchQueue * queue;
+        long batchRows;
+        RowLayout layout;
+
+        int source;
+
+        long numBatches;
+        long numRows;
+
+        void traceBatch(boost::posix_time::ptime batchStart);
+
+    public:
+        BatchProducer(DBReader::Reader * newReader, DBDataSchema::Schema * newSchema, RowBatchQueue * newQueue, long newBatchRows);
+
+        // mark all batches with this source (see WriterPool::setFlushListener)
+        void setSource(int newSource);
+
+        long run();
+
+        long getNumBatches();
+        long getNumRows();
+    };
+
+}
+
+#endif
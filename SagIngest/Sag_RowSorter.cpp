@@ -0,0 +1,286 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "sagingest_error.h"
+
+#include "Sag_RowSorter.h"
+
+using namespace std;
+
+namespace Sag {
+
+    uint64_t peanoHilbertKey(uint32_t ix, uint32_t iy, uint32_t iz, int bits) {
+        // Transform the coordinates into the "transposed" Hilbert index,
+        // following J. Skilling, "Programming the Hilbert curve" (2004),
+        // then interleave the bits to get the key.
+        uint32_t x[3];
+        uint32_t m, p, q, t;
+        uint64_t key = 0;
+
+        x[0] = ix;
+        x[1] = iy;
+        x[2] = iz;
+
+        m = 1 << (bits-1);
+
+        // inverse undo
+        for (q = m; q > 1; q >>= 1) {
+            p = q - 1;
+            for (int i=0; i<3; i++) {
+                if (x[i] & q) {
+                    x[0] ^= p;  // invert
+                } else {
+                    t = (x[0] ^ x[i]) & p;  // exchange
+                    x[0] ^= t;
+                    x[i] ^= t;
+                }
+            }
+        }
+
+        // Gray encode
+        for (int i=1; i<3; i++) {
+            x[i] ^= x[i-1];
+        }
+        t = 0;
+        for (q = m; q > 1; q >>= 1) {
+            if (x[2] & q) {
+                t ^= q - 1;
+            }
+        }
+        for (int i=0; i<3; i++) {
+            x[i] ^= t;
+        }
+
+        for (int b=bits-1; b>=0; b--) {
+            for (int i=0; i<3; i++) {
+                key = (key << 1) | ((x[i] >> b) & 1);
+            }
+        }
+
+        return key;
+    }
+
+    uint64_t sortableKey(long value) {
+        // flip the sign bit, so that negative values come first
+        return ((uint64_t) value) ^ 0x8000000000000000ULL;
+    }
+
+    uint64_t sortableKey(double value) {
+        // positive values: flip the sign bit, negative values: flip all bits
+        uint64_t u;
+        memcpy(&u, &value, sizeof(u));
+        if (u & 0x8000000000000000ULL) {
+            return ~u;
+        }
+        return u ^ 0x8000000000000000ULL;
+    }
+
+
+    bool MergeItem::operator>(const MergeItem &other) const {
+        if (key != other.key) {
+            return key > other.key;
+        }
+        return row > other.row;
+    }
+
+    static bool compareEntries(const SortEntry &a, const SortEntry &b) {
+        if (a.key != b.key) {
+            return a.key < b.key;
+        }
+        return a.row < b.row;
+    }
+
+
+    RowSorter::RowSorter(size_t newPayloadSize, size_t newMaxMemory, string newTmpDir) {
+        payloadSize = newPayloadSize;
+        maxMemory = newMaxMemory;
+        tmpDir = newTmpDir;
+
+        numRows = 0;
+        finished = false;
+        nextEntry = 0;
+    }
+
+    RowSorter::~RowSorter() {
+        for (int k=0; k<runs.size(); k++) {
+            fclose(runs[k]);
+        }
+        runs.clear();
+    }
+
+    void RowSorter::addRow(uint64_t key, long row, const char *payload) {
+        SortEntry e;
+
+        if (finished) {
+            SagIngest_error("RowSorter: Cannot add rows after sorting has finished.\n");
+        }
+
+        e.key = key;
+        e.row = row;
+        e.pos = arena.size();
+        entries.push_back(e);
+        arena.insert(arena.end(), payload, payload + payloadSize);
+        numRows++;
+
+        // write a sorted run to disk, if we exceed the memory limit
+        if (entries.size() * sizeof(SortEntry) + arena.size() >= maxMemory) {
+            spillRun();
+        }
+    }
+
+    void RowSorter::spillRun() {
+        // sort the rows currently in memory and write them to a temporary
+        // file (key, row, payload for each row)
+        string tmpName;
+        int fd;
+        FILE *f;
+
+        if (entries.size() == 0) {
+            return;
+        }
+
+        sort(entries.begin(), entries.end(), compareEntries);
+
+        tmpName = tmpDir + "/SagIngest_sortrun_XXXXXX";
+        vector<char> tmpNameBuf(tmpName.begin(), tmpName.end());
+        tmpNameBuf.push_back('\0');
+        fd = mkstemp(&tmpNameBuf[0]);
+        if (fd < 0) {
+            SagIngest_error("RowSorter: Cannot create temporary file for sorting.\n");
+        }
+        // the file is removed as soon as it is closed
+        unlink(&tmpNameBuf[0]);
+        f = fdopen(fd, "w+b");
+        if (!f) {
+            close(fd);
+            SagIngest_error("RowSorter: Cannot open temporary file for sorting.\n");
+        }
+        // the buffer must be set before the first operation on the stream;
+        // it is used for writing the run now and for merging it later
+        setvbuf(f, NULL, _IOFBF, runBufferSize);
+
+        for (long i=0; i<entries.size(); i++) {
+            if (fwrite(&entries[i].key, sizeof(uint64_t), 1, f) != 1
+                || fwrite(&entries[i].row, sizeof(long), 1, f) != 1
+                || fwrite(&arena[entries[i].pos], 1, payloadSize, f) != payloadSize) {
+                SagIngest_error("RowSorter: Error in writing sorted run to disk (disk full?).\n");
+            }
+        }
+        fflush(f);
+        runs.push_back(f);
+
+        cout << "RowSorter: wrote sorted run " << runs.size() << " with " << entries.size() << " rows" << endl;
+
+        entries.clear();
+        arena.clear();
+    }
+
+    // buffer of each run file; the runs are read sequentially while
+    // merging, larger buffers do not help much
+    const size_t RowSorter::runBufferSize = 1048576;
+
+    bool RowSorter::readRunRecord(int run, MergeItem &item) {
+        FILE *f = runs[run];
+
+        if (fread(&item.key, sizeof(uint64_t), 1, f) != 1) {
+            return false;
+        }
+        if (fread(&item.row, sizeof(long), 1, f) != 1
+            || fread(&runHeads[run][0], 1, payloadSize, f) != payloadSize) {
+            SagIngest_error("RowSorter: Error in reading sorted run from disk.\n");
+        }
+        item.run = run;
+        return true;
+    }
+
+    void RowSorter::finish() {
+        MergeItem item;
+
+        finished = true;
+        nextEntry = 0;
+
+        if (runs.size() == 0) {
+            // everything fits into memory, just sort it
+            sort(entries.begin(), entries.end(), compareEntries);
+            return;
+        }
+
+        // write the remaining rows as last run, then prepare the k-way merge
+        spillRun();
+
+        runHeads.resize(runs.size(), vector<char>(payloadSize));
+        for (int k=0; k<runs.size(); k++) {
+            rewind(runs[k]);
+            if (readRunRecord(k, item)) {
+                mergeQueue.push(item);
+            }
+        }
+        cout << "RowSorter: merging " << runs.size() << " sorted runs" << endl;
+    }
+
+    bool RowSorter::nextRow(uint64_t &key, long &row, char *payload) {
+        MergeItem item;
+
+        if (!finished) {
+            SagIngest_error("RowSorter: Call finish() before reading sorted rows.\n");
+        }
+
+        if (runs.size() == 0) {
+            if (nextEntry >= entries.size()) {
+                return false;
+            }
+            key = entries[nextEntry].key;
+            row = entries[nextEntry].row;
+            memcpy(payload, &arena[entries[nextEntry].pos], payloadSize);
+            nextEntry++;
+            return true;
+        }
+
+        if (mergeQueue.empty()) {
+            return false;
+        }
+
+        item = mergeQueue.top();
+        mergeQueue.pop();
+        key = item.key;
+        row = item.row;
+        memcpy(payload, &runHeads[item.run][0], payloadSize);
+
+        // refill from the run we just took the row from
+        if (readRunRecord(item.run, item)) {
+            mergeQueue.push(item);
+        }
+
+        return true;
+    }
+
+    long RowSorter::getNumRows() {
+        return numRows;
+    }
+
+    long RowSorter::getNumRuns() {
+        return runs.size();
+    }
+
+}
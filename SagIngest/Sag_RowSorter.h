@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef Sag_Sag_RowSorter_h
+#define Sag_Sag_RowSorter_h
+
+namespace Sag {
+
+    // Peano-Hilbert key of a grid cell, with bits bits per dimension
+    // (at most 21, so that the key fits into 63 bits)
+    uint64_t peanoHilbertKey(uint32_t ix, uint32_t iy, uint32_t iz, int bits);
+
+    // map signed integers and floating point values to unsigned keys
+    // that sort in the same order as the original values
+    uint64_t sortableKey(long value);
+    uint64_t sortableKey(double value);
+
+
+    class SortEntry {
+        public:
+            uint64_t key;
+            long row;   // row number in the data file
+            long pos;   // position of the row payload in the arena
+    };
+
+
+    class MergeItem {
+        public:
+            uint64_t key;
+            long row;
+            int run;    // index of the run this item comes from
+
+            bool operator>(const MergeItem &other) const;
+    };
+
+
+    // Sorts fixed-size rows by a 64 bit key. Rows are kept in memory as long
+    // as they fit into maxMemory bytes, otherwise sorted runs are written to
+    // temporary files in tmpDir and merged when the rows are read back.
+    // Rows with equal keys keep their original order.
+    class RowSorter {
+    private:
+        size_t payloadSize;  // number of bytes per row (without key and row number)
+        size_t maxMemory;
+        std::string tmpDir;
+
+        std::vector<SortEntry> entries;
+        std::vector<char> arena;
+        long numRows;
+
+        std::vector<FILE*> runs;
+        std::vector< std::vector<char> > runHeads; // current payload of each run
+        std::priority_queue< MergeItem, std::vector<MergeItem>, std::greater<MergeItem> > mergeQueue;
+
+        bool finished;
+        long nextEntry;
+
+        static const size_t runBufferSize;
+
+        void spillRun();
+        bool readRunRecord(int run, MergeItem &item);
+
+    public:
+        RowSorter(size_t newPayloadSize, size_t newMaxMemory, std::string newTmpDir);
+        ~RowSorter();
+
+        void addRow(uint64_t key, long row, const char *payload);
+        void finish();
+        bool nextRow(uint64_t &key, long &row, char *payload);
+
+        long getNumRows();
+        long getNumRuns();
+    };
+
+}
+
+#endif
@@ -92,6 +92,8 @@ namespace Sag {
 
         datafileFields.clear();
         databaseFields.clear();
+        precisions.clear();
+        nulls.clear();
 
         char *piece = NULL;
         char linechar[1024] = "";
@@ -126,6 +128,54 @@ namespace Sag {
                 dataField.type = type.c_str();
                 databaseFields.push_back(dataField);
 
+                // optional precision and NULL options after the database type
+                ColumnPrecision precision;
+                ColumnNulls columnNulls;
+                string option;
+                bool hasPrecision = false;
+                bool hasNulls = false;
+                while (ss >> option && option[0] != '#') {
+                    if (option.compare(0, 5, "null=") == 0) {
+                        if (!columnNulls.parseOption(option)) {
+                            cout << "ERROR: Invalid NULL value in '" << option << "' for " << datafileFields.back().name << " in the mapping file." << endl;
+                            abort();
+                        }
+                        hasNulls = true;
+                    } else if (precision.parseOption(option)) {
+                        hasPrecision = true;
+                    } else {
+                        cout << "ERROR: Unknown option '" << option << "' for " << datafileFields.back().name << " in the mapping file." << endl;
+                        abort();
+                    }
+                }
+                if (hasPrecision) {
+                    string fileType = datafileFields.back().type;
+                    int maxBits = (fileType == "REAL4" || precision.toFloat) ? 23 : 52;
+                    if (fileType != "REAL4" && fileType != "REAL8") {
+                        cout << "ERROR: Precision options are only possible for REAL4 and REAL8 columns (" << datafileFields.back().name << ")." << endl;
+                        abort();
+                    }
+                    if (precision.toFloat && fileType != "REAL4") {
+                        cout << "ERROR: " << datafileFields.back().name << " is read as float, its type must be REAL4." << endl;
+                        abort();
+                    }
+                    if (precision.mantissaBits != -1 && (precision.mantissaBits < 1 || precision.mantissaBits > maxBits)) {
+                        cout << "ERROR: Mantissa bits for " << datafileFields.back().name << " must be between 1 and " << maxBits << "." << endl;
+                        abort();
+                    }
+                    precisions[datafileFields.back().name] = precision;
+                }
+                if (hasNulls) {
+                    checkNulls(datafileFields.back(), columnNulls);
+                    nulls[datafileFields.back().name] = columnNulls;
+                } else if (isUnfilledColumn(datafileFields.back().name)) {
+                    // these columns are filled later on, NULL unless stated otherwise
+                    nulls[datafileFields.back().name].always = true;
+                }
+                // ignore anything left on the line
+                ss.str("");
+                ss.clear();
+
             }
 
         }
@@ -141,12 +191,52 @@ namespace Sag {
         for (int j=0; j<datafileFields.size(); j++) {
             cout << "  Fieldnames " << j << ":" << datafileFields[j].name << ", " << databaseFields[j].name << endl;
             cout << "  Fieldtypes " << j << ":" << datafileFields[j].type << ", " << databaseFields[j].type << endl;
+            if (precisions.count(datafileFields[j].name)) {
+                cout << "  Precision " << j << ":" << precisions[datafileFields[j].name].describe() << endl;
+            }
+            if (nulls.count(datafileFields[j].name)) {
+                cout << "  Nulls " << j << ":" << nulls[datafileFields[j].name].describe() << endl;
+            }
         }
 
         return datafileFieldNames;
 
     }
 
+    map<string, ColumnPrecision> SagSchemaMapper::getPrecisions() {
+        return precisions;
+    }
+
+    map<string, ColumnNulls> SagSchemaMapper::getNulls() {
+        return nulls;
+    }
+
+    bool SagSchemaMapper::isUnfilledColumn(string name) {
+        // computed columns which the reader cannot fill (yet)
+        return (name == "forestId" || name == "depthFirstId" || name == "ix" || name == "iy" || name == "iz");
+    }
+
+    void SagSchemaMapper::checkNulls(const DataField &field, ColumnNulls &columnNulls) {
+        // stop with an error, if the NULL options do not fit the column type
+        bool isReal = (field.type == "REAL4" || field.type == "REAL8");
+        if (field.name.substr(0, 1) != "/" && !columnNulls.always) {
+            cout << "ERROR: Only null=always is possible for the computed column " << field.name << "." << endl;
+            abort();
+        }
+        if (!isReal && !columnNulls.always && !columnNulls.hasOnlyIntegers()) {
+            cout << "ERROR: " << field.name << " is an integer column, its NULL values must be integers." << endl;
+            abort();
+        }
+        if (field.type == "INT1") {
+            for (int s=0; s<columnNulls.intSentinels.size(); s++) {
+                if (columnNulls.intSentinels[s] < -128 || columnNulls.intSentinels[s] > 127) {
+                    cout << "ERROR: NULL value " << columnNulls.intSentinels[s] << " is out of range for " << field.name << " (INT1)." << endl;
+                    abort();
+                }
+            }
+        }
+    }
+
     DBDataSchema::Schema * SagSchemaMapper::generateSchema(string dbName, string tblName) {
         DBDataSchema::Schema * returnSchema = new Schema();
 
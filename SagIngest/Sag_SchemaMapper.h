@@ -30,6 +30,9 @@
 #include <fstream>
 #include <map>
 
+#include "Sag_Precision.h"
+#include "Sag_NullMap.h"
+
 #ifndef Sag_Sag_SchemaMapper_h
 #define Sag_Sag_SchemaMapper_h
 
@@ -61,6 +64,15 @@ namespace Sag {
 
         std::vector<DataField> datafileFields, databaseFields;
 
+        // optional precision reduction per data file column
+        std::map<std::string, ColumnPrecision> precisions;
+
+        // optional values to be ingested as NULL, per data file column
+        std::map<std::string, ColumnNulls> nulls;
+
+        bool isUnfilledColumn(std::string name);
+        void checkNulls(const DataField &field, ColumnNulls &columnNulls);
+
         
     public:
         SagSchemaMapper();
@@ -73,6 +85,9 @@ namespace Sag {
 
         DBType getDBType(std::string thisDBType);
 
+        std::map<std::string, ColumnPrecision> getPrecisions();
+        std::map<std::string, ColumnNulls> getNulls();
+
         DBDataSchema::Schema * generateSchema(std::string dbName, std::string tblName);
 
         //std::vector<DataField> datafileFields, databaseFields; // make it public, so I can access it from the reader as well
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "Sag_ThreadPool.h"
+
+using namespace std;
+
+namespace Sag {
+
+    ThreadPool::ThreadPool(int numThreads) {
+        numRunning = 0;
+        stopping = false;
+        for (int i=0; i<numThreads; i++) {
+            threads.push_back(new boost::thread(&ThreadPool::runWorker, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            stopping = true;
+            taskAvailable.notify_all();
+        }
+        for (int i=0; i<threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+    }
+
+    void ThreadPool::runWorker() {
+        PoolTask * task;
+
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (tasks.empty() && !stopping) {
+                    taskAvailable.wait(lock);
+                }
+                if (tasks.empty()) {
+                    return;
+                }
+                task = tasks.front();
+                tasks.pop_front();
+                numRunning++;
+            }
+
+            task->run();
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                numRunning--;
+                if (tasks.empty() && numRunning == 0) {
+                    allDone.notify_all();
+                }
+            }
+        }
+    }
+
+    void ThreadPool::submit(PoolTask * task) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        tasks.push_back(task);
+        taskAvailable.notify_one();
+    }
+
+    void ThreadPool::wait() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!tasks.empty() || numRunning > 0) {
+            allDone.wait(lock);
+        }
+    }
+
+    int ThreadPool::getNumThreads() {
+        return threads.size();
+    }
+
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <vector>
+#include <deque>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#ifndef Sag_Sag_ThreadPool_h
+#define Sag_Sag_ThreadPool_h
+
+namespace Sag {
+
+    // a piece of work for the thread pool
+    class PoolTask {
+        public:
+            virtual ~PoolTask() {}
+            virtual void run() = 0;
+    };
+
+
+    // Fixed number of worker threads executing submitted tasks. The tasks
+    // are not owned by the pool; wait() returns when all submitted tasks
+    // are finished.
+    class ThreadPool {
+    private:
+        std::vector<boost::thread*> threads;
+        std::deque<PoolTask*> tasks;
+        long numRunning;
+        bool stopping;
+
+        boost::mutex mutex;
+        boost::condition_variable taskAvailable;
+        boost::condition_variable allDone;
+
+        void runWorker();
+
+    public:
+        ThreadPool(int numThreads);
+        ~ThreadPool();
+
+        void submit(PoolTask * task);
+        void wait();
+
+        int getNumThreads();
+    };
+
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <stdlib.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "Sag_Trace.h"
+
+using namespace std;
+
+namespace Sag {
+
+    // one complete span in microseconds since the start of the trace
+    class TraceEvent {
+        public:
+            const char *name;
+            const char *category;
+            string detail;
+            long start;
+            long duration;
+            int thread;
+    };
+
+    // more events are dropped (about 100 MB of JSON)
+    static const size_t maxEvents = 1000000;
+
+    class TraceLog {
+        public:
+            boost::mutex mutex;
+            string fileName;
+            boost::posix_time::ptime startTime;
+            vector<TraceEvent> events;
+            long dropped;
+            map<boost::thread::id, int> threads;
+            map<int, string> threadNames;
+
+            TraceLog() {
+                dropped = 0;
+            }
+
+            // small, stable number for the calling thread; mutex must be held
+            int threadIndex() {
+                boost::thread::id id = boost::this_thread::get_id();
+                map<boost::thread::id, int>::iterator it = threads.find(id);
+                if (it == threads.end()) {
+                    it = threads.insert(make_pair(id, (int) threads.size())).first;
+                }
+                return it->second;
+            }
+    };
+
+    static bool traceEnabled = false;
+
+    static TraceLog& traceLog() {
+        static TraceLog log;
+        return log;
+    }
+
+    static void writeTraceAtExit() {
+        Tracer::write();
+    }
+
+    void Tracer::enable(string fileName) {
+        TraceLog &log = traceLog();
+        log.fileName = fileName;
+        log.startTime = boost::posix_time::microsec_clock::universal_time();
+        log.events.reserve(10000);
+        setThreadName("main");
+        traceEnabled = true;
+        // also covers the exits on errors
+        atexit(writeTraceAtExit);
+    }
+
+    bool Tracer::isEnabled() {
+        return traceEnabled;
+    }
+
+    void Tracer::add(const char *name, const char *category, const string &detail,
+                     boost::posix_time::ptime start, boost::posix_time::ptime end) {
+        if (!traceEnabled) {
+            return;
+        }
+        TraceLog &log = traceLog();
+        boost::unique_lock<boost::mutex> lock(log.mutex);
+        if (log.events.size() >= maxEvents) {
+            log.dropped++;
+            return;
+        }
+        TraceEvent e;
+        e.name = name;
+        e.category = category;
+        e.detail = detail;
+        e.start = (start - log.startTime).total_microseconds();
+        e.duration = (end - start).total_microseconds();
+        e.thread = log.threadIndex();
+        log.events.push_back(e);
+    }
+
+    void Tracer::setThreadName(const string &name) {
+        TraceLog &log = traceLog();
+        boost::unique_lock<boost::mutex> lock(log.mutex);
+        log.threadNames[log.threadIndex()] = name;
+    }
+
+    static string jsonString(const string &s) {
+        stringstream out;
+        out << '"';
+        for (int i=0; i<s.size(); i++) {
+            unsigned char c = s[i];
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out << buf;
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+        return out.str();
+    }
+
+    void Tracer::write() {
+        if (!traceEnabled) {
+            return;
+        }
+        TraceLog &log = traceLog();
+        boost::unique_lock<boost::mutex> lock(log.mutex);
+        traceEnabled = false;
+
+        ofstream out(log.fileName.c_str());
+        if (!out) {
+            cout << "Warning: Cannot write the trace file " << log.fileName << "." << endl;
+            return;
+        }
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for (map<int, string>::iterator it = log.threadNames.begin(); it != log.threadNames.end(); it++) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it->first
+                << ",\"args\":{\"name\":" << jsonString(it->second) << "}}";
+            first = false;
+        }
+        for (size_t i=0; i<log.events.size(); i++) {
+            TraceEvent &e = log.events[i];
+            out << (first ? "" : ",\n") << "{\"name\":" << jsonString(e.name) << ",\"cat\":" << jsonString(e.category)
+                << ",\"ph\":\"X\",\"ts\":" << e.start << ",\"dur\":" << e.duration << ",\"pid\":1,\"tid\":" << e.thread;
+            if (e.detail != "") {
+                out << ",\"args\":{\"detail\":" << jsonString(e.detail) << "}";
+            }
+            out << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+
+        cout << "Trace: " << log.events.size() << " spans written to " << log.fileName;
+        if (log.dropped > 0) {
+            cout << " (" << log.dropped << " dropped)";
+        }
+        cout << endl;
+    }
+
+
+    TraceSpan::TraceSpan(const char *newName, const char *newCategory, const string &newDetail) {
+        name = newName;
+        category = newCategory;
+        if (traceEnabled) {
+            detail = newDetail;
+            start = boost::posix_time::microsec_clock::universal_time();
+        }
+    }
+
+    TraceSpan::~TraceSpan() {
+        if (traceEnabled && !start.is_not_a_date_time()) {
+            Tracer::add(name, category, detail, start, boost::posix_time::microsec_clock::universal_time());
+        }
+    }
+
+}
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifndef Sag_Sag_Trace_h
+#define Sag_Sag_Trace_h
+
+namespace Sag {
+
+    // Optional timeline of the ingest: spans (name, category, an optional
+    // detail like the dataset name, start, duration and thread) recorded
+    // by all threads and written as Chrome trace-event JSON, to be loaded
+    // e.g. in chrome://tracing or ui.perfetto.dev. Recording is off unless
+    // enable() was called; then each span costs one lock.
+    class Tracer {
+    public:
+        // start recording; the file is written when the process exits
+        static void enable(std::string fileName);
+        static bool isEnabled();
+
+        static void add(const char *name, const char *category, const std::string &detail,
+                        boost::posix_time::ptime start, boost::posix_time::ptime end);
+
+        // label of the calling thread in the timeline
+        static void setThreadName(const std::string &name);
+
+        static void write();
+    };
+
+
+    // Records the time from its construction to its destruction as one
+    // span, if tracing is enabled.
+    class TraceSpan {
+    private:
+        const char *name;
+        const char *category;
+        std::string detail;
+        boost::posix_time::ptime start;
+
+    public:
+        TraceSpan(const char *newName, const char *newCategory, const std::string &newDetail = "");
+        ~TraceSpan();
+    };
+
+}
+
+#endif
@@ -0,0 +1,394 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include "Sag_VirtualFile.h"
+#include "Sag_Reader.h"
+#include "Sag_DirWatcher.h"
+#include "Sag_Manifest.h"
+
+using namespace std;
+
+namespace Sag {
+
+    VirtualSource::VirtualSource() {
+        fileNum = 0;
+        firstRow = 0;
+        nrows = 0;
+    }
+
+
+    // a mapped dataset of one output group, as found in the first file having it
+    class VirtualDataSet {
+        public:
+            string name;        // relative to the output group
+            hid_t type;
+            int rank;
+            hsize_t ncols;
+            vector<hid_t> spaces; // source dataspace in each file (-1: not there)
+    };
+
+    class VirtualOutput {
+        public:
+            string outputName;  // "" for the root group
+            float redshift;
+            int snapnum;
+            vector<VirtualDataSet> dataSets;
+            vector<long> rows;  // rows in each file (-1: output not in the file)
+    };
+
+    // does the path (relative to loc) exist, including all groups on the way?
+    static bool pathExists(hid_t loc, const string &path) {
+        size_t pos = 0;
+        while (pos != string::npos) {
+            pos = path.find('/', pos + 1);
+            string part = path.substr(0, pos);
+            if (part != "" && part != "/" && H5Lexists(loc, part.c_str(), H5P_DEFAULT) <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void readGroupAttributes(hid_t fid, VirtualOutput &o) {
+        hid_t group = H5Gopen2(fid, (o.outputName == "") ? "/" : o.outputName.c_str(), H5P_DEFAULT);
+
+        if (H5Aexists(group, "Redshift") <= 0) {
+            cout << "ERROR: No Redshift attribute found for group " << ((o.outputName == "") ? "/" : o.outputName) << endl;
+            abort();
+        }
+        hid_t att = H5Aopen(group, "Redshift", H5P_DEFAULT);
+        H5Aread(att, H5T_NATIVE_FLOAT, &o.redshift);
+        H5Aclose(att);
+
+        if (H5Aexists(group, "Snapshot") > 0) {
+            att = H5Aopen(group, "Snapshot", H5P_DEFAULT);
+            H5Aread(att, H5T_NATIVE_INT, &o.snapnum);
+            H5Aclose(att);
+        } else if (o.outputName != "") {
+            o.snapnum = atoi(o.outputName.substr(7).c_str());
+        } else {
+            cout << "ERROR: No Snapshot attribute found for group /" << endl;
+            abort();
+        }
+        H5Gclose(group);
+    }
+
+    static void writeScalarAttribute(hid_t loc, const char *name, hid_t type, const void *value) {
+        hid_t space = H5Screate(H5S_SCALAR);
+        hid_t att = H5Acreate2(loc, name, type, space, H5P_DEFAULT, H5P_DEFAULT);
+        H5Awrite(att, type, value);
+        H5Aclose(att);
+        H5Sclose(space);
+    }
+
+    void buildVirtualFile(const string &virtualFile, const vector<string> &fileNames,
+                          const vector<int> &fileNums, const vector<string> &fieldNames) {
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        vector<VirtualOutput> outputs;
+        map<string, int> outputIndex;
+        vector<string> sourceNames;
+
+        // dataset names of the mapping file, each once
+        vector<string> names;
+        for (int j=0; j<fieldNames.size(); j++) {
+            string dsname;
+            int comp;
+            if (parseColumnName(fieldNames[j], dsname, comp) && find(names.begin(), names.end(), dsname) == names.end()) {
+                names.push_back(dsname);
+            }
+        }
+
+        // find the outputs and sizes of the mapped datasets in each file
+        for (int i=0; i<fileNames.size(); i++) {
+            hid_t fid = H5Fopen(fileNames[i].c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            if (fid < 0) {
+                cout << "ERROR: Cannot open " << fileNames[i] << " for the virtual file." << endl;
+                abort();
+            }
+            // the virtual file refers to the sources by their absolute path
+            sourceNames.push_back(canonicalPath(fileNames[i]));
+
+            vector<string> groupNames;
+            hid_t root = H5Gopen2(fid, "/", H5P_DEFAULT);
+            hsize_t nobj;
+            char memb_name[1024];
+            H5Gget_num_objs(root, &nobj);
+            for (hsize_t n=0; n<nobj; n++) {
+                H5Gget_objname_by_idx(root, n, memb_name, (size_t) 1024);
+                if (H5Gget_objtype_by_idx(root, (size_t) n) == H5G_GROUP && string(memb_name).compare(0, 6, "Output") == 0) {
+                    groupNames.push_back(string("/") + memb_name);
+                }
+            }
+            H5Gclose(root);
+            if (groupNames.size() == 0) {
+                groupNames.push_back("");
+            }
+            if (outputs.size() > 0 && (groupNames[0] == "") != (outputs[0].outputName == "")) {
+                cout << "ERROR: " << fileNames[i] << " has " << ((groupNames[0] == "") ? "no" : "") << " Output groups, unlike the other files of the virtual file." << endl;
+                abort();
+            }
+
+            for (int g=0; g<groupNames.size(); g++) {
+                map<string, int>::iterator it = outputIndex.find(groupNames[g]);
+                if (it == outputIndex.end()) {
+                    it = outputIndex.insert(make_pair(groupNames[g], (int) outputs.size())).first;
+                    outputs.push_back(VirtualOutput());
+                    outputs.back().outputName = groupNames[g];
+                    readGroupAttributes(fid, outputs.back());
+                }
+                VirtualOutput &o = outputs[it->second];
+                o.rows.resize(fileNames.size(), -1);
+
+                for (int k=0; k<names.size(); k++) {
+                    string path = o.outputName + names[k];
+                    if (!pathExists(fid, path)) {
+                        continue;
+                    }
+                    int d;
+                    for (d=0; d<o.dataSets.size() && o.dataSets[d].name != names[k]; d++);
+                    if (d == o.dataSets.size()) {
+                        VirtualDataSet v;
+                        v.name = names[k];
+                        v.type = -1;
+                        v.rank = 0;
+                        v.ncols = 1;
+                        o.dataSets.push_back(v);
+                    }
+                    VirtualDataSet &v = o.dataSets[d];
+                    v.spaces.resize(fileNames.size(), -1);
+
+                    hid_t dset = H5Dopen2(fid, path.c_str(), H5P_DEFAULT);
+                    hid_t space = H5Dget_space(dset);
+                    hid_t ftype = H5Dget_type(dset);
+                    hsize_t dims[2] = {0, 1};
+                    int rank = H5Sget_simple_extent_ndims(space);
+                    H5Sget_simple_extent_dims(space, dims, NULL);
+
+                    if (v.type < 0) {
+                        v.type = H5Tcopy(ftype);
+                        v.rank = rank;
+                        v.ncols = (rank == 2) ? dims[1] : 1;
+                    } else if (H5Tequal(ftype, v.type) <= 0 || rank != v.rank || (rank == 2 && dims[1] != v.ncols)) {
+                        cout << "ERROR: Dataset " << path << " in " << fileNames[i] << " has another type or shape than in the other files." << endl;
+                        abort();
+                    }
+                    if (o.rows[i] >= 0 && o.rows[i] != (long) dims[0]) {
+                        cout << "ERROR: Datasets of " << ((o.outputName == "") ? "/" : o.outputName) << " in " << fileNames[i] << " have different numbers of rows." << endl;
+                        abort();
+                    }
+                    o.rows[i] = dims[0];
+                    v.spaces[i] = space;
+                    H5Tclose(ftype);
+                    H5Dclose(dset);
+                }
+            }
+            H5Fclose(fid);
+        }
+
+        // one virtual dataset per output and mapped dataset, one mapping per file
+        hid_t vfid = H5Fcreate(virtualFile.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if (vfid < 0) {
+            cout << "ERROR: Cannot create the virtual file " << virtualFile << "." << endl;
+            abort();
+        }
+        hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+        H5Pset_create_intermediate_group(lcpl, 1);
+
+        for (int g=0; g<outputs.size(); g++) {
+            VirtualOutput &o = outputs[g];
+            long total = 0;
+            vector<int> outputFileNums;
+            for (int i=0; i<o.rows.size(); i++) {
+                if (o.rows[i] > 0) {
+                    total += o.rows[i];
+                    outputFileNums.push_back(fileNums[i]);
+                }
+            }
+            if (total == 0) {
+                continue;
+            }
+
+            hid_t group = (o.outputName == "") ? H5Gopen2(vfid, "/", H5P_DEFAULT)
+                                               : H5Gcreate2(vfid, o.outputName.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            writeScalarAttribute(group, "Redshift", H5T_NATIVE_FLOAT, &o.redshift);
+            writeScalarAttribute(group, "Snapshot", H5T_NATIVE_INT, &o.snapnum);
+            hsize_t nfiles = outputFileNums.size();
+            hid_t nspace = H5Screate_simple(1, &nfiles, NULL);
+            hid_t att = H5Acreate2(group, "SourceFileNums", H5T_NATIVE_INT, nspace, H5P_DEFAULT, H5P_DEFAULT);
+            H5Awrite(att, H5T_NATIVE_INT, &outputFileNums[0]);
+            H5Aclose(att);
+            H5Sclose(nspace);
+            H5Gclose(group);
+
+            for (int d=0; d<o.dataSets.size(); d++) {
+                VirtualDataSet &v = o.dataSets[d];
+                string path = o.outputName + v.name;
+                hsize_t dims[2] = {(hsize_t) total, v.ncols};
+                hid_t vspace = H5Screate_simple(v.rank, dims, NULL);
+                hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+                hsize_t offset = 0;
+
+                for (int i=0; i<o.rows.size(); i++) {
+                    if (o.rows[i] <= 0) {
+                        continue;
+                    }
+                    if (i >= v.spaces.size() || v.spaces[i] < 0) {
+                        cout << "ERROR: Dataset " << path << " is missing in " << fileNames[i] << "." << endl;
+                        abort();
+                    }
+                    hsize_t start[2] = {offset, 0};
+                    hsize_t count[2] = {(hsize_t) o.rows[i], v.ncols};
+                    H5Sselect_hyperslab(vspace, H5S_SELECT_SET, start, NULL, count, NULL);
+                    H5Sselect_all(v.spaces[i]);
+                    H5Pset_virtual(dcpl, vspace, sourceNames[i].c_str(), path.c_str(), v.spaces[i]);
+                    offset += o.rows[i];
+                }
+                H5Sselect_all(vspace);
+
+                hid_t dset = H5Dcreate2(vfid, path.c_str(), v.type, vspace, lcpl, dcpl, H5P_DEFAULT);
+                if (dset < 0) {
+                    cout << "ERROR: Cannot create the virtual dataset " << path << "." << endl;
+                    abort();
+                }
+                H5Dclose(dset);
+                H5Pclose(dcpl);
+                H5Sclose(vspace);
+            }
+            cout << "Virtual output " << ((o.outputName == "") ? "/" : o.outputName) << ": " << total << " rows from "
+                 << outputFileNums.size() << " files, " << o.dataSets.size() << " datasets" << endl;
+        }
+
+        H5Pclose(lcpl);
+        H5Fclose(vfid);
+
+        for (int g=0; g<outputs.size(); g++) {
+            for (int d=0; d<outputs[g].dataSets.size(); d++) {
+                VirtualDataSet &v = outputs[g].dataSets[d];
+                for (int i=0; i<v.spaces.size(); i++) {
+                    if (v.spaces[i] >= 0) {
+                        H5Sclose(v.spaces[i]);
+                    }
+                }
+                if (v.type >= 0) {
+                    H5Tclose(v.type);
+                }
+            }
+        }
+    }
+
+    // sorts sources by their first row
+    static bool firstRowLess(const VirtualSource &a, const VirtualSource &b) {
+        return a.firstRow < b.firstRow;
+    }
+
+    vector<VirtualSource> getVirtualSources(hid_t fid, const string &groupName, const string &dataSetName) {
+        boost::unique_lock<boost::recursive_mutex> h5lock(sagH5Mutex());
+        vector<VirtualSource> sources;
+
+        hid_t dset = H5Dopen2(fid, dataSetName.c_str(), H5P_DEFAULT);
+        hid_t dcpl = H5Dget_create_plist(dset);
+        if (H5Pget_layout(dcpl) != H5D_VIRTUAL) {
+            H5Pclose(dcpl);
+            H5Dclose(dset);
+            return sources;
+        }
+
+        // the fileNums written by buildVirtualFile, one per mapping
+        vector<int> fileNums;
+        hid_t group = H5Gopen2(fid, (groupName == "") ? "/" : groupName.c_str(), H5P_DEFAULT);
+        if (H5Aexists(group, "SourceFileNums") > 0) {
+            hid_t att = H5Aopen(group, "SourceFileNums", H5P_DEFAULT);
+            hid_t space = H5Aget_space(att);
+            fileNums.resize(H5Sget_simple_extent_npoints(space));
+            if (fileNums.size() > 0) {
+                H5Aread(att, H5T_NATIVE_INT, &fileNums[0]);
+            }
+            H5Sclose(space);
+            H5Aclose(att);
+        }
+        H5Gclose(group);
+
+        // relative source names are relative to the virtual file
+        char name[4096];
+        H5Fget_name(fid, name, sizeof(name));
+        string virtualName(name);
+        string virtualDir = (virtualName.find('/') == string::npos) ? string("") : virtualName.substr(0, virtualName.find_last_of('/') + 1);
+
+        size_t count = 0;
+        H5Pget_virtual_count(dcpl, &count);
+        for (size_t i=0; i<count; i++) {
+            VirtualSource s;
+            hid_t vspace = H5Pget_virtual_vspace(dcpl, i);
+            hsize_t start[2] = {0, 0};
+            hsize_t end[2] = {0, 0};
+            H5Sget_select_bounds(vspace, start, end);
+            H5Sclose(vspace);
+            s.firstRow = start[0];
+            s.nrows = end[0] - start[0] + 1;
+
+            H5Pget_virtual_filename(dcpl, i, name, sizeof(name));
+            s.fileName = name;
+            if (s.fileName == ".") {
+                s.fileName = virtualName;
+            } else if (s.fileName[0] != '/' && access(s.fileName.c_str(), R_OK) != 0) {
+                s.fileName = virtualDir + s.fileName;
+            }
+            // HDF5 reads missing sources as fill values, without an error
+            if (access(s.fileName.c_str(), R_OK) != 0) {
+                cout << "ERROR: Source file " << s.fileName << " of the virtual dataset " << dataSetName << " not found." << endl;
+                abort();
+            }
+            s.fileNum = (fileNums.size() == count) ? fileNums[i] : fileNumFromName(s.fileName, i);
+            sources.push_back(s);
+        }
+        sort(sources.begin(), sources.end(), firstRowLess);
+
+        H5Pclose(dcpl);
+        H5Dclose(dset);
+        return sources;
+    }
+
+    int findVirtualSource(const vector<VirtualSource> &sources, long row, int hint) {
+        if (hint >= 0 && hint < sources.size() && row >= sources[hint].firstRow && row < sources[hint].firstRow + sources[hint].nrows) {
+            return hint;
+        }
+        int lo = 0;
+        int hi = sources.size();
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (sources[mid].firstRow <= row) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < sources.size() && row >= sources[lo].firstRow && row < sources[lo].firstRow + sources[lo].nrows) {
+            return lo;
+        }
+        return -1;
+    }
+
+}
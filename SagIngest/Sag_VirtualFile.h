@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+#include "H5Cpp.h"
+
+#ifndef Sag_Sag_VirtualFile_h
+#define Sag_Sag_VirtualFile_h
+
+namespace Sag {
+
+    // One source file of a virtual dataset: its rows are the rows
+    // [firstRow, firstRow+nrows) of the virtual dataset.
+    class VirtualSource {
+        public:
+            std::string fileName;
+            int fileNum;
+            long firstRow;
+            long nrows;
+
+            VirtualSource();
+    };
+
+    // Writes an HDF5 file with virtual datasets (HDF5 >= 1.10), which
+    // concatenate the mapped datasets of the given files (e.g. all files
+    // of a snapshot) along the rows, with the same output groups and
+    // Redshift/Snapshot attributes as the files. The fileNum of each
+    // source is stored in the attribute SourceFileNums of the output group,
+    // in the order of the mappings. No data are copied.
+    void buildVirtualFile(const std::string &virtualFile, const std::vector<std::string> &fileNames,
+                          const std::vector<int> &fileNums, const std::vector<std::string> &fieldNames);
+
+    // source files of the given dataset in the order of their rows; empty,
+    // if it is not a virtual dataset. The fileNums are taken from the
+    // SourceFileNums attribute of the group, if present, else from the
+    // source file names.
+    std::vector<VirtualSource> getVirtualSources(hid_t fid, const std::string &groupName, const std::string &dataSetName);
+
+    // index of the source containing row (-1 if none), starting the search
+    // at the hint
+    int findVirtualSource(const std::vector<VirtualSource> &sources, long row, int hint);
+
+}
+
+#endif
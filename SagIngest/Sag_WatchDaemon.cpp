@@ -0,0 +1,270 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <signal.h>
+#include <time.h>
+
+#include <sstream>
+
+#include "sagingest_error.h"
+#include "Sag_WatchDaemon.h"
+#include "Sag_Trace.h"
+
+using namespace std;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+extern "C" void sagWatchSignalHandler(int sig) {
+    stopRequested = 1;
+}
+
+namespace Sag {
+
+    WatchDaemon::WatchDaemon(DirWatcher * newWatcher, vector<string> newFieldNames, ReaderSettings newSettings, vector<DBDataSchema::Schema*> newSchemas, RowBatchQueue * newQueue, long newBatchRows, int newIdleExit) {
+        watcher = newWatcher;
+        fieldNames = newFieldNames;
+        settings = newSettings;
+        schemas = newSchemas;
+        queue = newQueue;
+        batchRows = newBatchRows;
+        idleExit = newIdleExit;
+        summary = false;
+
+        checker = new Preflight(fieldNames, schemas[0], settings.snapnums);
+        checker->setPrecisions(settings.precisions);
+
+        numBusy = 0;
+        stopping = false;
+        numFiles = 0;
+        numRows = 0;
+        nextFileNum = 0;
+    }
+
+    WatchDaemon::~WatchDaemon() {
+        for (int i=0; i<jobs.size(); i++) {
+            delete jobs[i];
+        }
+        delete checker;
+    }
+
+    void WatchDaemon::setSummary(const AggregateSpec &spec, const DBConnInfo &conn, string table, int bufferSize) {
+        summary = true;
+        summarySpec = spec;
+        summaryConn = conn;
+        summaryTable = table;
+        summaryBufferSize = bufferSize;
+    }
+
+    void WatchDaemon::runJob(int i) {
+        // ingest one file after the other; the reader is kept for all files
+        SagReader * reader = NULL;
+        Aggregator * aggregator = summary ? new Aggregator(summarySpec) : NULL;
+        string fileName;
+        int fileNum;
+        stringstream threadName;
+
+        threadName << "job " << i;
+        Tracer::setThreadName(threadName.str());
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (files.empty() && !stopping) {
+                    filesAvailable.wait(lock);
+                }
+                if (stopping) {
+                    break;
+                }
+                fileName = files.front();
+                files.pop_front();
+                fileNum = fileNumFromName(fileName, nextFileNum++);
+                numBusy++;
+            }
+
+            TraceSpan span("file", "ingest", fileName);
+
+            // the reader stops the process on problems it finds on the way,
+            // so check the file completely before any of its rows is read
+            PreflightResult check = checker->checkFile(fileName);
+            if (check.errors.size() > 0) {
+                for (int k=0; k<check.errors.size(); k++) {
+                    cout << "ERROR: Job " << i << ": " << fileName << ": " << check.errors[k] << endl;
+                }
+                cout << "Job " << i << ": skipping " << fileName << ", nothing was ingested from it." << endl;
+                boost::unique_lock<boost::mutex> lock(mutex);
+                numBusy--;
+                rejected.push_back(fileName);
+                continue;
+            }
+            for (int k=0; k<check.warnings.size(); k++) {
+                cout << "Warning: Job " << i << ": " << fileName << ": " << check.warnings[k] << endl;
+            }
+
+            cout << "Job " << i << ": ingesting " << fileName << " (fileNum " << fileNum << ")" << endl;
+            AggregatingReader * aggReader = NULL;
+            BatchProducer * producer = NULL;
+            bool failed = false;
+            try {
+                if (!reader) {
+                    reader = new SagReader(fileName, fileNum, settings.blocksize, fieldNames);
+                    reader->applySettings(settings);
+                } else {
+                    reader->setFile(fileName, fileNum);
+                }
+
+                DBReader::Reader * jobReader = reader;
+                if (aggregator) {
+                    aggReader = new AggregatingReader(reader, schemas[i], aggregator);
+                    jobReader = aggReader;
+                }
+
+                producer = new BatchProducer(jobReader, schemas[i], queue, batchRows);
+                producer->run();
+                reader->closeFile();
+
+                if (aggregator) {
+                    writeSummary(aggregator, summaryConn, summaryTable, summaryBufferSize);
+                }
+            } catch (H5::Exception &e) {
+                cout << "ERROR: Job " << i << ": " << fileName << ": " << e.getDetailMsg() << endl;
+                failed = true;
+            } catch (std::exception &e) {
+                cout << "ERROR: Job " << i << ": " << fileName << ": " << e.what() << endl;
+                failed = true;
+            }
+
+            long fileRows = producer ? producer->getNumRows() : 0;
+            if (aggregator) {
+                aggregator->clear();
+            }
+            if (aggReader) {
+                delete aggReader;
+            }
+            if (producer) {
+                delete producer;
+            }
+            if (failed) {
+                // start with a fresh reader for the next file
+                delete reader;
+                reader = NULL;
+                cout << "Job " << i << ": " << fileName << " failed after " << fileRows << " rows; "
+                     << "these rows (fileNum " << fileNum << ") are ingested and must be deleted before the file is ingested again." << endl;
+            } else {
+                cout << "Job " << i << ": done with " << fileName << ", " << fileRows << " rows." << endl;
+            }
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                numBusy--;
+                numRows += fileRows;
+                if (failed) {
+                    rejected.push_back(fileName);
+                } else {
+                    numFiles++;
+                }
+            }
+        }
+
+        if (reader) {
+            delete reader;
+        }
+        if (aggregator) {
+            delete aggregator;
+        }
+    }
+
+    void WatchDaemon::run() {
+        vector<string> ready;
+        time_t lastActivity = time(NULL);
+        bool idle;
+
+        vector<string> fieldMapErrors = checker->getFieldMapErrors();
+        for (int i=0; i<fieldMapErrors.size(); i++) {
+            cout << "ERROR (mapping file): " << fieldMapErrors[i] << endl;
+        }
+        if (fieldMapErrors.size() > 0) {
+            SagIngest_error("WatchDaemon: The mapping file does not fit the computed columns.\n");
+        }
+
+        signal(SIGINT, sagWatchSignalHandler);
+        signal(SIGTERM, sagWatchSignalHandler);
+
+        for (int i=0; i<schemas.size(); i++) {
+            jobs.push_back(new boost::thread(&WatchDaemon::runJob, this, i));
+        }
+        cout << "Watching for new files with " << jobs.size() << " jobs ..." << endl;
+
+        while (!stopRequested) {
+            ready = watcher->poll(1000);
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (int k=0; k<ready.size(); k++) {
+                cout << "New file ready: " << ready[k] << endl;
+                files.push_back(ready[k]);
+                filesAvailable.notify_one();
+            }
+
+            idle = (ready.size() == 0 && files.empty() && numBusy == 0 && watcher->getNumPending() == 0);
+            if (!idle) {
+                lastActivity = time(NULL);
+            } else if (idleExit > 0 && time(NULL) - lastActivity >= idleExit) {
+                cout << "Nothing to do for " << idleExit << " seconds, stopping." << endl;
+                break;
+            }
+        }
+
+        // let the jobs finish their current file, skip files not started yet
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (int k=0; k<files.size(); k++) {
+                cout << "Not ingested (stopped before): " << files[k] << endl;
+            }
+            stopping = true;
+            filesAvailable.notify_all();
+        }
+        for (int i=0; i<jobs.size(); i++) {
+            jobs[i]->join();
+        }
+
+        cout << "Ingested " << numFiles << " files, " << numRows << " rows." << endl;
+        vector<string> unreadable = watcher->getRejected();
+        if (rejected.size() + unreadable.size() > 0) {
+            cout << "Rejected " << rejected.size() + unreadable.size() << " files:" << endl;
+            for (int k=0; k<rejected.size(); k++) {
+                cout << "  " << rejected[k] << endl;
+            }
+            for (int k=0; k<unreadable.size(); k++) {
+                cout << "  " << unreadable[k] << " (cannot be opened as HDF5)" << endl;
+            }
+        }
+    }
+
+    long WatchDaemon::getNumFiles() {
+        return numFiles;
+    }
+
+    long WatchDaemon::getNumRows() {
+        return numRows;
+    }
+
+    long WatchDaemon::getNumRejected() {
+        return rejected.size() + watcher->getRejected().size();
+    }
+
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Schema.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "Sag_Reader.h"
+#include "Sag_RowBatch.h"
+#include "Sag_DirWatcher.h"
+#include "Sag_Aggregator.h"
+#include "Sag_Preflight.h"
+
+#ifndef Sag_Sag_WatchDaemon_h
+#define Sag_Sag_WatchDaemon_h
+
+namespace Sag {
+
+    // Long-running ingest of all data files appearing in a directory.
+    // Up to numJobs files are read at the same time, each job keeps its
+    // reader; all rows go to the same batch queue, so the writer threads
+    // (and their database connections) stay alive for the whole run.
+    // Each file is checked against the mapping file (see Preflight) before
+    // its rows are read; files with errors are reported and skipped, so
+    // that one bad file does not stop the daemon.
+    class WatchDaemon {
+    private:
+        DirWatcher * watcher;
+        std::vector<std::string> fieldNames;
+        ReaderSettings settings;
+        std::vector<DBDataSchema::Schema*> schemas; // one per job
+        RowBatchQueue * queue;
+        long batchRows;
+        int idleExit;
+
+        // optional summary table, written after each file
+        bool summary;
+        AggregateSpec summarySpec;
+        DBConnInfo summaryConn;
+        std::string summaryTable;
+        int summaryBufferSize;
+
+        Preflight * checker;
+        std::vector<std::string> rejected;  // files not (completely) ingested because of errors
+
+        std::deque<std::string> files;
+        int numBusy;
+        bool stopping;
+        boost::mutex mutex;
+        boost::condition_variable filesAvailable;
+        std::vector<boost::thread*> jobs;
+
+        long numFiles;
+        long numRows;
+        int nextFileNum;
+
+        void runJob(int i);
+
+    public:
+        WatchDaemon(DirWatcher * newWatcher, std::vector<std::string> newFieldNames, ReaderSettings newSettings, std::vector<DBDataSchema::Schema*> newSchemas, RowBatchQueue * newQueue, long newBatchRows, int newIdleExit);
+        ~WatchDaemon();
+
+        // aggregate the rows of each file into the given table
+        void setSummary(const AggregateSpec &spec, const DBConnInfo &conn, std::string table, int bufferSize);
+
+        // runs until SIGINT/SIGTERM, or until nothing happened for idleExit seconds (if > 0)
+        void run();
+
+        long getNumFiles();
+        long getNumRows();
+        long getNumRejected();
+    };
+
+}
+
+#endif
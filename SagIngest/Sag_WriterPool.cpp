@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+
+#include <sstream>
+
+#include "Sag_WriterPool.h"
+#include "Sag_Trace.h"
+
+using namespace std;
+
+namespace Sag {
+
+    WriterPool::WriterPool(RowBatchQueue * newQueue, DBConnInfo newConn, int newBufferSize) {
+        queue = newQueue;
+        conn = newConn;
+        bufferSize = newBufferSize;
+        listener = NULL;
+
+        // writers cannot ask the user interactively, all at the same time
+        conn.askUserToValidateRead = false;
+    }
+
+    WriterPool::~WriterPool() {
+        for (int i=0; i<threads.size(); i++) {
+            delete threads[i];
+            delete ingestors[i];
+            delete readers[i];
+        }
+    }
+
+    void WriterPool::start(vector<DBDataSchema::Schema*> newSchemas) {
+        schemas = newSchemas;
+
+        // set up all connections first, then start the threads
+        for (int i=0; i<schemas.size(); i++) {
+            SagBatchReader * reader = new SagBatchReader(queue, schemas[i], conn.commitBatches);
+            DBServer::DBAbstractor * dbServer = adaptorFac.getDBAdaptors(conn.system);
+            DBIngest::DBIngestor * ingestor = new DBIngest::DBIngestor(schemas[i], reader, dbServer);
+            setupIngestor(ingestor, conn);
+
+            readers.push_back(reader);
+            dbServers.push_back(dbServer);
+            ingestors.push_back(ingestor);
+            finished.push_back(false);
+            flushedBatches.push_back(0);
+            flushedRows.push_back(0);
+            numCommits.push_back(0);
+        }
+
+        for (int i=0; i<schemas.size(); i++) {
+            threads.push_back(new boost::thread(&WriterPool::runWriter, this, i));
+        }
+        cout << "Started " << threads.size() << " writer threads." << endl;
+    }
+
+    void WriterPool::setFlushListener(FlushListener * newListener) {
+        listener = newListener;
+    }
+
+    void WriterPool::runWriter(int i) {
+        // one ingestData per segment of commitBatches batches: it returns
+        // at the end of the segment, after the final flush and commit, so
+        // only then the rows of the segment count as written
+        stringstream name;
+        name << "writer " << i;
+        Tracer::setThreadName(name.str());
+        while (readers[i]->startSegment()) {
+            ingestors[i]->ingestData(bufferSize);
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                flushedBatches[i] += readers[i]->getSegmentBatches();
+                flushedRows[i] += readers[i]->getSegmentRows();
+                numCommits[i]++;
+            }
+            if (listener) {
+                const map<int, long> &sourceRows = readers[i]->getSegmentSourceRows();
+                for (map<int, long>::const_iterator it=sourceRows.begin(); it!=sourceRows.end(); ++it) {
+                    listener->rowsFlushed(it->first, it->second);
+                }
+            }
+        }
+        finished[i] = true;
+    }
+
+    void WriterPool::join() {
+        for (int i=0; i<threads.size(); i++) {
+            threads[i]->join();
+        }
+    }
+
+    long WriterPool::getNumBatches() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        long n = 0;
+        for (int i=0; i<flushedBatches.size(); i++) {
+            n += flushedBatches[i];
+        }
+        return n;
+    }
+
+    long WriterPool::getNumRows() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        long n = 0;
+        for (int i=0; i<flushedRows.size(); i++) {
+            n += flushedRows[i];
+        }
+        return n;
+    }
+
+    void WriterPool::printStats() {
+        cout << "Writer statistics (batches/rows handed over per connection):" << endl;
+        for (int i=0; i<readers.size(); i++) {
+            cout << "  writer " << i << ": " << readers[i]->getNumBatches() << " batches, "
+                 << readers[i]->getNumRows() << " rows handed over, " << flushedRows[i] << " rows flushed in "
+                 << numCommits[i] << " commits" << (finished[i] ? "" : " (not finished)") << endl;
+        }
+        cout << "  total flushed: " << getNumBatches() << " batches, " << getNumRows() << " rows" << endl;
+    }
+
+}
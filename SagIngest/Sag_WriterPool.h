@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Schema.h>
+#include <DBIngestor.h>
+#include <DBAdaptorsFactory.h>
+#include <vector>
+#include <boost/thread/thread.hpp>
+
+#include "Sag_DBConnection.h"
+#include "Sag_RowBatch.h"
+#include "Sag_BatchReader.h"
+
+#ifndef Sag_Sag_WriterPool_h
+#define Sag_Sag_WriterPool_h
+
+namespace Sag {
+
+    // Told about the rows of each batch source (see BatchProducer::setSource)
+    // once they are committed.
+    class FlushListener {
+        public:
+            virtual ~FlushListener() {}
+            virtual void rowsFlushed(int source, long nrows) = 0;
+    };
+
+
+    // A pool of writer threads, each with its own database connection
+    // (DBIngestor with a SagBatchReader), all draining the same queue.
+    // The order of the rows in the database is not preserved. Each writer
+    // calls ingestData once per conn.commitBatches batches, so that the
+    // rows are committed (and counted as flushed) batch-wise.
+    class WriterPool {
+    private:
+        RowBatchQueue * queue;
+        DBConnInfo conn;
+        int bufferSize;
+
+        DBServer::DBAdaptorsFactory adaptorFac;
+        std::vector<DBDataSchema::Schema*> schemas;
+        std::vector<SagBatchReader*> readers;
+        std::vector<DBServer::DBAbstractor*> dbServers;
+        std::vector<DBIngest::DBIngestor*> ingestors;
+        std::vector<boost::thread*> threads;
+        std::vector<char> finished; // not vector<bool>, threads write to their own element
+        std::vector<long> flushedBatches;   // counted when ingestData has returned
+        std::vector<long> flushedRows;
+        std::vector<long> numCommits;       // ingestData calls
+        boost::mutex mutex;
+        FlushListener * listener;
+
+        void runWriter(int i);
+
+    public:
+        WriterPool(RowBatchQueue * newQueue, DBConnInfo newConn, int newBufferSize);
+        ~WriterPool();
+
+        // one schema per writer, all with the same items in the same order
+        void start(std::vector<DBDataSchema::Schema*> newSchemas);
+
+        // called by the writer threads after each commit (set before start)
+        void setFlushListener(FlushListener * newListener);
+        void join();
+
+        // batches/rows whose ingestData call has returned, i.e. which are
+        // committed; rows of a call still running are not counted
+        long getNumBatches();
+        long getNumRows();
+        void printStats();
+    };
+
+}
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <SchemaItem.h>
+#include <DataObjDesc.h>
+
+#include "Sag_ZoneMap.h"
+
+using namespace std;
+
+namespace Sag {
+
+    ColumnStats::ColumnStats() {
+        isInt = false;
+        nrows = 0;
+        nulls = 0;
+        imin = imax = 0;
+        dmin = dmax = 0;
+        isum = 0;
+        dsum = 0;
+    }
+
+    bool ColumnStats::hasValues() {
+        return nrows > nulls;
+    }
+
+
+    // min and max of the values, NaN values are counted and skipped;
+    // written without early exits so that the compiler can vectorise it
+    template <class T>
+    static long scanMinMax(const T *v, long n, T &lo, T &hi) {
+        long nans = 0;
+        lo = numeric_limits<T>::max();
+        hi = numeric_limits<T>::is_integer ? numeric_limits<T>::min() : -numeric_limits<T>::max();
+        for (long i=0; i<n; i++) {
+            T x = v[i];
+            nans += (x != x);
+            lo = (x < lo) ? x : lo;
+            hi = (x > hi) ? x : hi;
+        }
+        return nans;
+    }
+
+    // sums of the values, NaN values are skipped
+    template <class T>
+    static void scanSum(const T *v, long n, long &isum, double &dsum) {
+        uint64_t is = 0;
+        double ds = 0;
+        if (numeric_limits<T>::is_integer) {
+            for (long i=0; i<n; i++) {
+                is += (uint64_t) (long) v[i];
+            }
+            ds = (double) (long) is;
+        } else {
+            for (long i=0; i<n; i++) {
+                T x = v[i];
+                ds += (x == x) ? x : 0;
+            }
+        }
+        isum = (long) is;
+        dsum = ds;
+    }
+
+    template <class T>
+    static void fillHistogram(const T *v, long n, double lo, double hi, vector<long> &hist) {
+        int nbins = hist.size();
+        double scale = (hi > lo) ? nbins / (hi - lo) : 0;
+        for (long i=0; i<n; i++) {
+            double x = v[i];
+            if (x == x) {
+                int bin = (int) ((x - lo) * scale);
+                hist[min(bin, nbins - 1)]++;
+            }
+        }
+    }
+
+    template <class T>
+    static void computeStats(const T *v, long n, double factor, int nbins, ColumnStats &stats) {
+        T lo, hi;
+
+        stats.nrows = n;
+        stats.nulls = scanMinMax(v, n, lo, hi);
+        stats.isInt = numeric_limits<T>::is_integer && factor == 1;
+        stats.imin = (long) lo;
+        stats.imax = (long) hi;
+        stats.dmin = lo * factor;
+        stats.dmax = hi * factor;
+        scanSum(v, n, stats.isum, stats.dsum);
+        stats.dsum *= factor;
+
+        stats.hist.assign(max(nbins, 0), 0);
+        if (nbins > 0 && stats.hasValues()) {
+            fillHistogram(v, n, (double) lo, (double) hi, stats.hist);
+        }
+    }
+
+    void computeColumnStats(const string &type, const void *data, long n, double factor, int nbins, ColumnStats &stats) {
+        if (type == "long") {
+            computeStats((const long*) data, n, factor, nbins, stats);
+        } else if (type == "int8") {
+            computeStats((const int8_t*) data, n, factor, nbins, stats);
+        } else if (type == "double") {
+            computeStats((const double*) data, n, factor, nbins, stats);
+        } else if (type == "float") {
+            computeStats((const float*) data, n, factor, nbins, stats);
+        } else {
+            cout << "ERROR: Cannot compute statistics for type " << type << endl;
+            abort();
+        }
+    }
+
+
+    ZoneMapWriter::ZoneMapWriter(string fileName, DBDataSchema::Schema * schema, int newNumBins) {
+        numBins = newNumBins;
+        numBlocks = 0;
+
+        vector<DBDataSchema::SchemaItem*> items = schema->getArrSchemaItems();
+        for (int j=0; j<items.size(); j++) {
+            columnNames[items[j]->getDataDesc()->getDataObjName()] = items[j]->getColumnName();
+        }
+
+        // append to an existing file, e.g. from an earlier run
+        out.open(fileName.c_str(), ios::out | ios::app);
+        if (!out) {
+            cout << "ERROR: Cannot open zone map file '" << fileName << "'." << endl;
+            abort();
+        }
+        out.precision(numeric_limits<double>::digits10 + 2);
+        if (out.tellp() == 0) {
+            out << "#fileNum\tsnapnum\tfirstRow\tlastRow\tcolumn\tnRows\tnulls\tmin\tmax";
+            if (numBins > 0) {
+                out << "\thist(" << numBins << " bins from min to max)";
+            }
+            out << endl;
+        }
+    }
+
+    ZoneMapWriter::~ZoneMapWriter() {
+        out.close();
+    }
+
+    int ZoneMapWriter::getNumBins() {
+        return numBins;
+    }
+
+    void ZoneMapWriter::write(const BlockStats &block) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+
+        for (int c=0; c<block.columns.size(); c++) {
+            ColumnStats s = block.columns[c];
+            map<string, string>::iterator it = columnNames.find(s.name);
+            string column = (it == columnNames.end()) ? s.name : it->second;
+
+            out << block.fileNum << "\t" << block.snapnum << "\t" << block.firstRow << "\t" << block.lastRow
+                << "\t" << column << "\t" << s.nrows << "\t" << s.nulls << "\t";
+            if (!s.hasValues()) {
+                out << "\\N\t\\N";     // NULL for LOAD DATA
+            } else if (s.isInt) {
+                out << s.imin << "\t" << s.imax;
+            } else {
+                out << s.dmin << "\t" << s.dmax;
+            }
+            for (int b=0; b<s.hist.size(); b++) {
+                out << ((b == 0) ? "\t" : ",") << s.hist[b];
+            }
+            out << "\n";
+
+            // totals for the report
+            if (totals.find(column) == totals.end()) {
+                totalsOrder.push_back(column);
+                ColumnStats &t = totals[column];
+                t = s;
+                t.nrows = 0;
+                t.nulls = 0;
+                t.hist.clear();
+            }
+            ColumnStats &t = totals[column];
+            if (s.hasValues()) {
+                if (!t.hasValues()) {
+                    t.imin = s.imin;
+                    t.imax = s.imax;
+                    t.dmin = s.dmin;
+                    t.dmax = s.dmax;
+                }
+                t.imin = min(t.imin, s.imin);
+                t.imax = max(t.imax, s.imax);
+                t.dmin = min(t.dmin, s.dmin);
+                t.dmax = max(t.dmax, s.dmax);
+            }
+            t.nrows += s.nrows;
+            t.nulls += s.nulls;
+        }
+        out.flush();
+        numBlocks++;
+    }
+
+    void ZoneMapWriter::printReport() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+
+        cout << "Column statistics (" << numBlocks << " blocks):" << endl;
+        for (int c=0; c<totalsOrder.size(); c++) {
+            ColumnStats &t = totals[totalsOrder[c]];
+            cout << "  " << totalsOrder[c] << ": " << t.nrows << " rows, " << t.nulls << " NULL/NaN";
+            if (t.hasValues() && t.isInt) {
+                cout << ", min " << t.imin << ", max " << t.imax;
+            } else if (t.hasValues()) {
+                cout << ", min " << t.dmin << ", max " << t.dmax;
+            }
+            cout << endl;
+        }
+    }
+
+}
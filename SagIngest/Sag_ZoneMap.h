@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2016, Kristin Riebe <kriebe@aip.de>,
+ *                      E-Science team AIP Potsdam
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  See the NOTICE file distributed with this work for additional
+ *  information regarding copyright ownership. You may obtain a copy
+ *  of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <Schema.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <boost/thread/mutex.hpp>
+
+#ifndef Sag_Sag_ZoneMap_h
+#define Sag_Sag_ZoneMap_h
+
+namespace Sag {
+
+    // Statistics of one column in one block of rows.
+    class ColumnStats {
+        public:
+            std::string name;       // data file name of the column
+            bool isInt;             // min/max in imin/imax (exact), else in dmin/dmax
+            long nrows;
+            long nulls;             // NaN values
+            long imin, imax;
+            double dmin, dmax;
+            long isum;              // sum of the values (isInt only, modulo 2^64)
+            double dsum;            // sum of the values without NaN
+            std::vector<long> hist; // counts in equal bins between min and max
+
+            ColumnStats();
+            bool hasValues();
+    };
+
+    // compute the statistics of n values of the given type (as in DataBlock:
+    // long, int8, double or float); factor converts them to database units;
+    // with nbins > 0 a coarse histogram over [min, max] is made as well
+    void computeColumnStats(const std::string &type, const void *data, long n, double factor, int nbins, ColumnStats &stats);
+
+
+    // Statistics of all columns of one block of rows.
+    class BlockStats {
+        public:
+            int fileNum;
+            int snapnum;
+            long firstRow;  // NInFile of the first and last row of the block
+            long lastRow;
+            long nrows;     // rows in the block (sorted rows: may be less than the range)
+            std::vector<ColumnStats> columns;
+    };
+
+
+    // Writes the zone maps (statistics per column and block) of all ingested
+    // files to a tab-separated sidecar file, one line per block and column,
+    // using the database column names. Query tools can skip row ranges
+    // whose min/max do not match; the totals give a data-quality report.
+    // Shared by all readers of the process.
+    class ZoneMapWriter {
+    private:
+        std::ofstream out;
+        std::map<std::string, std::string> columnNames; // data file name -> database column
+        int numBins;
+        boost::mutex mutex;
+
+        long numBlocks;
+        std::map<std::string, ColumnStats> totals;
+        std::vector<std::string> totalsOrder;
+
+    public:
+        ZoneMapWriter(std::string fileName, DBDataSchema::Schema * schema, int newNumBins);
+        ~ZoneMapWriter();
+
+        int getNumBins();
+        void write(const BlockStats &block);
+
+        // min, max and NULL count of each column over all blocks
+        void printReport();
+    };
+
+}
+
+#endif
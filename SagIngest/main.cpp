@@ -24,6 +24,21 @@
 #include "Sag_Reader.h"
 #include "Sag_SchemaMapper.h"
 #include "sagingest_error.h"
+#include "Sag_DBConnection.h"
+#include "Sag_RowBatch.h"
+#include "Sag_WriterPool.h"
+#include "Sag_DirWatcher.h"
+#include "Sag_WatchDaemon.h"
+#include "Sag_FileScheduler.h"
+#include "Sag_Aggregator.h"
+#include "Sag_ZoneMap.h"
+#include "Sag_Checksums.h"
+#include "Sag_VirtualFile.h"
+#include "Sag_Partitioner.h"
+#include "Sag_MemoryBudget.h"
+#include "Sag_Metrics.h"
+#include "Sag_Trace.h"
+#include "Sag_Preflight.h"
 #include <Schema.h>
 #include <DBIngestor.h>
 #include <DBAdaptorsFactory.h>
@@ -32,6 +47,7 @@
 #include <boost/program_options.hpp>
 
 #include <sstream>
+#include <fstream>
 #include <vector>
 
 using namespace Sag;
@@ -39,6 +55,34 @@ using namespace std;
 namespace po = boost::program_options;
 
 
+// common end of all modes: stop the live metrics, write the checksums and
+// the reports, and free the objects shared by the modes
+static int finishIngest(MetricsExporter * metricsExporter, Metrics * metrics, ChecksumSet * checksums, string checksumFile,
+                        ZoneMapWriter * zoneMap, MemoryBudget * memory, SagSchemaMapper * thisSchemaMapper, DBDataSchema::Schema * thisSchema) {
+    if (metricsExporter) {
+        metricsExporter->stop();
+        delete metricsExporter;
+        delete metrics;
+    }
+    if (checksums) {
+        checksums->write(checksumFile);
+        delete checksums;
+    }
+    if (zoneMap) {
+        zoneMap->printReport();
+        delete zoneMap;
+    }
+    if (memory) {
+        memory->printReport();
+        delete memory;
+    }
+
+    delete thisSchemaMapper;
+    delete thisSchema;
+    return 0;
+}
+
+
 int main (int argc, const char * argv[])
 {
     string dataFile;
@@ -48,6 +92,66 @@ int main (int argc, const char * argv[])
     int fileNum;
     
     int user_blocksize;
+    bool adaptiveBlocksize;
+
+    string sortKey;
+    long sortMemory;
+    string sortTmpDir;
+    double boxSize;
+    int phBits;
+    int decompressThreads;
+    bool ioOrder;
+    long mergeGap;
+    bool multiRead;
+
+    int numWriters;
+    long batchRows;
+    int queueDepth;
+    long commitBatches;
+
+    string snapnumList;
+    vector<int> snapnums;
+
+    string watchDir;
+    string watchSuffix;
+    int watchSettle;
+    int watchGrace;
+    int watchJobs;
+    bool watchExisting;
+    int watchIdleExit;
+
+    string fileList;
+    int jobs;
+    long taskRows;
+    string manifestFile;
+    string virtualFile;
+
+    string aggregateFile;
+    string aggregateTable;
+
+    string partitionBy;
+    string partitionMode;
+    int partitions;
+    int maxPartitions;
+    string partitionBounds;
+    int planPartitions;
+
+    string zoneMapFile;
+    int zoneMapBins;
+
+    string checksumFile;
+    string verifyFile;
+    string verifyResult;
+
+    long maxMemory;
+
+    string metricsFile;
+    string metricsSocket;
+    int metricsInterval;
+
+    string traceFile;
+
+    bool preflight;
 
     string dbase;
     string table;
@@ -115,6 +219,52 @@ int main (int argc, const char * argv[])
                 ("blocksize", po::value<int32_t>(&user_blocksize)->default_value(100000), "number of rows to be read in one block (for each dataset); dataset * blocksize * dataType must fit into memory [default: 10000]")
                 ("resumeMode,R", po::value<bool>(&resumeMode)->default_value(0), "try to resume ingest on failed connection (turns off transactions)? [default: 0]")
                 ("validateSchema,v", po::value<bool>(&askUserToValidateRead)->default_value(1), "ask user to validate the schema mapping [default: 1]")
+                ("writers", po::value<int>(&numWriters)->default_value(1), "number of writer threads, each with its own database connection; rows are read into a queue of batches, their order is not preserved [default: 1]")
+                ("batchRows", po::value<long>(&batchRows)->default_value(10000), "number of rows per batch for the writer threads [default: 10000]")
+                ("queueDepth", po::value<int>(&queueDepth)->default_value(0), "max. number of batches waiting for the writer threads [default: 2 * writers]")
+                ("commitBatches", po::value<long>(&commitBatches)->default_value(100), "each writer thread commits its rows after this many batches (one ingestData call each), only committed rows count as flushed [default: 100, 0: at the end]")
+                ("adaptiveBlocksize", po::value<bool>(&adaptiveBlocksize)->default_value(0), "grow or shrink the blocksize while reading to the highest measured throughput (rows/s of reading plus consuming a block), starting at blocksize; the chosen size is logged [default: 0]")
+                ("snapnums", po::value<string>(&snapnumList)->default_value(""), "comma separated list of snapshot numbers to be ingested from files with several Output* groups [default: all]")
+                ("sortKey", po::value<string>(&sortKey)->default_value(""), "sort the rows of each file before ingesting them, by 'phkey' (computed from /X, /Y, /Z) or by a dataset from the mapping file [default: no sorting]")
+                ("sortMemory", po::value<long>(&sortMemory)->default_value(1024), "memory (in MB) for sorting; if the rows do not fit, sorted runs are written to sortTmpDir and merged [default: 1024]")
+                ("sortTmpDir", po::value<string>(&sortTmpDir)->default_value("."), "directory for temporary files when sorting [default: .]")
+                ("boxSize", po::value<double>(&boxSize)->default_value(0), "box size of the simulation (in the units of the positions in the database), needed for phkey")
+                ("phBits", po::value<int>(&phBits)->default_value(20), "number of bits per dimension for phkey (max. 21) [default: 20]")
+                ("decompressThreads", po::value<int>(&decompressThreads)->default_value(0), "number of threads for decompressing gzip-compressed chunked datasets; 0 lets HDF5 decompress them serially [default: 0]")
+                ("ioOrder", po::value<bool>(&ioOrder)->default_value(1), "read the datasets of each block in the order of their position in the file? [default: 1]")
+                ("mergeGap", po::value<long>(&mergeGap)->default_value(0), "datasets (contiguous layout) whose data for a block are at most this many KB apart in the file are read with one read; -1: never [default: 0, only adjacent ones]")
+                ("multiRead", po::value<bool>(&multiRead)->default_value(1), "keep the datasets open and read all of them with one call per block (H5Dread_multi with HDF5 >= 1.14)? [default: 1]")
+                ("watchDir", po::value<string>(&watchDir)->default_value(""), "run as daemon: ingest every data file appearing in this directory (instead of a single dataFile); fileNum is taken from the file name")
+                ("watchSuffix", po::value<string>(&watchSuffix)->default_value(".hdf5"), "only files with this suffix are ingested in watch mode [default: .hdf5]")
+                ("watchSettle", po::value<int>(&watchSettle)->default_value(30), "seconds a closed file must not change before it is ingested in watch mode [default: 30]")
+                ("watchGrace", po::value<int>(&watchGrace)->default_value(300), "seconds after the settle time after which a file that cannot be opened as HDF5 is rejected in watch mode [default: 300]")
+                ("watchJobs", po::value<int>(&watchJobs)->default_value(1), "number of files read at the same time in watch mode [default: 1]")
+                ("watchExisting", po::value<bool>(&watchExisting)->default_value(1), "also ingest files that are already in watchDir at startup? [default: 1]")
+                ("watchIdleExit", po::value<int>(&watchIdleExit)->default_value(0), "stop watch mode after this many seconds without new files [default: 0, run until SIGINT/SIGTERM]")
+                ("fileList", po::value<string>(&fileList)->default_value(""), "ingest all files listed in this file (one 'path [fileNum]' per line, fileNum taken from the file name if not given) instead of a single dataFile; large files are split into tasks, the largest are read first")
+                ("jobs", po::value<int>(&jobs)->default_value(1), "number of reader threads taking tasks from the file list [default: 1]")
+                ("taskRows", po::value<long>(&taskRows)->default_value(1000000), "split the outputs of listed files into tasks of at most this many rows; 0: one task per output [default: 1000000]")
+                ("manifest", po::value<string>(&manifestFile)->default_value(""), "with fileList: record the completely ingested files in this file and skip files whose size, modification time and mapping file did not change since")
+                ("virtualFile", po::value<string>(&virtualFile)->default_value(""), "with fileList: write an HDF5 file with virtual datasets concatenating the mapped datasets of all listed files (e.g. of one snapshot) and ingest it as one file; fileNum and NInFile still refer to the listed files")
+                ("aggregateFile", po::value<string>(&aggregateFile)->default_value(""), "file declaring aggregates (key, count, sum, min, max, mean, hist) computed while ingesting and written to a summary table after each file")
+                ("partitionBy", po::value<string>(&partitionBy)->default_value(""), "route the rows to one table per partition of this column (database name), each with its own writers")
+                ("partitionMode", po::value<string>(&partitionMode)->default_value("value"), "value: table <table>_<value> per value (e.g. snapnum); range: tables <table>_p<i> between partitionBounds; hash: tables <table>_h<i> by hash of the column [default: value]")
+                ("partitions", po::value<int>(&partitions)->default_value(0), "number of partitions for partitionMode=hash")
+                ("maxPartitions", po::value<int>(&maxPartitions)->default_value(256), "stop with an error when partitionBy needs more partition tables than this, 0 for no limit [default: 256]")
+                ("partitionBounds", po::value<string>(&partitionBounds)->default_value(""), "comma-separated boundaries for partitionMode=range")
+                ("planPartitions", po::value<int>(&planPartitions)->default_value(0), "only estimate boundaries for this many balanced range partitions of partitionBy (quantile sketch) and print them, no ingest")
+                ("zoneMapFile", po::value<string>(&zoneMapFile)->default_value(""), "append min, max and NULL count of each column in each block (zone maps) to this tab-separated file")
+                ("zoneMapBins", po::value<int>(&zoneMapBins)->default_value(0), "number of bins of the coarse histogram of each column in the zone maps [default: 0, none]")
+                ("checksumFile", po::value<string>(&checksumFile)->default_value(""), "write the row count and count, min, max and sum of each column of all ingested rows to this file, for verifying the table with --verify")
+                ("verify", po::value<string>(&verifyFile)->default_value(""), "only verify the table against this checksum file (written with --checksumFile) with one aggregate query, no ingest; the query is run directly for sqlite3 (path) or its result is taken from verifyResult, else it is printed")
+                ("verifyResult", po::value<string>(&verifyResult)->default_value(""), "file with the result row of the verification query (values separated by tabs, | or commas), e.g. saved from the mysql client")
+                ("maxMemory", po::value<long>(&maxMemory)->default_value(0), "limit (in MB) for the column buffers, read buffers, sort buffers and row batches; blocks are made smaller and reading waits for the writers instead of growing [default: 0, no limit]")
+                ("metricsFile", po::value<string>(&metricsFile)->default_value(""), "write live metrics (rows and bytes read, rows written, queue depth, phase latency histograms, ETA) in the Prometheus text format to this file every metricsInterval seconds, e.g. for the textfile collector of the node exporter")
+                ("metricsSocket", po::value<string>(&metricsSocket)->default_value(""), "serve the live metrics to every client connecting to this Unix socket, e.g. socat - UNIX-CONNECT:<path>")
+                ("metricsInterval", po::value<int>(&metricsInterval)->default_value(10), "seconds between two writes of the metrics file [default: 10]")
+                ("preflight", po::value<bool>(&preflight)->default_value(0), "check all data files against the mapping file (attributes, snapshots, dataset types, ranks, columns and row counts) in parallel before ingesting, and stop with a report if any check fails [default: 0]")
+                ("traceFile", po::value<string>(&traceFile)->default_value(""), "record a timeline of the reader and writer threads (output scans, block and dataset reads, batch building, queue waits, batch writes) and write it as Chrome trace-event JSON to this file at exit, for chrome://tracing or ui.perfetto.dev")
+                ("aggregateTable", po::value<string>(&aggregateTable)->default_value(""), "name of the summary table for the aggregates [default: <table>_summary]")
                 ;
     // Attention: many of these options actually are required; boost version 1.42 and above support ->required() (instead of default()), but not older versions;
     // Unfortunately our servers only have boost 1.41 installed, so it would not work there.
@@ -129,14 +279,79 @@ int main (int argc, const char * argv[])
     po::store(po::command_line_parser(argc, (char **) argv).options(progDesc).positional(posDesc).run(), varMap);
     // --> only compiles at erebos if I include the (char **) cast
     po::notify(varMap);
+
+    if (verifyFile != "" && !varMap.count("help")) {
+        return verifyChecksums(verifyFile, verifyResult, system, path);
+    }
     
-    if (varMap.count("help") || varMap.count("?") || dataFile.length() == 0) {
+    if (varMap.count("help") || varMap.count("?") || (dataFile.length() == 0 && watchDir.length() == 0 && fileList.length() == 0)) {
         cout << progDesc;
         return EXIT_SUCCESS;
     }
     
     cout << "You have entered the following parameters:" << endl;
-    cout << "Data file: " << dataFile << endl;
+    if (watchDir != "") {
+        cout << "Watch directory: " << watchDir << endl;
+        cout << "Watch suffix: " << watchSuffix << endl;
+        cout << "Settle time (s): " << watchSettle << endl;
+        cout << "Grace time (s): " << watchGrace << endl;
+        cout << "Watch jobs: " << watchJobs << endl;
+        if (watchJobs < 1) {
+            SagIngest_error("watchJobs must be at least 1.");
+        }
+        if (numWriters < 1) {
+            numWriters = 1;
+        }
+    } else if (fileList != "") {
+        cout << "File list: " << fileList << endl;
+        cout << "Jobs: " << jobs << endl;
+        cout << "Rows per task: " << taskRows << endl;
+        if (jobs < 1) {
+            SagIngest_error("jobs must be at least 1.");
+        }
+        if (numWriters < 1) {
+            numWriters = 1;
+        }
+        if (aggregateFile != "" || partitionBy != "") {
+            SagIngest_error("Aggregates and partitioned ingest are not supported with a file list.");
+        }
+        if (manifestFile != "") {
+            cout << "Manifest: " << manifestFile << endl;
+        }
+        if (virtualFile != "") {
+            cout << "Virtual file: " << virtualFile << endl;
+            if (manifestFile != "") {
+                SagIngest_error("A manifest cannot be used with a virtual file.");
+            }
+        }
+    } else {
+        cout << "Data file: " << dataFile << endl;
+    }
+    if (preflight && watchDir != "") {
+        SagIngest_error("Preflight checks are always done in watch mode, for each file before it is ingested.");
+    }
+    if (manifestFile != "" && fileList == "") {
+        SagIngest_error("A manifest can only be used with a file list.");
+    }
+    if (virtualFile != "" && fileList == "") {
+        SagIngest_error("A virtual file can only be built from a file list.");
+    }
+    if (traceFile != "") {
+        cout << "Trace file: " << traceFile << endl;
+        Tracer::enable(traceFile);
+    }
+    if (metricsFile != "") {
+        cout << "Metrics file: " << metricsFile << " (every " << metricsInterval << " s)" << endl;
+    }
+    if (metricsSocket != "") {
+        cout << "Metrics socket: " << metricsSocket << endl;
+    }
+    if (checksumFile != "") {
+        cout << "Checksum file: " << checksumFile << endl;
+        if (partitionBy != "" && planPartitions == 0) {
+            SagIngest_error("Checksums are not supported for partitioned ingest.");
+        }
+    }
     cout << "DB system: " << system << endl;
     cout << "Buffer size: " << bufferSize << endl;
     cout << "Performance output frequency: " << outputFreq << endl;
@@ -155,6 +370,81 @@ int main (int argc, const char * argv[])
         cout << "Path: " << path << endl;
     }
     cout << "Blocksize: " << user_blocksize << endl;
+    if (adaptiveBlocksize) {
+        cout << "Adaptive blocksize: on" << endl;
+    }
+    if (numWriters > 1 || watchDir != "" || fileList != "" || partitionBy != "") {
+        if (queueDepth <= 0) {
+            queueDepth = 2 * numWriters;
+        }
+        cout << "Writer threads: " << numWriters << endl;
+        cout << "Rows per batch: " << batchRows << endl;
+        cout << "Queue depth (batches): " << queueDepth << endl;
+        cout << "Commit every (batches): " << commitBatches << endl;
+    }
+    if (snapnumList != "") {
+        stringstream ss(snapnumList);
+        string item;
+        while (getline(ss, item, ',')) {
+            snapnums.push_back(atoi(item.c_str()));
+        }
+        cout << "Snapshot numbers: " << snapnumList << endl;
+    }
+    if (sortKey != "") {
+        cout << "Sort key: " << sortKey << endl;
+        cout << "Sort memory (MB): " << sortMemory << endl;
+        cout << "Sort tmp directory: " << sortTmpDir << endl;
+    }
+    if (maxMemory > 0) {
+        cout << "Max. memory (MB): " << maxMemory << endl;
+        if (sortKey != "" && sortMemory > maxMemory/2) {
+            sortMemory = max(maxMemory/2, 1L);
+            cout << "Sort memory reduced to " << sortMemory << " MB (half of maxMemory)" << endl;
+        }
+    }
+    if (sortKey == "phkey") {
+        cout << "Box size: " << boxSize << endl;
+        cout << "Bits per dimension for phkey: " << phBits << endl;
+        if (boxSize <= 0) {
+            SagIngest_error("Sorting by phkey requires a positive boxSize.");
+        }
+    }
+
+    if (decompressThreads > 0) {
+        cout << "Decompression threads: " << decompressThreads << endl;
+    }
+    PartitionSpec partitionSpec;
+    if (partitionBy != "") {
+        partitionSpec.column = partitionBy;
+        partitionSpec.mode = partitionMode;
+        partitionSpec.numPartitions = partitions;
+        partitionSpec.maxPartitions = maxPartitions;
+        stringstream ss(partitionBounds);
+        string item;
+        while (getline(ss, item, ',')) {
+            partitionSpec.bounds.push_back(atof(item.c_str()));
+        }
+        cout << "Partition column: " << partitionBy << endl;
+        if (planPartitions > 0) {
+            cout << "Planning " << planPartitions << " range partitions" << endl;
+        } else {
+            cout << "Partition mode: " << partitionMode << endl;
+            cout << "Maximum partitions: " << maxPartitions << endl;
+        }
+        if (watchDir != "") {
+            SagIngest_error("Partitioned ingest is not supported in watch mode.");
+        }
+    }
+    AggregateSpec aggregateSpec;
+    if (aggregateFile != "") {
+        if (aggregateTable == "") {
+            aggregateTable = table + "_summary";
+        }
+        aggregateSpec.readSpecFile(aggregateFile);
+        cout << "Aggregates: " << aggregateFile << " (" << aggregateSpec.keys.size() << " keys, "
+             << aggregateSpec.items.size() << " aggregates)" << endl;
+        cout << "Summary table: " << aggregateTable << endl;
+    }
 
     cout << endl;
 
@@ -173,62 +463,339 @@ int main (int argc, const char * argv[])
     thisSchema = thisSchemaMapper->generateSchema(dbase, table);
 
     //now setup the file reader
+    ReaderSettings readerSettings;
+    readerSettings.blocksize = user_blocksize;
+    readerSettings.snapnums = snapnums;
+    readerSettings.sortKey = sortKey;
+    readerSettings.sortMemory = sortMemory*1024L*1024L;
+    readerSettings.sortTmpDir = sortTmpDir;
+    readerSettings.boxSize = boxSize;
+    readerSettings.phBits = phBits;
+    readerSettings.decompressThreads = decompressThreads;
+    readerSettings.ioOrder = ioOrder;
+    readerSettings.mergeGap = (mergeGap < 0) ? -1 : mergeGap*1024L;
+    readerSettings.multiRead = multiRead;
+    if (partitionBy != "" && sortKey != "phkey") {
+        // phkey is usually NULL, but the partition key must be known for each row
+        int j = findSchemaColumn(thisSchema, partitionBy);
+        if (j >= 0 && thisSchema->getArrSchemaItems()[j]->getDataDesc()->getDataObjName() == "phkey") {
+            cout << "Computing phkey for partitioning (box size: " << boxSize << ", bits per dimension: " << phBits << ")" << endl;
+            if (boxSize <= 0) {
+                SagIngest_error("Partitioning by phkey requires a positive boxSize.");
+            }
+            readerSettings.computePHKey = true;
+        }
+    }
+    readerSettings.adaptiveBlocksize = adaptiveBlocksize;
+    readerSettings.precisions = thisSchemaMapper->getPrecisions();
+    readerSettings.nulls = thisSchemaMapper->getNulls();
+
+    ZoneMapWriter * zoneMap = NULL;
+    if (zoneMapFile != "") {
+        cout << "Zone map file: " << zoneMapFile << endl;
+        zoneMap = new ZoneMapWriter(zoneMapFile, thisSchema, zoneMapBins);
+        readerSettings.zoneMap = zoneMap;
+    }
+
+    ChecksumSet * checksums = NULL;
+    if (checksumFile != "") {
+        checksums = new ChecksumSet(thisSchema, table);
+        readerSettings.checksums = checksums;
+    }
+
+    MemoryBudget * memory = NULL;
+    if (maxMemory > 0) {
+        memory = new MemoryBudget(maxMemory*1024L*1024L);
+        readerSettings.memory = memory;
+    }
+
+    Metrics * metrics = NULL;
+    MetricsExporter * metricsExporter = NULL;
+    if (metricsFile != "" || metricsSocket != "") {
+        metrics = new Metrics();
+        metrics->setMemoryBudget(memory);
+        readerSettings.metrics = metrics;
+        metricsExporter = new MetricsExporter(metrics, metricsFile, metricsSocket, metricsInterval);
+        metricsExporter->start();
+    }
+
+    // connection settings, shared by all ingestors
+    DBConnInfo conn;
+    conn.system = system;
+    conn.dbase = dbase;
+    conn.table = table;
+    conn.socket = socket;
+    conn.user = user;
+    conn.pwd = pwd;
+    conn.port = port;
+    conn.host = host;
+    conn.path = path;
+    conn.resumeMode = resumeMode;
+    conn.isDryRun = isDryRun;
+    conn.askUserToValidateRead = askUserToValidateRead;
+    conn.outputFreq = outputFreq;
+    conn.commitBatches = commitBatches;
+
+    if (watchDir != "") {
+        // daemon mode: always use the writer pool, so that the database
+        // connections stay open between files
+        conn.askUserToValidateRead = false;
+        RowBatchQueue batchQueue(queueDepth);
+        batchQueue.setMemoryBudget(memory);
+        batchQueue.setMetrics(metrics);
+        if (metrics) {
+            metrics->setQueue(&batchQueue);
+        }
+        WriterPool writerPool(&batchQueue, conn, bufferSize);
+
+        vector<DBDataSchema::Schema*> writerSchemas;
+        for (int i=0; i<numWriters; i++) {
+            writerSchemas.push_back(thisSchemaMapper->generateSchema(dbase, table));
+        }
+        vector<DBDataSchema::Schema*> jobSchemas;
+        for (int i=0; i<watchJobs; i++) {
+            jobSchemas.push_back(thisSchemaMapper->generateSchema(dbase, table));
+        }
+
+        DirWatcher watcher(watchDir, watchSuffix, watchSettle, watchGrace, watchExisting);
+        WatchDaemon daemon(&watcher, datafileFieldNames, readerSettings, jobSchemas, &batchQueue, batchRows, watchIdleExit);
+        if (aggregateFile != "") {
+            daemon.setSummary(aggregateSpec, conn, aggregateTable, bufferSize);
+        }
+
+        writerPool.start(writerSchemas);
+        daemon.run();
+        batchQueue.close();
+
+        writerPool.join();
+        writerPool.printStats();
+        if (writerPool.getNumRows() != daemon.getNumRows()) {
+            SagIngest_error("Number of rows flushed by the writers does not match the number of read rows.");
+        }
+
+        for (int i=0; i<numWriters; i++) {
+            delete writerSchemas[i];
+        }
+        for (int i=0; i<watchJobs; i++) {
+            delete jobSchemas[i];
+        }
+
+        return finishIngest(metricsExporter, metrics, checksums, checksumFile, zoneMap, memory, thisSchemaMapper, thisSchema);
+    }
+
+    if (fileList != "") {
+        // many files: tasks of all files are taken by the jobs, largest
+        // first, all rows go through one writer pool
+        conn.askUserToValidateRead = false;
+        RowBatchQueue batchQueue(queueDepth);
+        batchQueue.setMemoryBudget(memory);
+        batchQueue.setMetrics(metrics);
+        if (metrics) {
+            metrics->setQueue(&batchQueue);
+        }
+        WriterPool writerPool(&batchQueue, conn, bufferSize);
+
+        vector<DBDataSchema::Schema*> writerSchemas;
+        for (int i=0; i<numWriters; i++) {
+            writerSchemas.push_back(thisSchemaMapper->generateSchema(dbase, table));
+        }
+        vector<DBDataSchema::Schema*> jobSchemas;
+        for (int i=0; i<jobs; i++) {
+            jobSchemas.push_back(thisSchemaMapper->generateSchema(dbase, table));
+        }
+
+        FileScheduler scheduler(datafileFieldNames, readerSettings, jobSchemas, &batchQueue, batchRows, taskRows);
+        Manifest * manifest = NULL;
+        if (manifestFile != "") {
+            manifest = new Manifest(manifestFile);
+            scheduler.setManifest(manifest, hashFileContents(mapFile));
+        }
+        ifstream listStream(fileList.c_str());
+        if (!listStream) {
+            SagIngest_error("Could not open the file list.");
+        }
+        string line;
+        int index = 0;
+        vector<string> listFiles;
+        vector<int> listFileNums;
+        while (getline(listStream, line)) {
+            stringstream ls(line);
+            string listFile;
+            int listFileNum;
+            if (!(ls >> listFile) || listFile[0] == '#') {
+                continue;
+            }
+            if (!(ls >> listFileNum)) {
+                listFileNum = fileNumFromName(listFile, index);
+            }
+            listFiles.push_back(listFile);
+            listFileNums.push_back(listFileNum);
+            index++;
+        }
+        if (preflight) {
+            Preflight checker(datafileFieldNames, thisSchema, readerSettings.snapnums);
+            checker.setPrecisions(readerSettings.precisions);
+            if (!checker.run(listFiles, max(jobs, 4))) {
+                SagIngest_error("Preflight checks failed, nothing was ingested.");
+            }
+        }
+        if (virtualFile != "") {
+            // all files are read through one virtual file, which is split
+            // into tasks like one large file
+            buildVirtualFile(virtualFile, listFiles, listFileNums, datafileFieldNames);
+            scheduler.addFile(virtualFile, 0);
+        } else {
+            for (int i=0; i<listFiles.size(); i++) {
+                scheduler.addFile(listFiles[i], listFileNums[i]);
+            }
+        }
+        cout << "Files: " << index << " (" << scheduler.getNumSkipped() << " skipped), tasks: " << scheduler.getNumTasks() << endl;
+
+        writerPool.setFlushListener(&scheduler);
+        writerPool.start(writerSchemas);
+        scheduler.run();
+        batchQueue.close();
+
+        writerPool.join();
+        scheduler.printStats();
+        writerPool.printStats();
+        if (writerPool.getNumRows() != scheduler.getNumRows()) {
+            SagIngest_error("Number of rows flushed by the writers does not match the number of read rows.");
+        }
+        scheduler.writeManifest();
+        if (manifest) {
+            delete manifest;
+        }
+
+        for (int i=0; i<numWriters; i++) {
+            delete writerSchemas[i];
+        }
+        for (int i=0; i<jobs; i++) {
+            delete jobSchemas[i];
+        }
+
+        return finishIngest(metricsExporter, metrics, checksums, checksumFile, zoneMap, memory, thisSchemaMapper, thisSchema);
+    }
+
+    if (preflight) {
+        Preflight checker(datafileFieldNames, thisSchema, readerSettings.snapnums);
+        checker.setPrecisions(readerSettings.precisions);
+        if (!checker.run(vector<string>(1, dataFile), 1)) {
+            SagIngest_error("Preflight checks failed, nothing was ingested.");
+        }
+    }
+
     SagReader *thisReader = new SagReader(dataFile, fileNum, user_blocksize, datafileFieldNames);
-    dbServer = adaptorFac.getDBAdaptors(system);
-    
-    sagIngestor = new DBIngest::DBIngestor(thisSchema, thisReader, dbServer);
-    sagIngestor->setUsrName(user);
-    sagIngestor->setPasswd(pwd);
-
-    //settings for different DBs (copy&paste from AsciiIngest)
-    if(system.compare("mysql") == 0) {
-        sagIngestor->setSocket(socket);
-        sagIngestor->setPort(port);
-        sagIngestor->setHost(host);
-    } else if (system.compare("sqlite3") == 0) {
-        sagIngestor->setHost(path);
-    } else if (system.compare("unix_sqlsrv_odbc") == 0) {
-        sagIngestor->setSocket("DRIVER=FreeTDS;TDS_Version=7.0;");
-        //sagIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
-        sagIngestor->setPort(port);
-        sagIngestor->setHost(host);
-    } else if (system.compare("sqlsrv_odbc") == 0) {
-        sagIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
-        sagIngestor->setPort(port);
-        sagIngestor->setHost(host);
-    } else if (system.compare("sqlsrv_odbc_bulk") == 0) {
-        //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
-        sagIngestor->setSocket("DRIVER=SQL Server Native Client 10.0;");
-        sagIngestor->setPort(port);
-        sagIngestor->setHost(host);
-    }  else if (system.compare("cust_odbc") == 0) {
-        sagIngestor->setSocket(socket);
-        sagIngestor->setPort(port);
-        sagIngestor->setHost(host);
-    } else if (system.compare("cust_odbc_bulk") == 0) {
-        //TESTS ON SQL SERVER SHOWED THIS IS VERY SLOW. BUT NO CLUE WHY, DID NOT BOTHER TO LOOK AT PROFILER YET
-        sagIngestor->setSocket(socket);
-        sagIngestor->setPort(port);
-        sagIngestor->setHost(host);
+    thisReader->applySettings(readerSettings);
+    if (metrics) {
+        metrics->addExpectedRows(thisReader->countRows());
+    }
+
+    if (partitionBy != "" && planPartitions > 0) {
+        // planning pass only: print boundaries for --partitionBounds
+        vector<double> bounds = planPartitionBounds(thisReader, thisSchema, partitionBy, planPartitions);
+        DBDataSchema::DType partType = thisSchema->getArrSchemaItems()[findSchemaColumn(thisSchema, partitionBy)]->getDataDesc()->getDataObjDType();
+        bool isInt = (partType != DBDataSchema::DT_REAL4 && partType != DBDataSchema::DT_REAL8);
+        cout.precision(17);
+        cout << "--partitionMode range --partitionBounds ";
+        for (int i=0; i<bounds.size(); i++) {
+            cout << ((i > 0) ? "," : "");
+            if (isInt) {
+                cout << (long) bounds[i];
+            } else {
+                cout << bounds[i];
+            }
+        }
+        cout << endl;
+
+        delete thisReader;
+        return finishIngest(metricsExporter, metrics, checksums, checksumFile, zoneMap, memory, thisSchemaMapper, thisSchema);
     }
+
+    // optionally pass the rows through the aggregator on their way
+    Aggregator * aggregator = NULL;
+    DBReader::Reader * ingestReader = thisReader;
+    if (aggregateFile != "") {
+        aggregator = new Aggregator(aggregateSpec);
+        ingestReader = new AggregatingReader(thisReader, thisSchema, aggregator);
+    }
+
+    if (partitionBy != "") {
+        // route the rows to the partition tables, each with its own writers
+        conn.askUserToValidateRead = false;
+        PartitionRouter router(partitionSpec, thisSchema, thisSchemaMapper, conn, bufferSize, numWriters, batchRows, queueDepth);
+        router.setMemoryBudget(memory);
+        router.setMetrics(metrics);
+
+        cout << "Go now! (partitioned by " << partitionBy << ")" << endl;
+        router.run(ingestReader);
+        router.finish();
+        cout << "Read " << router.getNumRows() << " rows." << endl;
+        if (router.getNumWrittenRows() != router.getNumRows()) {
+            SagIngest_error("Number of rows flushed by the writers does not match the number of read rows.");
+        }
+    } else if (numWriters <= 1) {
+        dbServer = adaptorFac.getDBAdaptors(system);
     
-    // setup resume option, if desired
-    sagIngestor->setResumeMode(resumeMode); 
-    sagIngestor->setIsDryRun(isDryRun);
-    sagIngestor->setAskUserToValidateRead(askUserToValidateRead); 
+        // no writer threads: the reader counts the rows handed to the database
+        thisReader->setCountWritten(true);
+        sagIngestor = new DBIngest::DBIngestor(thisSchema, ingestReader, dbServer);
+        setupIngestor(sagIngestor, conn);
    
-    cout << "now everything ready to ingest ..." << endl;
+        cout << "now everything ready to ingest ..." << endl;
    
-    //now ingest data after setup
-    sagIngestor->setPerformanceMeter(outputFreq);	// after how many lines should I print the status?
-    cout << "Go now!" << endl;
-    sagIngestor->ingestData(bufferSize);  		// buffer size (in bytes??)
-    
-    delete thisSchemaMapper;
-    delete thisSchema;
+        //now ingest data after setup
+        cout << "Go now!" << endl;
+        TraceSpan span("ingest", "db");
+        sagIngestor->ingestData(bufferSize);  		// buffer size (in bytes??)
+    } else {
+        // read rows into a bounded queue of batches, which is drained by
+        // numWriters threads with their own database connections
+        RowBatchQueue batchQueue(queueDepth);
+        batchQueue.setMemoryBudget(memory);
+        batchQueue.setMetrics(metrics);
+        if (metrics) {
+            metrics->setQueue(&batchQueue);
+        }
+        WriterPool writerPool(&batchQueue, conn, bufferSize);
+
+        vector<DBDataSchema::Schema*> writerSchemas;
+        for (int i=0; i<numWriters; i++) {
+            writerSchemas.push_back(thisSchemaMapper->generateSchema(dbase, table));
+        }
+
+        cout << "now everything ready to ingest ..." << endl;
+        cout << "Go now! (with " << numWriters << " writers)" << endl;
+        writerPool.start(writerSchemas);
+
+        BatchProducer producer(ingestReader, thisSchema, &batchQueue, batchRows);
+        producer.run();
+        batchQueue.close();
+
+        writerPool.join();
+        if (metrics) {
+            metrics->setQueue(NULL);
+        }
+        cout << "Read " << producer.getNumBatches() << " batches, " << producer.getNumRows() << " rows." << endl;
+        writerPool.printStats();
+        if (writerPool.getNumRows() != producer.getNumRows() || writerPool.getNumBatches() != producer.getNumBatches()) {
+            SagIngest_error("Number of rows/batches flushed by the writers does not match the number of read rows/batches.");
+        }
+
+        for (int i=0; i<numWriters; i++) {
+            delete writerSchemas[i];
+        }
+    }
+
+    if (aggregator) {
+        writeSummary(aggregator, conn, aggregateTable, bufferSize);
+        delete ingestReader;
+        delete aggregator;
+    }
+
     //delete assertFac;
     //delete convFac;
 
-    return 0;
+    return finishIngest(metricsExporter, metrics, checksums, checksumFile, zoneMap, memory, thisSchemaMapper, thisSchema);
 }
 